@@ -0,0 +1,36 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+/*
+ * Small event loop.
+ * The functions posted with event_post() and the expired timers run in
+ * order on the event thread, they must not block.
+ * Blocking work is posted with event_job(): it runs on a worker thread
+ * and its completion function is then posted to the event thread.
+ */
+
+#define EVENT_TIMERS_NUM    8
+// Max wait of the event thread, it bounds the error of a clock change
+#define EVENT_MAX_WAIT      1000
+
+typedef void(*event_func_t)(void *arg);
+
+int event_init();
+void event_stop();
+
+int event_post(event_func_t f, void *arg);
+int event_job(event_func_t job, event_func_t done, void *arg);
+
+int event_timer_set(int id, int ms, event_func_t f, void *arg);
+void event_timer_cancel(int id);
+int event_timer_pending(int id);
+
+#endif // EVENT_H
@@ -0,0 +1,24 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define RESIZE_JPG_BIN          "/mnt/mmc/sonoff-hack/bin/resize_jpg"
+
+// Max size of the low resolution jpg and max time to create it, in ms
+#define IMAGE_LOW_MAX_SIZE      (128 * 1024)
+#define IMAGE_RESIZE_TIMEOUT    5000
+
+int image_resize(const unsigned char *jpg, int len, unsigned char *out, int size, int scale, int quality);
+
+#endif // IMAGE_H
@@ -7,28 +7,72 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
+#include <signal.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/file.h>
 
 #include "config.h"
 #include "sql.h"
 #include "mqtt.h"
 #include "cJSON.h"
+#include "libsnapshot.h"
+#include "event.h"
+#include "image.h"
 
 #define MQTT_SONOFF_VERSION      "0.1.0"
 #define MQTT_SONOFF_CONF_FILE    "/mnt/mmc/sonoff-hack/etc/mqtt-sonoff.conf"
 #define COLINK_CONF_FILE         "/mnt/mtd/ipc/cfg/colink.conf"
 #define HACK_VERSION_FILE        "/mnt/mmc/sonoff-hack/version"
+#define MQTT_SONOFF_PID_FILE     "/var/run/mqtt-sonoff.pid"
 
-#define MQTT_SONOFF_SNAPSHOT     "/mnt/mmc/sonoff-hack/bin/snapshot"
+// Scripts run by the messages to <prefix>/cmnd
+#define CONF2MQTT_SCRIPT         "/mnt/mmc/sonoff-hack/script/conf2mqtt.sh"
+#define SWITCH_ON_SCRIPT         "/mnt/mmc/sonoff-hack/script/privacy.sh"
+// The settings received within this time (ms) are written together
+#define COMMAND_BATCH_WAIT       20
+
+// The privacy is enabled while this file exists
+#define PRIVACY_DIR              "/tmp"
+#define PRIVACY_FILE_NAME        "privacy"
+#define PRIVACY_FILE             PRIVACY_DIR "/" PRIVACY_FILE_NAME
+// Check interval of the file in ms if inotify is not available
+#define PRIVACY_POLL_INTERVAL    500
+
+// Motion stop is sent after the last motion + MOTION_STOP_DELAY ms
+#define MOTION_STOP_DELAY        10000
+
+#define TIMER_MOTION_STOP        0
+#define TIMER_MOTION_IMAGE       1
+#define TIMER_MOTION_BURST       2
+
+// Wait in ms before trying again a capture while another one is running
+#define MOTION_IMAGE_RETRY       50
+
+#define MOTION_BURST_SEQUENCE    0
+#define MOTION_BURST_MJPEG       1
+#define MOTION_BURST_MAX_FRAMES  20
+#define MOTION_BURST_MAX_SIZE    (2 * 1024 * 1024)
 
 typedef struct
 {
     char    *mqtt_prefix;
     char    *mqtt_prefix_stat;
+    char    *mqtt_prefix_cmnd;
     char    *topic_birth_will;
     char    *topic_motion;
     char    *topic_motion_image;
     double   motion_image_delay;
+    char    *topic_motion_image_low;
+    int      motion_image_low_scale;
+    int      motion_image_low_quality;
+    char    *topic_motion_burst;
+    int      motion_burst_frames;
+    double   motion_burst_interval;
+    int      motion_burst_mode;
     char    *birth_msg;
     char    *will_msg;
     char    *motion_start_msg;
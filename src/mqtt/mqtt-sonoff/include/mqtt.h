@@ -2,13 +2,42 @@
 #define MQTT_H
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <mosquitto.h>
 
 #define EMPTY_TOPIC         ""
 
+// Reconnection backoff and max wait of the CONNACK, in ms
+#define MQTT_RETRY_MIN      1000
+#define MQTT_RETRY_MAX      60000
+#define MQTT_CONNACK_WAIT   10000
+
+// Messages kept in memory while disconnected, the events exceeding
+// MQTT_QUEUE_MAX_SIZE bytes are written to the journal on the sd
+#define MQTT_QUEUE_MAX_SIZE     (1024 * 1024)
+#define MQTT_JOURNAL_FILE       "/mnt/mmc/mqtt-sonoff.journal"
+#define MQTT_JOURNAL_MAX_SIZE   (16 * 1024 * 1024)
+#define MQTT_JOURNAL_MAGIC      0x514d
+// Max queued messages handed to mosquitto for each write of the socket
+#define MQTT_FLUSH_MAX_COUNT    8
+// Wait before trying again when nothing of the queue could be sent, in ms
+#define MQTT_FLUSH_RETRY        1000
+
+// Topics subscribed at every connection
+#define MQTT_MAX_SUBSCRIPTIONS  4
+
+// Max number of pollfd used by the mqtt loop
+#define MQTT_POLL_FDS       2
+
 typedef struct
 {
     char       *client_id;
@@ -37,15 +66,19 @@ typedef struct
     int len;
 } mqtt_msg_t;
 
+typedef void (*mqtt_message_func_t)(const char *topic, const char *payload, int len);
+
 int init_mqtt(void);
 void stop_mqtt(void);
 
-void mqtt_loop(void);
+int mqtt_poll_fds(struct pollfd *fds);
+int mqtt_poll_timeout(void);
+void mqtt_poll_handle(struct pollfd *fds, int nfds);
 
 void mqtt_init_conf(mqtt_conf_t *conf);
 void mqtt_set_conf(mqtt_conf_t *conf);
-void mqtt_check_connection();
 int mqtt_send_message(mqtt_msg_t *msg, int retain);
+int mqtt_subscribe(const char *topic, mqtt_message_func_t f);
 
 int mqtt_connect();
 
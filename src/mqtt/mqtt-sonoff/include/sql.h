@@ -23,16 +23,31 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <pthread.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/inotify.h>
 #include <mqueue.h>
 #include <sqlite3.h>
 
 #define SQL_DEBUG             0
 
+// Overridden by the host tests in ../test
+#ifndef IPCSYS_DB
 #define IPCSYS_DB             "/mnt/mtd/db/ipcsys.db"
+#endif
+#ifndef IPCMMC_DB
 #define IPCMMC_DB             "/mnt/mmc/AVRecordFile.db"
+#endif
+
+// The dbs are read only when inotify reports a write to them (or to
+// their journal/wal), at least every SQL_MAX_WAIT ms
+#define SQL_MAX_WAIT          5000
+#define SQL_POLL_WAIT         1000
+#define SQL_BUSY_TIMEOUT      200
 
 typedef enum
 {
@@ -74,5 +89,8 @@ void sql_stop();
 //-----------------------------------------------------------------------------
 
 int sql_set_callback(SQL_MESSAGE_TYPE type, void (*f)());
+int sql_update_begin();
+int sql_update(char *key, char *value);
+int sql_update_end();
 
 #endif // SQL_H
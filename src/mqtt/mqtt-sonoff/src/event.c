@@ -0,0 +1,317 @@
+#include "event.h"
+
+typedef struct event_item
+{
+    event_func_t f;
+    event_func_t done;
+    void *arg;
+    struct event_item *next;
+} event_item_t;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    event_item_t *head;
+    event_item_t *tail;
+} event_queue_t;
+
+typedef struct
+{
+    int active;
+    long long due;
+    event_func_t f;
+    void *arg;
+} event_timer_t;
+
+static event_queue_t events;
+static event_queue_t jobs;
+// Protected by the events mutex
+static event_timer_t timers[EVENT_TIMERS_NUM];
+
+static pthread_t tr_event;
+static pthread_t tr_job;
+static int event_routine = 0;
+
+static void *event_thread(void *args);
+static void *job_thread(void *args);
+
+//-----------------------------------------------------------------------------
+// UTILS
+//-----------------------------------------------------------------------------
+
+static long long now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void queue_init(event_queue_t *q)
+{
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    q->head = NULL;
+    q->tail = NULL;
+}
+
+static int queue_push(event_queue_t *q, event_func_t f, event_func_t done, void *arg)
+{
+    event_item_t *e;
+
+    if (f == NULL)
+        return -1;
+
+    e = malloc(sizeof(event_item_t));
+    if (e == NULL) {
+        fprintf(stderr, "Can't allocate event\n");
+        return -1;
+    }
+    e->f = f;
+    e->done = done;
+    e->arg = arg;
+    e->next = NULL;
+
+    pthread_mutex_lock(&q->mutex);
+    if (q->tail != NULL)
+        q->tail->next = e;
+    else
+        q->head = e;
+    q->tail = e;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+
+    return 0;
+}
+
+static event_item_t *queue_pop_locked(event_queue_t *q)
+{
+    event_item_t *e = q->head;
+
+    if (e != NULL) {
+        q->head = e->next;
+        if (q->head == NULL)
+            q->tail = NULL;
+    }
+
+    return e;
+}
+
+static void queue_free(event_queue_t *q)
+{
+    event_item_t *e;
+
+    pthread_mutex_lock(&q->mutex);
+    while ((e = queue_pop_locked(q)) != NULL)
+        free(e);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+// The condition uses the realtime clock, so the wait is kept short
+static void wait_locked(event_queue_t *q, long long ms)
+{
+    struct timeval now;
+    struct timespec ts;
+
+    if (ms > EVENT_MAX_WAIT)
+        ms = EVENT_MAX_WAIT;
+    if (ms < 1)
+        ms = 1;
+
+    gettimeofday(&now, NULL);
+    ts.tv_sec = now.tv_sec + ms / 1000;
+    ts.tv_nsec = now.tv_usec * 1000 + (ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&q->cond, &q->mutex, &ts);
+}
+
+//-----------------------------------------------------------------------------
+// INIT
+//-----------------------------------------------------------------------------
+
+int event_init()
+{
+    int ret;
+
+    memset(timers, 0, sizeof(timers));
+    queue_init(&events);
+    queue_init(&jobs);
+    event_routine = 1;
+
+    ret = pthread_create(&tr_event, NULL, &event_thread, NULL);
+    if (ret != 0) {
+        fprintf(stderr, "Can't create event thread. Error: %d\n", ret);
+        event_routine = 0;
+        return -1;
+    }
+    ret = pthread_create(&tr_job, NULL, &job_thread, NULL);
+    if (ret != 0) {
+        fprintf(stderr, "Can't create job thread. Error: %d\n", ret);
+        event_stop();
+        return -2;
+    }
+
+    return 0;
+}
+
+void event_stop()
+{
+    if (!event_routine)
+        return;
+
+    pthread_mutex_lock(&events.mutex);
+    pthread_mutex_lock(&jobs.mutex);
+    event_routine = 0;
+    pthread_cond_broadcast(&events.cond);
+    pthread_cond_broadcast(&jobs.cond);
+    pthread_mutex_unlock(&jobs.mutex);
+    pthread_mutex_unlock(&events.mutex);
+
+    pthread_join(tr_event, NULL);
+    pthread_join(tr_job, NULL);
+
+    queue_free(&events);
+    queue_free(&jobs);
+}
+
+//-----------------------------------------------------------------------------
+// THREADS
+//-----------------------------------------------------------------------------
+
+static void *event_thread(void *args)
+{
+    event_item_t *e;
+    event_func_t f;
+    void *arg = NULL;
+    long long now, next;
+    int armed;
+    int i;
+
+    pthread_mutex_lock(&events.mutex);
+    while (event_routine) {
+        e = queue_pop_locked(&events);
+        if (e != NULL) {
+            pthread_mutex_unlock(&events.mutex);
+            (*e->f)(e->arg);
+            free(e);
+            pthread_mutex_lock(&events.mutex);
+            continue;
+        }
+
+        // Run the first expired timer or wait the next one
+        f = NULL;
+        armed = 0;
+        now = now_ms();
+        next = now + EVENT_MAX_WAIT;
+        for (i = 0; i < EVENT_TIMERS_NUM; i++) {
+            if (!timers[i].active)
+                continue;
+            armed = 1;
+            if (timers[i].due <= now) {
+                timers[i].active = 0;
+                f = timers[i].f;
+                arg = timers[i].arg;
+                break;
+            }
+            if (timers[i].due < next)
+                next = timers[i].due;
+        }
+        if (f != NULL) {
+            pthread_mutex_unlock(&events.mutex);
+            (*f)(arg);
+            pthread_mutex_lock(&events.mutex);
+            continue;
+        }
+
+        // Without timers sleep until something is posted
+        if (armed)
+            wait_locked(&events, next - now);
+        else
+            pthread_cond_wait(&events.cond, &events.mutex);
+    }
+    pthread_mutex_unlock(&events.mutex);
+
+    return NULL;
+}
+
+static void *job_thread(void *args)
+{
+    event_item_t *e;
+
+    pthread_mutex_lock(&jobs.mutex);
+    while (event_routine) {
+        e = queue_pop_locked(&jobs);
+        if (e == NULL) {
+            pthread_cond_wait(&jobs.cond, &jobs.mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&jobs.mutex);
+        (*e->f)(e->arg);
+        if (e->done != NULL)
+            event_post(e->done, e->arg);
+        free(e);
+        pthread_mutex_lock(&jobs.mutex);
+    }
+    pthread_mutex_unlock(&jobs.mutex);
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// GETTERS AND SETTERS
+//-----------------------------------------------------------------------------
+
+int event_post(event_func_t f, void *arg)
+{
+    return queue_push(&events, f, NULL, arg);
+}
+
+int event_job(event_func_t job, event_func_t done, void *arg)
+{
+    return queue_push(&jobs, job, done, arg);
+}
+
+// Arm the timer id to call f after ms, an armed timer is moved
+int event_timer_set(int id, int ms, event_func_t f, void *arg)
+{
+    if ((id < 0) || (id >= EVENT_TIMERS_NUM) || (f == NULL))
+        return -1;
+
+    pthread_mutex_lock(&events.mutex);
+    timers[id].active = 1;
+    timers[id].due = now_ms() + ms;
+    timers[id].f = f;
+    timers[id].arg = arg;
+    pthread_cond_signal(&events.cond);
+    pthread_mutex_unlock(&events.mutex);
+
+    return 0;
+}
+
+void event_timer_cancel(int id)
+{
+    if ((id < 0) || (id >= EVENT_TIMERS_NUM))
+        return;
+
+    pthread_mutex_lock(&events.mutex);
+    timers[id].active = 0;
+    pthread_mutex_unlock(&events.mutex);
+}
+
+int event_timer_pending(int id)
+{
+    int ret;
+
+    if ((id < 0) || (id >= EVENT_TIMERS_NUM))
+        return 0;
+
+    pthread_mutex_lock(&events.mutex);
+    ret = timers[id].active;
+    pthread_mutex_unlock(&events.mutex);
+
+    return ret;
+}
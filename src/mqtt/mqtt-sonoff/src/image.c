@@ -0,0 +1,128 @@
+#include "image.h"
+
+static long long now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Scale the jpg to 1/scale with resize_jpg and write the result in out.
+ * The jpg is piped to the process and the result is read at the same
+ * time, so nothing is written to a file.
+ * Return the size of the new jpg or -1.
+ */
+int image_resize(const unsigned char *jpg, int len, unsigned char *out, int size, int scale, int quality)
+{
+    char s_scale[16], s_quality[16];
+    int fd_in[2], fd_out[2];
+    struct pollfd fds[2];
+    long long deadline, left;
+    int written, n, ret;
+    int status;
+    pid_t pid;
+
+    sprintf(s_scale, "%d", scale);
+    sprintf(s_quality, "%d", quality);
+
+    if (pipe(fd_in) != 0)
+        return -1;
+    if (pipe(fd_out) != 0) {
+        close(fd_in[0]);
+        close(fd_in[1]);
+        return -1;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        close(fd_in[0]);
+        close(fd_in[1]);
+        close(fd_out[0]);
+        close(fd_out[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        signal(SIGPIPE, SIG_DFL);
+        dup2(fd_in[0], STDIN_FILENO);
+        dup2(fd_out[1], STDOUT_FILENO);
+        close(fd_in[0]);
+        close(fd_in[1]);
+        close(fd_out[0]);
+        close(fd_out[1]);
+        execl(RESIZE_JPG_BIN, RESIZE_JPG_BIN, "-i", "-", "-o", "-",
+                "-s", s_scale, "-q", s_quality, (char *) NULL);
+        _exit(127);
+    }
+    close(fd_in[0]);
+    close(fd_out[1]);
+    fcntl(fd_in[1], F_SETFL, O_NONBLOCK);
+
+    // The output could fill the pipe before the input is consumed
+    written = 0;
+    ret = 0;
+    deadline = now_ms() + IMAGE_RESIZE_TIMEOUT;
+    while ((left = deadline - now_ms()) > 0) {
+        fds[0].fd = fd_out[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = fd_in[1];
+        fds[1].events = POLLOUT;
+
+        n = poll(fds, (fd_in[1] >= 0) ? 2 : 1, (int) left);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ret = -1;
+            break;
+        }
+        if (n == 0) {
+            fprintf(stderr, "Timeout resizing the image\n");
+            ret = -1;
+            break;
+        }
+
+        if ((fd_in[1] >= 0) && (fds[1].revents & (POLLOUT | POLLERR | POLLHUP))) {
+            n = write(fd_in[1], jpg + written, len - written);
+            if (n > 0)
+                written += n;
+            if (((n < 0) && (errno != EAGAIN) && (errno != EINTR)) || (written == len)) {
+                close(fd_in[1]);
+                fd_in[1] = -1;
+            }
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            if (ret == size) {
+                fprintf(stderr, "Resized image too big\n");
+                ret = -1;
+                break;
+            }
+            n = read(fd_out[0], out + ret, size - ret);
+            if (n == 0)
+                break;
+            if ((n < 0) && (errno != EINTR)) {
+                ret = -1;
+                break;
+            }
+            if (n > 0)
+                ret += n;
+        }
+    }
+    if (left <= 0)
+        ret = -1;
+
+    if (fd_in[1] >= 0)
+        close(fd_in[1]);
+    close(fd_out[0]);
+
+    if (ret < 0)
+        kill(pid, SIGKILL);
+    while ((waitpid(pid, &status, 0) < 0) && (errno == EINTR));
+    if ((ret > 0) && (!WIFEXITED(status) || (WEXITSTATUS(status) != 0))) {
+        fprintf(stderr, "%s failed\n", RESIZE_JPG_BIN);
+        ret = -1;
+    }
+
+    return ret;
+}
@@ -35,85 +35,221 @@ char *default_topic = EMPTY_TOPIC;
 
 extern char *sql_cmd_params[][2];
 
-void callback_motion_start()
+// Motion state, used only on the event thread
+static int motion_active = 0;
+
+// Commit time of the settings received by mqtt, 0 if nothing is pending
+static long long command_commit = 0;
+
+// Only one snapshot is mapped at a time, the buffers are reused
+typedef struct
+{
+    int busy;
+    int burst;                      // Frame of a burst or motion image
+    const unsigned char *jpg;       // Points to the shared snapshot cache
+    int size;
+    unsigned char *low;
+    int low_size;
+} image_job_t;
+
+// Burst state, the buffer is written by the worker only while a frame is taken
+typedef struct
+{
+    int active;
+    int requested;
+    int taken;
+    int frames;                     // Frames in the buffer
+    unsigned char *buffer;
+    int buffer_size;
+    int size;
+} burst_t;
+
+static image_job_t image;
+static burst_t burst;
+
+static void motion_image(void *arg);
+static void burst_frame(void *arg);
+
+static void motion_publish(char *payload, int len, char *suffix, int retain)
 {
     char topic[128];
-    char cmd[128];
-    char bufferFile[L_tmpnam];
-    FILE *fImage;
-    long int sz;
-    char *bufferImage;
     mqtt_msg_t msg;
 
-    printf("CALLBACK MOTION START\n");
-
-    // Send start message
-    msg.msg=mqtt_sonoff_conf.motion_start_msg;
-    msg.len=strlen(msg.msg);
+    msg.msg=payload;
+    msg.len=len;
     msg.topic=topic;
 
-    sprintf(topic, "%s/%s", mqtt_sonoff_conf.mqtt_prefix, mqtt_sonoff_conf.topic_motion);
-
-    mqtt_send_message(&msg, conf.retain_motion);
+    sprintf(topic, "%s/%s", mqtt_sonoff_conf.mqtt_prefix, suffix);
 
-    if (strlen(mqtt_sonoff_conf.topic_motion_image)) {
-        // Send image
-        printf("Wait %.1f seconds and take a snapshot\n", mqtt_sonoff_conf.motion_image_delay);
-        tmpnam(bufferFile);
-        sprintf(cmd, "%s -f %s", MQTT_SONOFF_SNAPSHOT, bufferFile);
-        usleep((unsigned int) (mqtt_sonoff_conf.motion_image_delay * 1000.0 * 1000.0));
-        system(cmd);
+    mqtt_send_message(&msg, retain);
+}
 
-        fImage = fopen(bufferFile, "r");
-        if (fImage == NULL) {
-            printf("Cannot open image file\n");
-            remove(bufferFile);
-            return;
+// Worker thread: the capture and the resize can take a while
+static void image_job(void *arg)
+{
+    image_job_t *job = (image_job_t *) arg;
+
+    job->low_size = -1;
+    if (job->burst) {
+        // Every frame must be a new one
+        job->size = snapshot_map_cached(&job->jpg, 0, SNAPSHOT_TIMEOUT);
+        if ((job->size > 0) && (burst.buffer != NULL)) {
+            // A mjpeg is just the jpgs one after another
+            if (burst.size + job->size <= burst.buffer_size) {
+                memcpy(burst.buffer + burst.size, job->jpg, job->size);
+                burst.size += job->size;
+                burst.frames++;
+            } else {
+                printf("Burst buffer full, frame dropped\n");
+            }
         }
-        fseek(fImage, 0L, SEEK_END);
-        sz = ftell(fImage);
-        fseek(fImage, 0L, SEEK_SET);
+        return;
+    }
 
-        bufferImage = (char *) malloc(sz * sizeof(char));
-        if (bufferImage == NULL) {
-            printf("Cannot allocate memory\n");
-            fclose(fImage);
-            remove(bufferFile);
-            return;
-        }
-        if (fread(bufferImage, 1, sz, fImage) != sz) {
-            printf("Cannot read image file\n");
-            free(bufferImage);
-            fclose(fImage);
-            remove(bufferFile);
-            return;
+    job->size = snapshot_map_cached(&job->jpg, SNAPSHOT_MAX_AGE, SNAPSHOT_TIMEOUT);
+    if ((job->size > 0) && (job->low != NULL)) {
+        job->low_size = image_resize(job->jpg, job->size, job->low, IMAGE_LOW_MAX_SIZE,
+                mqtt_sonoff_conf.motion_image_low_scale, mqtt_sonoff_conf.motion_image_low_quality);
+    }
+}
+
+static void burst_done(image_job_t *job)
+{
+    if (job->size < 0) {
+        printf("Cannot take burst frame %d: %d\n", burst.taken + 1, job->size);
+    } else {
+        if (burst.buffer == NULL)
+            motion_publish((char *) job->jpg, job->size, mqtt_sonoff_conf.topic_motion_burst, 0);
+        snapshot_unmap_cached();
+    }
+
+    burst.taken++;
+    if (burst.taken < mqtt_sonoff_conf.motion_burst_frames)
+        return;
+
+    if ((burst.buffer != NULL) && (burst.frames > 0)) {
+        printf("SEND MJPEG BURST: %d FRAMES, %d BYTES\n", burst.frames, burst.size);
+        motion_publish((char *) burst.buffer, burst.size, mqtt_sonoff_conf.topic_motion_burst, 0);
+    }
+    burst.active = 0;
+}
+
+static void image_done(void *arg)
+{
+    image_job_t *job = (image_job_t *) arg;
+
+    if (job->burst) {
+        burst_done(job);
+    } else if (job->size < 0) {
+        printf("Cannot take a snapshot: %d\n", job->size);
+    } else {
+        // mosquitto copies the payload, the cache can be released
+        motion_publish((char *) job->jpg, job->size, mqtt_sonoff_conf.topic_motion_image, conf.retain_motion_image);
+        snapshot_unmap_cached();
+
+        if (job->low_size > 0) {
+            motion_publish((char *) job->low, job->low_size, mqtt_sonoff_conf.topic_motion_image_low, conf.retain_motion_image);
+        } else if (job->low != NULL) {
+            printf("Cannot resize the snapshot\n");
         }
+    }
+
+    job->busy = 0;
+}
+
+// Return 0 if the job is started, the timer is moved if another one is running
+static int image_start(int burst_frame, int timer_id, event_func_t f)
+{
+    if (image.busy) {
+        event_timer_set(timer_id, MOTION_IMAGE_RETRY, f, NULL);
+        return -1;
+    }
 
-        msg.msg=bufferImage;
-        msg.len=sz;
-        msg.topic=topic;
+    image.busy = 1;
+    image.burst = burst_frame;
+    if (event_job(&image_job, &image_done, &image) != 0) {
+        image.busy = 0;
+        event_timer_set(timer_id, MOTION_IMAGE_RETRY, f, NULL);
+        return -1;
+    }
 
-        sprintf(topic, "%s/%s", mqtt_sonoff_conf.mqtt_prefix, mqtt_sonoff_conf.topic_motion_image);
+    return 0;
+}
 
-        mqtt_send_message(&msg, conf.retain_motion_image);
+static void motion_image(void *arg)
+{
+    image_start(0, TIMER_MOTION_IMAGE, &motion_image);
+}
 
-        // Clean
-        free(bufferImage);
-        fclose(fImage);
-        remove(bufferFile);
+static void burst_frame(void *arg)
+{
+    if (image_start(1, TIMER_MOTION_BURST, &burst_frame) != 0)
+        return;
+
+    // The interval runs from the start of each capture
+    burst.requested++;
+    if (burst.requested < mqtt_sonoff_conf.motion_burst_frames)
+        event_timer_set(TIMER_MOTION_BURST, (int) (mqtt_sonoff_conf.motion_burst_interval * 1000.0), &burst_frame, NULL);
+}
+
+static void burst_start()
+{
+    if (burst.active) {
+        printf("Burst already in progress\n");
+        return;
     }
 
-    printf("WAIT 10 S AND SEND MOTION STOP\n");
-    sleep(10);
+    burst.active = 1;
+    burst.requested = 0;
+    burst.taken = 0;
+    burst.frames = 0;
+    burst.size = 0;
 
-    // Send start message
-    msg.msg=mqtt_sonoff_conf.motion_stop_msg;
-    msg.len=strlen(msg.msg);
-    msg.topic=topic;
+    printf("Wait %.1f seconds and take %d frames\n", mqtt_sonoff_conf.motion_image_delay, mqtt_sonoff_conf.motion_burst_frames);
+    event_timer_set(TIMER_MOTION_BURST, (int) (mqtt_sonoff_conf.motion_image_delay * 1000.0), &burst_frame, NULL);
+}
+
+static void motion_stop(void *arg)
+{
+    printf("SEND MOTION STOP\n");
+
+    motion_active = 0;
+    motion_publish(mqtt_sonoff_conf.motion_stop_msg, strlen(mqtt_sonoff_conf.motion_stop_msg),
+            mqtt_sonoff_conf.topic_motion, conf.retain_motion);
+}
+
+static void motion_start(void *arg)
+{
+    if (!motion_active) {
+        motion_active = 1;
+
+        // Send start message
+        motion_publish(mqtt_sonoff_conf.motion_start_msg, strlen(mqtt_sonoff_conf.motion_start_msg),
+                mqtt_sonoff_conf.topic_motion, conf.retain_motion);
+
+        if (strlen(mqtt_sonoff_conf.topic_motion_image)) {
+            // Send image
+            printf("Wait %.1f seconds and take a snapshot\n", mqtt_sonoff_conf.motion_image_delay);
+            event_timer_set(TIMER_MOTION_IMAGE, (int) (mqtt_sonoff_conf.motion_image_delay * 1000.0), &motion_image, NULL);
+        }
+        if ((mqtt_sonoff_conf.motion_burst_frames > 0) && strlen(mqtt_sonoff_conf.topic_motion_burst)) {
+            burst_start();
+        }
+    } else {
+        printf("MOTION ALREADY ACTIVE, EXTEND IT\n");
+    }
+
+    // A new motion moves the stop
+    printf("WAIT %d S AND SEND MOTION STOP\n", MOTION_STOP_DELAY / 1000);
+    event_timer_set(TIMER_MOTION_STOP, MOTION_STOP_DELAY, &motion_stop, NULL);
+}
 
-    sprintf(topic, "%s/%s", mqtt_sonoff_conf.mqtt_prefix, mqtt_sonoff_conf.topic_motion);
+// Called by the sql thread, it must return immediately
+void callback_motion_start()
+{
+    printf("CALLBACK MOTION START\n");
 
-    mqtt_send_message(&msg, conf.retain_motion);
+    event_post(&motion_start, NULL);
 }
 
 void callback_command(void *arg)
@@ -138,14 +274,237 @@ void callback_command(void *arg)
     mqtt_send_message(&msg, 1);
 }
 
+//-----------------------------------------------------------------------------
+// COMMANDS
+//-----------------------------------------------------------------------------
+
+static long long now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Messages to <prefix>/cmnd/<file>/<param>, the settings are written to
+ * the db and the sql thread publishes the new stat.
+ * An empty message to <prefix>/cmnd/<file> dumps the configuration.
+ * Called by the main loop.
+ */
+static void command_message(const char *topic, const char *payload, int len)
+{
+    char file[MAX_KEY_LENGTH], param[MAX_KEY_LENGTH];
+    char value[MAX_VALUE_LENGTH];
+    char sys_cmd[256];
+    const char *p, *slash;
+    int prefix_len;
+
+    printf("Received message '%.*s' for topic '%s'\n", len, payload, topic);
+
+    // Remove <prefix>/cmnd/
+    prefix_len=strlen(mqtt_sonoff_conf.mqtt_prefix_cmnd)-1;
+    if(strlen(topic)<=prefix_len)
+        return;
+    p=topic+prefix_len;
+
+    if(len>=MAX_VALUE_LENGTH)
+    {
+        printf("Message payload exceeds buffer size\n");
+        return;
+    }
+    memcpy(value, payload, len);
+    value[len]='\0';
+
+    slash=strchr(p, '/');
+    if(slash==NULL)
+    {
+        if(strlen(p)>=MAX_KEY_LENGTH || len>0)
+            return;
+        // Send response with a dump of the configuration
+        sprintf(sys_cmd, "%s %s &", CONF2MQTT_SCRIPT, p);
+        printf("Running system command \"%s\"\n", sys_cmd);
+        system(sys_cmd);
+        return;
+    }
+    if(slash-p>=MAX_KEY_LENGTH || strlen(slash+1)>=MAX_KEY_LENGTH)
+    {
+        printf("Message subtopic exceeds buffer size\n");
+        return;
+    }
+    memcpy(file, p, slash-p);
+    file[slash-p]='\0';
+    strcpy(param, slash+1);
+    if(strlen(param)==0)
+    {
+        printf("Param is empty\n");
+        return;
+    }
+    if(len==0)
+    {
+        printf("Payload is empty\n");
+        return;
+    }
+
+    // The settings sent together are written with one commit
+    if(command_commit==0 && sql_update_begin()==0)
+        command_commit=now_ms()+COMMAND_BATCH_WAIT;
+
+    printf("Updating db: parameter \"%s\", value \"%s\"\n", param, value);
+    if(sql_update(param, value)!=0)
+        printf("Update error: parameter \"%s\", value \"%s\"\n", param, value);
+
+    // The script doesn't block the loop, the new state is read by privacy_check
+    if(strcasecmp("switch_on", param)==0)
+    {
+        if(strcasecmp("on", value)==0 || strcasecmp("yes", value)==0)
+        {
+            sprintf(sys_cmd, "%s off &", SWITCH_ON_SCRIPT);
+            system(sys_cmd);
+        }
+        else if(strcasecmp("off", value)==0 || strcasecmp("no", value)==0)
+        {
+            sprintf(sys_cmd, "%s on &", SWITCH_ON_SCRIPT);
+            system(sys_cmd);
+        }
+    }
+}
+
+// Called by the main loop, return the ms to wait or -1 if nothing is pending
+static int command_check()
+{
+    long long now;
+
+    if(command_commit==0)
+        return -1;
+
+    now=now_ms();
+    if(now<command_commit)
+        return (int) (command_commit-now);
+
+    command_commit=0;
+    if(sql_update_end()!=0)
+        printf("Update error: settings not saved\n");
+
+    return -1;
+}
+
+// Only one instance, mqtt-config is just another name for it
+static int lock_instance()
+{
+    char pid[16];
+    int fd;
+
+    fd=open(MQTT_SONOFF_PID_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd<0)
+        return 0;
+
+    if(flock(fd, LOCK_EX | LOCK_NB)!=0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    sprintf(pid, "%d\n", getpid());
+    if(ftruncate(fd, 0)!=0 || write(fd, pid, strlen(pid))<0)
+        fprintf(stderr, "Can't write %s\n", MQTT_SONOFF_PID_FILE);
+
+    // The lock is released at the exit
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// PRIVACY
+//-----------------------------------------------------------------------------
+
+// Watch the folder of the privacy file, return the inotify fd or -1
+static int privacy_watch_init()
+{
+    int fd;
+
+    fd=inotify_init();
+    if(fd<0)
+    {
+        fprintf(stderr, "inotify not available, polling %s\n", PRIVACY_FILE);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    if(inotify_add_watch(fd, PRIVACY_DIR, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)<0)
+    {
+        fprintf(stderr, "Can't watch %s, polling %s\n", PRIVACY_DIR, PRIVACY_FILE);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Read the events and return 1 if the privacy file is involved
+static int privacy_changed(int fd, struct pollfd *pfd)
+{
+    char buf[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    char *p;
+    int len;
+    int ret=0;
+
+    if(!(pfd->revents & POLLIN))
+        return 0;
+
+    while((len=read(fd, buf, sizeof(buf)))>0)
+    {
+        for(p=buf; p<buf+len; p+=sizeof(struct inotify_event)+ev->len)
+        {
+            ev=(struct inotify_event *) p;
+            if(ev->mask & IN_Q_OVERFLOW)
+                ret=1;
+            else if(ev->len>0 && strcmp(ev->name, PRIVACY_FILE_NAME)==0)
+                ret=1;
+        }
+    }
+
+    return ret;
+}
+
+static void privacy_check(SQL_COMMAND_TYPE *privacy)
+{
+    if (access(PRIVACY_FILE, F_OK ) == 0 ) {
+        if (*privacy != PRIVACY_ON) {
+            *privacy = PRIVACY_ON;
+            callback_command((void *) privacy);
+        }
+    } else {
+        if (*privacy != PRIVACY_OFF) {
+            *privacy = PRIVACY_OFF;
+            callback_command((void *) privacy);
+        }
+    }
+}
+
 int main(int argc, char **argv)
 {
     int ret;
     SQL_COMMAND_TYPE privacy = -1;
+    struct pollfd fds[MQTT_POLL_FDS + 1];
+    int nfds, mqtt_nfds;
+    int timeout;
+    int privacy_fd;
+    int wait;
 
     setbuf(stdout, NULL);
     setbuf(stderr, NULL);
 
+    // Don't die if resize_jpg exits before reading the whole image
+    signal(SIGPIPE, SIG_IGN);
+
+    if(lock_instance()!=0)
+    {
+        printf("mqtt_sonoff is already running\n");
+        exit(EXIT_SUCCESS);
+    }
+
     printf("Starting mqtt_sonoff v%s\n", MQTT_SONOFF_VERSION);
 
     mqtt_init_conf(&conf);
@@ -157,42 +516,93 @@ int main(int argc, char **argv)
     if(ret!=0)
         exit(EXIT_FAILURE);
 
+    ret=mqtt_subscribe(mqtt_sonoff_conf.mqtt_prefix_cmnd, &command_message);
+    if(ret!=0)
+        exit(EXIT_FAILURE);
+
     ret=mqtt_connect();
     if(ret!=0)
         exit(EXIT_FAILURE);
 
     send_ha_discovery();
 
-    ret=sql_init(conf.ipcsys_db);
+    // The low resolution buffer is allocated once
+    memset(&image, 0, sizeof(image));
+    if (strlen(mqtt_sonoff_conf.topic_motion_image) && strlen(mqtt_sonoff_conf.topic_motion_image_low)) {
+        image.low = (unsigned char *) malloc(IMAGE_LOW_MAX_SIZE);
+        if (image.low == NULL) {
+            printf("Cannot allocate memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memset(&burst, 0, sizeof(burst));
+    if ((mqtt_sonoff_conf.motion_burst_frames > 0) && (mqtt_sonoff_conf.motion_burst_mode == MOTION_BURST_MJPEG)) {
+        burst.buffer_size = mqtt_sonoff_conf.motion_burst_frames * SNAPSHOT_MAX_SIZE;
+        if (burst.buffer_size > MOTION_BURST_MAX_SIZE)
+            burst.buffer_size = MOTION_BURST_MAX_SIZE;
+        burst.buffer = (unsigned char *) malloc(burst.buffer_size);
+        if (burst.buffer == NULL) {
+            printf("Cannot allocate memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    ret=event_init();
     if(ret!=0)
         exit(EXIT_FAILURE);
 
+    // The first states are reported as soon as the thread starts
     sql_set_callback(SQL_MSG_MOTION_START, &callback_motion_start);
     sql_set_callback(SQL_MSG_COMMAND, &callback_command);
 
+    ret=sql_init(conf.ipcsys_db);
+    if(ret!=0)
+        exit(EXIT_FAILURE);
+
+    privacy_fd=privacy_watch_init();
+    privacy_check(&privacy);
+
     while(1)
     {
-        mqtt_check_connection();
-        mqtt_loop();
-
-        // Check if privacy is enabled
-        if (access("/tmp/privacy", F_OK ) == 0 ) {
-            if (privacy != PRIVACY_ON) {
-                privacy = PRIVACY_ON;
-                callback_command((void *) &privacy);
-            }
-        } else {
-            if (privacy != PRIVACY_OFF) {
-                privacy = PRIVACY_OFF;
-                callback_command((void *) &privacy);
-            }
+        nfds=mqtt_poll_fds(fds);
+        mqtt_nfds=nfds;
+        timeout=mqtt_poll_timeout();
+        if(privacy_fd>=0)
+        {
+            fds[nfds].fd=privacy_fd;
+            fds[nfds].events=POLLIN;
+            fds[nfds].revents=0;
+            nfds++;
+        }
+        else if(timeout>PRIVACY_POLL_INTERVAL)
+        {
+            // No inotify, check the file from time to time
+            timeout=PRIVACY_POLL_INTERVAL;
+        }
+        wait=command_check();
+        if(wait>=0 && (timeout<0 || wait<timeout))
+            timeout=wait;
+
+        ret=poll(fds, nfds, timeout);
+        if(ret<0 && errno!=EINTR)
+        {
+            fprintf(stderr, "Poll failed\n");
+            usleep(100*1000);
+            continue;
         }
 
-        usleep(500*1000);
+        mqtt_poll_handle(fds, mqtt_nfds);
+        command_check();
+
+        if(privacy_fd<0 || privacy_changed(privacy_fd, &fds[mqtt_nfds]))
+            privacy_check(&privacy);
     }
 
     sql_stop();
+    event_stop();
     stop_mqtt();
+    free(image.low);
+    free(burst.buffer);
 
     return 0;
 }
@@ -251,6 +661,7 @@ static void handle_config(const char *key, const char *value)
         conf.mqtt_prefix=conf_set_string(value);
         mqtt_sonoff_conf.mqtt_prefix=conf.mqtt_prefix;
         mqtt_sonoff_conf.mqtt_prefix_stat=conf_set_strings(value, "/stat");
+        mqtt_sonoff_conf.mqtt_prefix_cmnd=conf_set_strings(value, "/cmnd/#");
     }
     else if(strcmp(key, "TOPIC_BIRTH_WILL")==0)
     {
@@ -269,6 +680,37 @@ static void handle_config(const char *key, const char *value)
     {
         conf_set_double(value, &mqtt_sonoff_conf.motion_image_delay);
     }
+    else if(strcmp(key, "TOPIC_MOTION_IMAGE_LOW")==0)
+    {
+        mqtt_sonoff_conf.topic_motion_image_low=conf_set_string(value);
+    }
+    else if(strcmp(key, "MOTION_IMAGE_LOW_SCALE")==0)
+    {
+        conf_set_int(value, &mqtt_sonoff_conf.motion_image_low_scale);
+    }
+    else if(strcmp(key, "MOTION_IMAGE_LOW_QUALITY")==0)
+    {
+        conf_set_int(value, &mqtt_sonoff_conf.motion_image_low_quality);
+    }
+    else if(strcmp(key, "TOPIC_MOTION_BURST")==0)
+    {
+        mqtt_sonoff_conf.topic_motion_burst=conf_set_string(value);
+    }
+    else if(strcmp(key, "MOTION_BURST_FRAMES")==0)
+    {
+        conf_set_int(value, &mqtt_sonoff_conf.motion_burst_frames);
+    }
+    else if(strcmp(key, "MOTION_BURST_INTERVAL")==0)
+    {
+        conf_set_double(value, &mqtt_sonoff_conf.motion_burst_interval);
+    }
+    else if(strcmp(key, "MOTION_BURST_MODE")==0)
+    {
+        if(strcasecmp(value, "mjpeg")==0)
+            mqtt_sonoff_conf.motion_burst_mode=MOTION_BURST_MJPEG;
+        else
+            mqtt_sonoff_conf.motion_burst_mode=MOTION_BURST_SEQUENCE;
+    }
     else if(strcmp(key, "BIRTH_MSG")==0)
     {
         conf.birth_msg=conf_set_string(value);
@@ -311,10 +753,18 @@ static void init_mqtt_sonoff_config()
     // Setting conf vars to NULL
     mqtt_sonoff_conf.mqtt_prefix=NULL;
     mqtt_sonoff_conf.mqtt_prefix_stat=NULL;
+    mqtt_sonoff_conf.mqtt_prefix_cmnd=NULL;
     mqtt_sonoff_conf.topic_birth_will=NULL;
     mqtt_sonoff_conf.topic_motion=NULL;
     mqtt_sonoff_conf.topic_motion_image=NULL;
     mqtt_sonoff_conf.motion_image_delay=0.5;
+    mqtt_sonoff_conf.topic_motion_image_low=NULL;
+    mqtt_sonoff_conf.motion_image_low_scale=4;
+    mqtt_sonoff_conf.motion_image_low_quality=60;
+    mqtt_sonoff_conf.topic_motion_burst=NULL;
+    mqtt_sonoff_conf.motion_burst_frames=0;
+    mqtt_sonoff_conf.motion_burst_interval=0.5;
+    mqtt_sonoff_conf.motion_burst_mode=MOTION_BURST_SEQUENCE;
     mqtt_sonoff_conf.birth_msg=NULL;
     mqtt_sonoff_conf.will_msg=NULL;
     mqtt_sonoff_conf.motion_start_msg=NULL;
@@ -346,6 +796,34 @@ static void init_mqtt_sonoff_config()
     {
         mqtt_sonoff_conf.topic_motion_image=default_topic;
     }
+    if(mqtt_sonoff_conf.topic_motion_image_low == NULL)
+    {
+        mqtt_sonoff_conf.topic_motion_image_low=default_topic;
+    }
+    if((mqtt_sonoff_conf.motion_image_low_scale < 1) || (mqtt_sonoff_conf.motion_image_low_scale > 8))
+    {
+        mqtt_sonoff_conf.motion_image_low_scale=4;
+    }
+    if((mqtt_sonoff_conf.motion_image_low_quality < 0) || (mqtt_sonoff_conf.motion_image_low_quality > 100))
+    {
+        mqtt_sonoff_conf.motion_image_low_quality=60;
+    }
+    if(mqtt_sonoff_conf.topic_motion_burst == NULL)
+    {
+        mqtt_sonoff_conf.topic_motion_burst=default_topic;
+    }
+    if(mqtt_sonoff_conf.motion_burst_frames < 0)
+    {
+        mqtt_sonoff_conf.motion_burst_frames=0;
+    }
+    if(mqtt_sonoff_conf.motion_burst_frames > MOTION_BURST_MAX_FRAMES)
+    {
+        mqtt_sonoff_conf.motion_burst_frames=MOTION_BURST_MAX_FRAMES;
+    }
+    if(mqtt_sonoff_conf.motion_burst_interval < 0.1)
+    {
+        mqtt_sonoff_conf.motion_burst_interval=0.1;
+    }
     if(conf.birth_msg == NULL)
     {
         conf.birth_msg=default_online;
@@ -390,6 +868,7 @@ static void init_sonoff_colink_config(){
         conf.mqtt_prefix=conf_set_string(prefix);
         mqtt_sonoff_conf.mqtt_prefix=conf.mqtt_prefix;
         mqtt_sonoff_conf.mqtt_prefix_stat=conf_set_strings(prefix, "/stat");
+        mqtt_sonoff_conf.mqtt_prefix_cmnd=conf_set_strings(prefix, "/cmnd/#");
     }
 }
 
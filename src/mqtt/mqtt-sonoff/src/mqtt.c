@@ -7,39 +7,88 @@ enum conn_states {CONN_DISCONNECTED, CONN_CONNECTING, CONN_CONNECTED};
 static enum conn_states conn_state;
 static int mid_sent;
 
+// Wakes up the loop when another thread publishes a message
+static int wake_fd[2] = {-1, -1};
+
+// Loop deadlines, in ms
+static long long next_retry;
+static long long next_misc;
+static long long connack_deadline;
+static long long next_flush;
+static int retry_delay = MQTT_RETRY_MIN;
+
+// Messages waiting for the connection, the oldest events can be on the sd
+typedef struct mqtt_queue_item
+{
+    char *topic;
+    char *payload;
+    int len;
+    int retain;
+    struct mqtt_queue_item *next;
+} mqtt_queue_item_t;
+
+typedef struct
+{
+    unsigned short magic;
+    unsigned char retain;
+    unsigned char topic_len;
+    unsigned int len;
+} mqtt_journal_hdr_t;
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mqtt_queue_item_t *queue_head = NULL;
+static mqtt_queue_item_t *queue_tail = NULL;
+static int queue_size = 0;
+static int journal_fd = -1;
+static off_t journal_read = 0;
+static off_t journal_write = 0;
+
+typedef struct
+{
+    char *topic;
+    mqtt_message_func_t f;
+} mqtt_subscription_t;
+
+static mqtt_subscription_t subscriptions[MQTT_MAX_SUBSCRIPTIONS];
+static int subscriptions_num = 0;
+
 static int init_mosquitto_instance();
+static void mqtt_wakeup();
+static void mqtt_reconnect(long long now);
+static void mqtt_connect_started(int ret, long long now);
+static void mqtt_retry_later(long long now);
+static int mqtt_publish(const char *topic, const char *payload, int len, int retain);
+static int queue_add(const char *topic, const char *payload, int len, int retain);
+static int queue_pending();
+static int queue_flush();
+static void journal_init();
+static int journal_add(const char *topic, const char *payload, int len, int retain);
+static int journal_flush_one();
 
 static void connect_callback(struct mosquitto *mosq, void *obj, int result);
 static void disconnect_callback(struct mosquitto *mosq, void *obj, int rc);
 static void publish_callback(struct mosquitto *mosq, void *obj, int mid);
+static void message_callback(struct mosquitto *mosq, void *obj, const struct mosquitto_message *message);
 static void log_callback(struct mosquitto *mosq, void *obj, int level, const char *str);
 
+// Published directly, without waiting the queued messages
 void send_birth_msg()
 {
     char topic[128];
-    mqtt_msg_t msg;
-
-    msg.msg=mqtt_conf->birth_msg;
-    msg.len=strlen(msg.msg);
-    msg.topic=topic;
 
     sprintf(topic, "%s/%s", mqtt_conf->mqtt_prefix, mqtt_conf->topic_birth_will);
 
-    mqtt_send_message(&msg, mqtt_conf->retain_birth_will);
+    mqtt_publish(topic, mqtt_conf->birth_msg, strlen(mqtt_conf->birth_msg), mqtt_conf->retain_birth_will);
 }
 
+// Published directly, without waiting the queued messages
 void send_will_msg()
 {
     char topic[128];
-    mqtt_msg_t msg;
-
-    msg.msg=mqtt_conf->will_msg;
-    msg.len=strlen(msg.msg);
-    msg.topic=topic;
 
     sprintf(topic, "%s/%s", mqtt_conf->mqtt_prefix, mqtt_conf->topic_birth_will);
 
-    mqtt_send_message(&msg, mqtt_conf->retain_birth_will);
+    mqtt_publish(topic, mqtt_conf->will_msg, strlen(mqtt_conf->will_msg), mqtt_conf->retain_birth_will);
 }
 
 int init_mqtt(void)
@@ -60,6 +109,16 @@ int init_mqtt(void)
         return -2;
     }
 
+    if(pipe(wake_fd)!=0)
+    {
+        fprintf(stderr, "Can't create wake up pipe.\n");
+        return -3;
+    }
+    fcntl(wake_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_fd[1], F_SETFL, O_NONBLOCK);
+
+    journal_init();
+
     conn_state=CONN_DISCONNECTED;
 
     return 0;
@@ -70,12 +129,170 @@ void stop_mqtt(void)
     send_will_msg();
     mosquitto_destroy(mosq);
     mosquitto_lib_cleanup();
+    close(wake_fd[0]);
+    close(wake_fd[1]);
+    if(journal_fd>=0)
+        close(journal_fd);
+}
+
+//-----------------------------------------------------------------------------
+// LOOP
+//-----------------------------------------------------------------------------
+
+static long long now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void mqtt_wakeup()
+{
+    char c = 0;
+
+    // If the pipe is full the loop is already awake
+    if(write(wake_fd[1], &c, 1)<0 && errno!=EAGAIN)
+        fprintf(stderr, "Can't wake up the mqtt loop.\n");
+}
+
+/*
+ * Fill fds with the descriptors to wait in the main loop.
+ * Return the number of fds used, at most MQTT_POLL_FDS.
+ */
+int mqtt_poll_fds(struct pollfd *fds)
+{
+    int nfds=0;
+    int sock;
+
+    fds[nfds].fd=wake_fd[0];
+    fds[nfds].events=POLLIN;
+    fds[nfds].revents=0;
+    nfds++;
+
+    sock=mosquitto_socket(mosq);
+    if(sock>=0)
+    {
+        fds[nfds].fd=sock;
+        fds[nfds].events=POLLIN;
+        if(mosquitto_want_write(mosq))
+            fds[nfds].events|=POLLOUT;
+        fds[nfds].revents=0;
+        nfds++;
+    }
+
+    return nfds;
+}
+
+// Time in ms until the loop has something to do without events
+int mqtt_poll_timeout(void)
+{
+    long long deadline;
+    long long now=now_ms();
+
+    if(conn_state==CONN_CONNECTED)
+    {
+        deadline=next_misc;
+        // Send the queue as soon as the socket has room
+        if(!mosquitto_want_write(mosq) && queue_pending() && next_flush<deadline)
+            deadline=next_flush;
+    }
+    else if(conn_state==CONN_CONNECTING)
+        deadline=connack_deadline;
+    else
+        deadline=next_retry;
+
+    if(deadline<=now)
+        return 0;
+    return (int) (deadline-now);
+}
+
+void mqtt_poll_handle(struct pollfd *fds, int nfds)
+{
+    char buf[64];
+    long long now;
+    int i;
+
+    for(i=0; i<nfds; i++)
+    {
+        if(fds[i].fd==wake_fd[0])
+        {
+            if(fds[i].revents & POLLIN)
+            {
+                while(read(wake_fd[0], buf, sizeof(buf))>0);
+            }
+        }
+        else if(fds[i].fd==mosquitto_socket(mosq))
+        {
+            if(fds[i].revents & (POLLIN | POLLERR | POLLHUP))
+                mosquitto_loop_read(mosq, 1);
+        }
+    }
+
+    // Messages published by the other threads are only queued
+    if(mosquitto_socket(mosq)>=0 && mosquitto_want_write(mosq))
+        mosquitto_loop_write(mosq, 1);
+
+    now=now_ms();
+    if(conn_state==CONN_CONNECTED)
+    {
+        // Without progress (sd or memory errors) don't spin on the queue
+        if(!mosquitto_want_write(mosq) && now>=next_flush && queue_flush()==0)
+            next_flush=now+MQTT_FLUSH_RETRY;
+
+        // Keepalive, checked often enough to send the ping in time
+        if(now>=next_misc)
+        {
+            mosquitto_loop_misc(mosq);
+            next_misc=now+mqtt_conf->keepalive*1000/4;
+        }
+    }
+    else if(conn_state==CONN_CONNECTING)
+    {
+        if(now>=connack_deadline)
+        {
+            fprintf(stderr, "No answer from the broker.\n");
+            mosquitto_disconnect(mosq);
+            conn_state=CONN_DISCONNECTED;
+            mqtt_retry_later(now);
+        }
+    }
+
+    if(conn_state==CONN_DISCONNECTED && now>=next_retry)
+        mqtt_reconnect(now);
+}
+
+// Try to connect again, without waiting: the loop completes the connection
+static void mqtt_reconnect(long long now)
+{
+    fprintf(stderr, "Trying to reconnect...\n");
+
+    mqtt_connect_started(mosquitto_reconnect_async(mosq), now);
 }
 
-void mqtt_loop(void)
+// The next attempt after an error is delayed up to MQTT_RETRY_MAX
+static void mqtt_connect_started(int ret, long long now)
 {
-    if(mosq!=NULL)
-        mosquitto_loop(mosq, -1, 1);
+    if(ret==MOSQ_ERR_SUCCESS)
+    {
+        // Wait the CONNACK
+        if(conn_state==CONN_DISCONNECTED)
+            conn_state=CONN_CONNECTING;
+        connack_deadline=now+MQTT_CONNACK_WAIT;
+        return;
+    }
+
+    fprintf(stderr, "Unable to connect (%s), retry in %d s.\n", mosquitto_strerror(ret), retry_delay/1000);
+    mqtt_retry_later(now);
+}
+
+// Schedule the next attempt and grow the delay for the one after
+static void mqtt_retry_later(long long now)
+{
+    next_retry=now+retry_delay;
+    retry_delay*=2;
+    if(retry_delay>MQTT_RETRY_MAX)
+        retry_delay=MQTT_RETRY_MAX;
 }
 
 //-----------------------------------------------------------------------------
@@ -108,24 +325,13 @@ void mqtt_set_conf(mqtt_conf_t *conf)
     mqtt_conf=conf;
 }
 
-void mqtt_check_connection()
-{
-    char topic[128];
-
-    if (conn_state != CONN_CONNECTED) {
-        sprintf(topic, "%s/%s", mqtt_conf->mqtt_prefix, mqtt_conf->topic_birth_will);
-        mosquitto_will_set(mosq, topic, strlen(mqtt_conf->will_msg),
-                    mqtt_conf->will_msg, mqtt_conf->qos, mqtt_conf->retain_birth_will == 1);
-        mqtt_connect();
-    }
-}
-
+// Start the connection, it's completed by the main loop
 int mqtt_connect()
 {
     int ret;
     char topic[128];
 
-    fprintf(stderr, "Trying to connect... ");
+    fprintf(stderr, "Trying to connect...\n");
 
     if(mqtt_conf->user!=NULL && strcmp(mqtt_conf->user, "")!=0)
     {
@@ -138,62 +344,51 @@ int mqtt_connect()
         }
     }
 
-    conn_state=CONN_DISCONNECTED;
-
-
-    while (conn_state!=CONN_CONNECTED) {
-        sprintf(topic, "%s/%s", mqtt_conf->mqtt_prefix, mqtt_conf->topic_birth_will);
-        mosquitto_will_set(mosq, topic, strlen(mqtt_conf->will_msg),
-                    mqtt_conf->will_msg, mqtt_conf->qos, mqtt_conf->retain_birth_will == 1);
-
-        do
-        {
-            ret=mosquitto_connect(mosq, mqtt_conf->host, mqtt_conf->port,
-                                       mqtt_conf->keepalive);
-
-            if(ret!=MOSQ_ERR_SUCCESS)
-                fprintf(stderr, "Unable to connect (%s).\n", mosquitto_strerror(ret));
-
-            usleep(500*1000);
-
-        } while(ret!=MOSQ_ERR_SUCCESS);
-
-        /* I'm not sure mosquitto_connect has already called the callback
-           so I only change the state if it's not already connected
-        */
-        if (conn_state==CONN_DISCONNECTED)
-            conn_state=CONN_CONNECTING;
-
-        do
-        {
-            ret=mosquitto_loop(mosq, -1, 1);
-            fprintf(stderr, ".");
-            if(conn_state!=CONN_CONNECTED)
-                usleep(100*1000);
-        } while(conn_state==CONN_CONNECTING);
-
-    }
+    sprintf(topic, "%s/%s", mqtt_conf->mqtt_prefix, mqtt_conf->topic_birth_will);
+    mosquitto_will_set(mosq, topic, strlen(mqtt_conf->will_msg),
+                mqtt_conf->will_msg, mqtt_conf->qos, mqtt_conf->retain_birth_will == 1);
 
-    fprintf(stderr, "\nconnected!\n");
+    conn_state=CONN_DISCONNECTED;
+    ret=mosquitto_connect_async(mosq, mqtt_conf->host, mqtt_conf->port,
+                                mqtt_conf->keepalive);
+    mqtt_connect_started(ret, now_ms());
 
     return 0;
 }
 
+/*
+ * Publish the message now if possible, otherwise queue it until the
+ * connection is back: the messages are always sent in order.
+ */
 int mqtt_send_message(mqtt_msg_t *msg, int retain)
 {
     int ret;
 
-    if(conn_state!=CONN_CONNECTED)
-        return -1;
-
     if (strcmp("/", &msg->topic[strlen(msg->topic)-1])==0) {
         fprintf(stderr, "No message sent: topic is empty\n");
         return -1;
-    } else {
-        ret=mosquitto_publish(mosq, &mid_sent, msg->topic, msg->len, msg->msg,
-                              mqtt_conf->qos, retain);
     }
 
+    pthread_mutex_lock(&queue_mutex);
+    ret=MOSQ_ERR_NO_CONN;
+    if(conn_state==CONN_CONNECTED && !queue_pending())
+        ret=mqtt_publish(msg->topic, msg->msg, msg->len, retain);
+    if(ret==MOSQ_ERR_NO_CONN)
+        ret=queue_add(msg->topic, msg->msg, msg->len, retain);
+    pthread_mutex_unlock(&queue_mutex);
+
+    mqtt_wakeup();
+
+    return ret;
+}
+
+static int mqtt_publish(const char *topic, const char *payload, int len, int retain)
+{
+    int ret;
+
+    ret=mosquitto_publish(mosq, &mid_sent, topic, len, payload,
+                          mqtt_conf->qos, retain);
+
     if(ret!=MOSQ_ERR_SUCCESS)
     {
         switch(ret){
@@ -217,6 +412,280 @@ int mqtt_send_message(mqtt_msg_t *msg, int retain)
     return ret;
 }
 
+/*
+ * Pass the messages matching topic to f, called by the main loop.
+ * Call it before the connection.
+ */
+int mqtt_subscribe(const char *topic, mqtt_message_func_t f)
+{
+    if(subscriptions_num>=MQTT_MAX_SUBSCRIPTIONS)
+        return -1;
+
+    subscriptions[subscriptions_num].topic=strdup(topic);
+    if(subscriptions[subscriptions_num].topic==NULL)
+        return -1;
+    subscriptions[subscriptions_num].f=f;
+    subscriptions_num++;
+
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// QUEUE
+//-----------------------------------------------------------------------------
+
+/*
+ * Retained messages are states: only the last value of a topic is kept,
+ * in memory.
+ * The other messages are events: they are kept in memory up to
+ * MQTT_QUEUE_MAX_SIZE bytes, then appended to the journal on the sd,
+ * so they survive also a restart. With qos 0 they are dropped instead.
+ * The memory is sent first, then the journal: once an event is in the
+ * journal, the next ones follow it there to keep the order.
+ * Called with queue_mutex locked.
+ */
+static int queue_add(const char *topic, const char *payload, int len, int retain)
+{
+    mqtt_queue_item_t *item;
+    char *p;
+
+    if(retain)
+    {
+        for(item=queue_head; item!=NULL; item=item->next)
+        {
+            if(item->retain && strcmp(item->topic, topic)==0)
+            {
+                p=(char *) realloc(item->payload, len>0?len:1);
+                if(p==NULL)
+                    return MOSQ_ERR_NOMEM;
+                memcpy(p, payload, len);
+                queue_size+=len-item->len;
+                item->payload=p;
+                item->len=len;
+                return MOSQ_ERR_SUCCESS;
+            }
+        }
+    }
+    else
+    {
+        if(journal_write>journal_read || queue_size+len>MQTT_QUEUE_MAX_SIZE)
+        {
+            if(mqtt_conf->qos>0 && journal_add(topic, payload, len, retain)==0)
+                return MOSQ_ERR_SUCCESS;
+            fprintf(stderr, "Queue full, message to %s dropped.\n", topic);
+            return MOSQ_ERR_NOMEM;
+        }
+    }
+
+    item=(mqtt_queue_item_t *) malloc(sizeof(mqtt_queue_item_t));
+    if(item==NULL)
+        return MOSQ_ERR_NOMEM;
+    item->topic=strdup(topic);
+    item->payload=(char *) malloc(len>0?len:1);
+    if(item->topic==NULL || item->payload==NULL)
+    {
+        free(item->topic);
+        free(item->payload);
+        free(item);
+        return MOSQ_ERR_NOMEM;
+    }
+    memcpy(item->payload, payload, len);
+    item->len=len;
+    item->retain=retain;
+    item->next=NULL;
+
+    if(queue_tail!=NULL)
+        queue_tail->next=item;
+    else
+        queue_head=item;
+    queue_tail=item;
+    queue_size+=len;
+
+    return MOSQ_ERR_SUCCESS;
+}
+
+// Called with queue_mutex locked
+static int queue_pending()
+{
+    return queue_head!=NULL || journal_write>journal_read;
+}
+
+/*
+ * Send the queue a bit at a time, the loop calls it again when the socket
+ * has been written: the messages don't pile up inside mosquitto.
+ * Return the number of messages removed from the queue.
+ */
+static int queue_flush()
+{
+    mqtt_queue_item_t *item;
+    int count=0;
+    int ret;
+
+    pthread_mutex_lock(&queue_mutex);
+    while(conn_state==CONN_CONNECTED && count<MQTT_FLUSH_MAX_COUNT)
+    {
+        item=queue_head;
+        if(item!=NULL)
+        {
+            ret=mqtt_publish(item->topic, item->payload, item->len, item->retain);
+            // Retry later only if the message can be sent
+            if(ret==MOSQ_ERR_NO_CONN || ret==MOSQ_ERR_NOMEM)
+                break;
+            queue_head=item->next;
+            if(queue_head==NULL)
+                queue_tail=NULL;
+            queue_size-=item->len;
+            free(item->topic);
+            free(item->payload);
+            free(item);
+        }
+        else if(journal_write>journal_read)
+        {
+            if(journal_flush_one()!=0)
+                break;
+        }
+        else
+        {
+            break;
+        }
+        count++;
+    }
+    pthread_mutex_unlock(&queue_mutex);
+
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+// JOURNAL
+//-----------------------------------------------------------------------------
+
+// Open the journal, the events left by the last run are sent again
+static void journal_init()
+{
+    mqtt_journal_hdr_t hdr;
+    struct stat st;
+
+    journal_fd=open(MQTT_JOURNAL_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(journal_fd<0)
+    {
+        fprintf(stderr, "Can't open %s, events are kept only in memory.\n", MQTT_JOURNAL_FILE);
+        return;
+    }
+
+    journal_read=0;
+    journal_write=0;
+    if(fstat(journal_fd, &st)!=0)
+        st.st_size=0;
+
+    // Keep the records up to the first broken one, e.g. after a power loss
+    while(journal_write+(off_t) sizeof(hdr)<=st.st_size)
+    {
+        if(pread(journal_fd, &hdr, sizeof(hdr), journal_write)!=sizeof(hdr) ||
+                hdr.magic!=MQTT_JOURNAL_MAGIC ||
+                journal_write+(off_t) sizeof(hdr)+hdr.topic_len+hdr.len>st.st_size)
+            break;
+        journal_write+=sizeof(hdr)+hdr.topic_len+hdr.len;
+    }
+    if(journal_write<st.st_size)
+    {
+        fprintf(stderr, "Journal corrupted, %lld bytes discarded.\n", (long long) (st.st_size-journal_write));
+        if(ftruncate(journal_fd, journal_write)!=0)
+            fprintf(stderr, "Can't truncate %s.\n", MQTT_JOURNAL_FILE);
+    }
+    if(journal_write>0)
+        fprintf(stderr, "%lld bytes of events to send in %s.\n", (long long) journal_write, MQTT_JOURNAL_FILE);
+}
+
+static int journal_add(const char *topic, const char *payload, int len, int retain)
+{
+    mqtt_journal_hdr_t hdr;
+    struct iovec iov[3];
+    int topic_len=strlen(topic);
+
+    if(journal_fd<0 || topic_len>255)
+        return -1;
+    if(journal_write+(off_t) sizeof(hdr)+topic_len+len>MQTT_JOURNAL_MAX_SIZE)
+        return -1;
+
+    hdr.magic=MQTT_JOURNAL_MAGIC;
+    hdr.retain=retain;
+    hdr.topic_len=topic_len;
+    hdr.len=len;
+
+    iov[0].iov_base=&hdr;
+    iov[0].iov_len=sizeof(hdr);
+    iov[1].iov_base=(void *) topic;
+    iov[1].iov_len=topic_len;
+    iov[2].iov_base=(void *) payload;
+    iov[2].iov_len=len;
+
+    if(lseek(journal_fd, journal_write, SEEK_SET)<0 ||
+            writev(journal_fd, iov, 3)!=(ssize_t) (sizeof(hdr)+topic_len+len))
+    {
+        // Don't leave half a record
+        if(ftruncate(journal_fd, journal_write)!=0)
+            fprintf(stderr, "Can't truncate %s.\n", MQTT_JOURNAL_FILE);
+        return -1;
+    }
+    journal_write+=sizeof(hdr)+topic_len+len;
+
+    return 0;
+}
+
+// Send the oldest event of the journal, it's emptied when everything is sent
+static int journal_flush_one()
+{
+    mqtt_journal_hdr_t hdr;
+    char topic[256];
+    char *payload;
+    int ret;
+
+    if(pread(journal_fd, &hdr, sizeof(hdr), journal_read)!=sizeof(hdr) ||
+            hdr.magic!=MQTT_JOURNAL_MAGIC ||
+            journal_read+(off_t) sizeof(hdr)+hdr.topic_len+hdr.len>journal_write)
+    {
+        fprintf(stderr, "Journal corrupted, %lld bytes discarded.\n", (long long) (journal_write-journal_read));
+        journal_write=journal_read;
+        goto end;
+    }
+
+    payload=(char *) malloc(hdr.len>0?hdr.len:1);
+    if(payload==NULL)
+        return -1;
+    if(pread(journal_fd, topic, hdr.topic_len, journal_read+sizeof(hdr))!=hdr.topic_len ||
+            pread(journal_fd, payload, hdr.len, journal_read+sizeof(hdr)+hdr.topic_len)!=(ssize_t) hdr.len)
+    {
+        // A read error would stop the queue forever
+        free(payload);
+        fprintf(stderr, "Can't read %s, %lld bytes of events discarded.\n",
+                MQTT_JOURNAL_FILE, (long long) (journal_write-journal_read));
+        journal_write=journal_read;
+        goto end;
+    }
+    topic[hdr.topic_len]='\0';
+
+    ret=mqtt_publish(topic, payload, hdr.len, hdr.retain);
+    free(payload);
+    if(ret==MOSQ_ERR_NO_CONN || ret==MOSQ_ERR_NOMEM)
+        return -1;
+    journal_read+=sizeof(hdr)+hdr.topic_len+hdr.len;
+
+end:
+    if(journal_read>=journal_write)
+    {
+        journal_read=0;
+        journal_write=0;
+        if(ftruncate(journal_fd, 0)!=0)
+        {
+            fprintf(stderr, "Can't truncate %s, events are kept only in memory.\n", MQTT_JOURNAL_FILE);
+            close(journal_fd);
+            journal_fd=-1;
+        }
+    }
+
+    return 0;
+}
+
 //-----------------------------------------------------------------------------
 
 static int init_mosquitto_instance()
@@ -236,11 +705,16 @@ static int init_mosquitto_instance()
         return -1;
     }
 
+    // The messages are written by the main loop, also the ones
+    // published by the other threads
+    mosquitto_threaded_set(mosq, true);
+
     mosquitto_log_callback_set(mosq, log_callback);
 
     mosquitto_connect_callback_set(mosq, connect_callback);
     mosquitto_disconnect_callback_set(mosq, disconnect_callback);
     mosquitto_publish_callback_set(mosq, publish_callback);
+    mosquitto_message_callback_set(mosq, message_callback);
 
     return 0;
 }
@@ -249,23 +723,60 @@ static int init_mosquitto_instance()
 
 static void connect_callback(struct mosquitto *mosq, void *obj, int result)
 {
+    int i, ret;
+
     if(result==MOSQ_ERR_SUCCESS)
     {
+        fprintf(stderr, "Connected.\n");
         conn_state=CONN_CONNECTED;
+        retry_delay=MQTT_RETRY_MIN;
+        next_misc=now_ms();
+        next_flush=next_misc;
+
+        // The birth goes before the queued messages
         send_birth_msg();
+
+        // The session is clean, subscribe again
+        for(i=0; i<subscriptions_num; i++)
+        {
+            ret=mosquitto_subscribe(mosq, NULL, subscriptions[i].topic, mqtt_conf->qos);
+            if(ret!=MOSQ_ERR_SUCCESS)
+                fprintf(stderr, "Unable to subscribe %s (%s).\n", subscriptions[i].topic, mosquitto_strerror(ret));
+        }
     }
     else
     {
         conn_state=CONN_DISCONNECTED;
+        mqtt_retry_later(now_ms());
         fprintf(stderr, "%s\n", mosquitto_connack_string(result));
     }
 }
 
 static void disconnect_callback(struct mosquitto *mosq, void *obj, int rc)
 {
+    // Reconnect at once only if an established link is lost, a failed
+    // attempt waits the backoff
+    if(conn_state==CONN_CONNECTED)
+        next_retry=now_ms();
+    else if(conn_state==CONN_CONNECTING)
+        mqtt_retry_later(now_ms());
     conn_state=CONN_DISCONNECTED;
 }
 
+static void message_callback(struct mosquitto *mosq, void *obj, const struct mosquitto_message *message)
+{
+    bool match;
+    int i;
+
+    for(i=0; i<subscriptions_num; i++)
+    {
+        match=false;
+        mosquitto_topic_matches_sub(subscriptions[i].topic, message->topic, &match);
+        if(match)
+            subscriptions[i].f(message->topic, (const char *) message->payload, message->payloadlen);
+    }
+}
+
 static void publish_callback(struct mosquitto *mosq, void *obj, int mid)
 {
     /*
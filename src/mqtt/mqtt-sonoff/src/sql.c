@@ -44,7 +44,9 @@ static pthread_t *tr_sql;
 int tr_sql_routine;
 int ipcsys_db = 1;
 sqlite3 *dbc = NULL, *dbc_sys = NULL, *dbc_mmc = NULL;
-char last_msg[32];
+// Only for the settings received by mqtt, see sql_update_begin
+sqlite3 *dbc_upd = NULL;
+sqlite3_int64 last_rowid = -1;
 
 int sensitivity = -1;
 int motion_detection = -1;
@@ -52,9 +54,31 @@ int local_record = -1;
 int rotate = -1;
 int ir = -1;
 
+typedef struct
+{
+    int wd;
+    char name[64];
+} sql_watch_t;
+
+static int watch_fd = -1;
+static sql_watch_t watches[2];
+static int watches_num = 0;
+
+// Written by sql_update: the thread reads the settings again at once,
+// without waiting for the inotify event of the commit
+static int wake_fd[2] = { -1, -1 };
+static volatile int sys_updated = 0;
+// Updates written in the open transaction, see sql_update_begin
+static int updates_pending = -1;
+
 static int start_sql_thread();
 static void *sql_thread(void *args);
-static int parse_message(char *msg);
+static int sql_watch_init();
+static int sql_watch_add(const char *db);
+static void sql_wait_change();
+static int sql_changed(sqlite3_stmt *stmt, int *version);
+static void sql_wakeup();
+static int parse_message(sqlite3_int64 rowid, char *msg);
 
 static void call_callback(SQL_MESSAGE_TYPE type);
 static void call_callback_cmd(SQL_COMMAND_TYPE type);
@@ -73,7 +97,8 @@ static void handle_sql_command(int cmd);
 
 typedef void(*func_ptr_t)(void* arg);
 
-static func_ptr_t *sql_callbacks;
+// Set before sql_init, the thread calls them as soon as it starts
+static func_ptr_t sql_callbacks[SQL_MSG_LAST];
 
 //=============================================================================
 
@@ -86,27 +111,43 @@ int sql_init(int sysdb)
     int ret = 0;
     ipcsys_db = sysdb;
 
-    memset(last_msg, '\0', sizeof(last_msg));
+    last_rowid = -1;
     if (ipcsys_db) {
         ret = sqlite3_open_v2(IPCSYS_DB, &dbc_sys, SQLITE_OPEN_READONLY, NULL);
         dbc = dbc_sys;
     } else {
         ret = sqlite3_open_v2(IPCMMC_DB, &dbc_mmc, SQLITE_OPEN_READONLY, NULL);
         dbc = dbc_mmc;
-        ret = sqlite3_open_v2(IPCSYS_DB, &dbc_sys, SQLITE_OPEN_READONLY, NULL);
+        if (ret == SQLITE_OK)
+            ret = sqlite3_open_v2(IPCSYS_DB, &dbc_sys, SQLITE_OPEN_READONLY, NULL);
     }
+    // The settings received by mqtt are written with their own handle: the
+    // thread must not read the uncommitted data of an open transaction
+    if (ret == SQLITE_OK)
+        ret = sqlite3_open_v2(IPCSYS_DB, &dbc_upd, SQLITE_OPEN_READWRITE, NULL);
 
     if (ret != SQLITE_OK) {
         fprintf(stderr, "Error opening db\n");
         return -1;
     }
 
+    // The change is notified while the writer still holds the lock
+    sqlite3_busy_timeout(dbc_sys, SQL_BUSY_TIMEOUT);
+    sqlite3_busy_timeout(dbc_upd, SQL_BUSY_TIMEOUT);
+    if (dbc != dbc_sys)
+        sqlite3_busy_timeout(dbc, SQL_BUSY_TIMEOUT);
+
+    if (pipe(wake_fd) != 0) {
+        fprintf(stderr, "Can't create sql wake up pipe\n");
+        return -1;
+    }
+    fcntl(wake_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_fd[1], F_SETFL, O_NONBLOCK);
+
     ret = start_sql_thread();
     if(ret != 0)
         return -2;
 
-    sql_callbacks = malloc((sizeof(func_ptr_t)) * SQL_MSG_LAST);
-
     return 0;
 }
 
@@ -115,12 +156,15 @@ void sql_stop()
     if(tr_sql != NULL)
     {
         tr_sql_routine = 0;
+        sql_wakeup();
         pthread_join(*tr_sql, NULL);
         free(tr_sql);
     }
 
-    if(sql_callbacks != NULL)
-        free(sql_callbacks);
+    if (wake_fd[0] >= 0) {
+        close(wake_fd[0]);
+        close(wake_fd[1]);
+    }
 
     if (dbc_sys) {
         sqlite3_close_v2(dbc_sys);
@@ -128,6 +172,9 @@ void sql_stop()
     if (dbc_mmc) {
         sqlite3_close_v2(dbc_mmc);
     }
+    if (dbc_upd) {
+        sqlite3_close_v2(dbc_upd);
+    }
 
 }
 
@@ -150,18 +197,36 @@ static int start_sql_thread()
 static void *sql_thread(void *args)
 {
     sqlite3_stmt *stmt1 = NULL;
+    sqlite3_stmt *stmt1_max = NULL;
+    sqlite3_int64 max_rowid;
     sqlite3_stmt *stmt2 = NULL;
     sqlite3_stmt *stmt3 = NULL;
     sqlite3_stmt *stmt4 = NULL;
     sqlite3_stmt *stmt5 = NULL;
+    sqlite3_stmt *stmt_ver = NULL;
+    sqlite3_stmt *stmt_ver_sys = NULL;
+    int version = -1, version_sys = -1;
+    int db_changed, sys_changed;
     int ret = 0;
     int itmp = 0;
     char buffer[1024];
 
+    // Alarms are read incrementally by rowid, max(rowid) is a lookup of
+    // the last row of the table and doesn't depend on its size
     if (ipcsys_db) {
-        sprintf (buffer, "select max(c_alarm_time), c_alarm_context from t_alarm_log;");
+        sprintf (buffer, "select max(rowid) from t_alarm_log;");
     } else {
-        sprintf (buffer, "select max(c_alarm_time), c_alarm_code from T_RecordFile;");
+        sprintf (buffer, "select max(rowid) from T_RecordFile;");
+    }
+    ret = sqlite3_prepare_v2(dbc, buffer, -1, &stmt1_max, NULL);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "Failed to fetch data: %s\n", sqlite3_errmsg(dbc));
+    }
+
+    if (ipcsys_db) {
+        sprintf (buffer, "select rowid, c_alarm_time from t_alarm_log where rowid > ? order by rowid;");
+    } else {
+        sprintf (buffer, "select rowid, c_alarm_time from T_RecordFile where rowid > ? order by rowid;");
     }
     ret = sqlite3_prepare_v2(dbc, buffer, -1, &stmt1, NULL);
     if (ret != SQLITE_OK) {
@@ -192,15 +257,60 @@ static void *sql_thread(void *args)
         fprintf(stderr, "Failed to fetch data: %s\n", sqlite3_errmsg(dbc_sys));
     }
 
+    ret = sqlite3_prepare_v2(dbc, "pragma data_version;", -1, &stmt_ver, NULL);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "Failed to fetch data: %s\n", sqlite3_errmsg(dbc));
+    }
+    if (dbc != dbc_sys) {
+        ret = sqlite3_prepare_v2(dbc_sys, "pragma data_version;", -1, &stmt_ver_sys, NULL);
+        if (ret != SQLITE_OK) {
+            fprintf(stderr, "Failed to fetch data: %s\n", sqlite3_errmsg(dbc_sys));
+        }
+    }
+
+    sql_watch_init();
+
     while(tr_sql_routine)
     {
-        ret = sqlite3_step(stmt1);
-        if (ret == SQLITE_ROW) {
-            if (sqlite3_column_text(stmt1, 0) != NULL) {
-                parse_message((char *) sqlite3_column_text(stmt1, 0));
+        // Run the queries only if a db was committed by another connection
+        db_changed = sql_changed(stmt_ver, &version);
+        if (dbc != dbc_sys) {
+            sys_changed = sql_changed(stmt_ver_sys, &version_sys);
+        } else {
+            sys_changed = db_changed;
+        }
+        if (sys_updated) {
+            sys_updated = 0;
+            sys_changed = 1;
+        }
+
+        if (db_changed) {
+            max_rowid = -1;
+            ret = sqlite3_step(stmt1_max);
+            if ((ret == SQLITE_ROW) && (sqlite3_column_type(stmt1_max, 0) != SQLITE_NULL)) {
+                max_rowid = sqlite3_column_int64(stmt1_max, 0);
+            } else if (ret == SQLITE_ROW) {
+                max_rowid = 0;
+            }
+            ret = sqlite3_reset(stmt1_max);
+
+            if ((max_rowid >= 0) && ((last_rowid < 0) || (max_rowid < last_rowid))) {
+                // First run, or the table was emptied/recreated
+                last_rowid = max_rowid;
+            } else if (max_rowid > last_rowid) {
+                // Every new row is an event
+                sqlite3_bind_int64(stmt1, 1, last_rowid);
+                while (sqlite3_step(stmt1) == SQLITE_ROW) {
+                    parse_message(sqlite3_column_int64(stmt1, 0), (char *) sqlite3_column_text(stmt1, 1));
+                }
+                ret = sqlite3_reset(stmt1);
             }
         }
-        ret = sqlite3_reset(stmt1);
+
+        if (!sys_changed) {
+            sql_wait_change();
+            continue;
+        }
 
         ret = sqlite3_step(stmt2);
         if (ret == SQLITE_ROW) {
@@ -268,33 +378,171 @@ static void *sql_thread(void *args)
         }
         ret = sqlite3_reset(stmt5);
 
-        usleep(1000*1000);
+        sql_wait_change();
     }
 
     sqlite3_finalize(stmt1);
+    sqlite3_finalize(stmt1_max);
     sqlite3_finalize(stmt2);
     sqlite3_finalize(stmt3);
     sqlite3_finalize(stmt4);
+    sqlite3_finalize(stmt5);
+    sqlite3_finalize(stmt_ver);
+    if (stmt_ver_sys != NULL)
+        sqlite3_finalize(stmt_ver_sys);
+
+    if (watch_fd >= 0) {
+        close(watch_fd);
+        watch_fd = -1;
+    }
 
     return 0;
 }
 
+//-----------------------------------------------------------------------------
+// CHANGE NOTIFICATION
+//-----------------------------------------------------------------------------
+
+static int sql_watch_init()
+{
+    watches_num = 0;
+    watch_fd = inotify_init();
+    if (watch_fd < 0) {
+        fprintf(stderr, "Can't init inotify, polling the db\n");
+        return -1;
+    }
+    fcntl(watch_fd, F_SETFL, O_NONBLOCK);
+
+    if ((sql_watch_add(IPCSYS_DB) != 0) || (!ipcsys_db && (sql_watch_add(IPCMMC_DB) != 0))) {
+        fprintf(stderr, "Can't watch the db, polling it\n");
+        close(watch_fd);
+        watch_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Watch the folder: the journal and the wal are created and removed
+static int sql_watch_add(const char *db)
+{
+    char dir[PATH_MAX];
+    char *p;
+
+    strncpy(dir, db, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    p = strrchr(dir, '/');
+    if ((p == NULL) || (strlen(p + 1) >= sizeof(watches[0].name)))
+        return -1;
+    *p = '\0';
+
+    watches[watches_num].wd = inotify_add_watch(watch_fd, dir,
+            IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+    if (watches[watches_num].wd < 0)
+        return -1;
+    strcpy(watches[watches_num].name, p + 1);
+    watches_num++;
+
+    return 0;
+}
+
+/*
+ * Wait until a db, its journal or its wal is written.
+ * Without inotify just sleep SQL_POLL_WAIT ms.
+ */
+static void sql_wait_change()
+{
+    char ev_buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    struct pollfd pfd[2];
+    char *p;
+    int len, i;
+    int changed = 0;
+
+    pfd[0].fd = wake_fd[0];
+    pfd[0].events = POLLIN;
+    pfd[1].fd = watch_fd;
+    pfd[1].events = POLLIN;
+
+    if (watch_fd < 0) {
+        if (poll(pfd, 1, SQL_POLL_WAIT) > 0)
+            while (read(wake_fd[0], ev_buf, sizeof(ev_buf)) > 0);
+        return;
+    }
+
+    while (tr_sql_routine && !changed && !sys_updated) {
+        if (poll(pfd, 2, SQL_MAX_WAIT) <= 0)
+            return;
+
+        // Written by sql_update or by sql_stop
+        if (pfd[0].revents & POLLIN)
+            while (read(wake_fd[0], ev_buf, sizeof(ev_buf)) > 0);
+
+        while ((len = read(watch_fd, ev_buf, sizeof(ev_buf))) > 0) {
+            for (p = ev_buf; p < ev_buf + len; p += sizeof(struct inotify_event) + ev->len) {
+                ev = (struct inotify_event *) p;
+                if (ev->len == 0)
+                    continue;
+                for (i = 0; i < watches_num; i++) {
+                    // db, db-journal, db-wal and db-shm
+                    if ((ev->wd == watches[i].wd) &&
+                            (strncmp(ev->name, watches[i].name, strlen(watches[i].name)) == 0))
+                        changed = 1;
+                }
+            }
+        }
+    }
+    sql_debug("DB CHANGED\n");
+}
+
+static void sql_wakeup()
+{
+    char c = 0;
+
+    // If the pipe is full the thread is already awake
+    if ((write(wake_fd[1], &c, 1) < 0) && (errno != EAGAIN))
+        fprintf(stderr, "Can't wake up the sql thread\n");
+}
+
+/*
+ * Return 1 if the data_version of the connection changed since the last call.
+ */
+static int sql_changed(sqlite3_stmt *stmt, int *version)
+{
+    int v;
+
+    if (stmt == NULL)
+        return 1;
+
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        sqlite3_reset(stmt);
+        return 1;
+    }
+    v = sqlite3_column_int(stmt, 0);
+    sqlite3_reset(stmt);
+
+    if (v == *version)
+        return 0;
+    *version = v;
+
+    return 1;
+}
+
 //-----------------------------------------------------------------------------
 // MSG PARSER
 //-----------------------------------------------------------------------------
 
-static int parse_message(char *msg)
+static int parse_message(sqlite3_int64 rowid, char *msg)
 {
     sql_debug("Parsing message.\n");
 
-    sql_debug(msg);
+    if (msg != NULL)
+        sql_debug(msg);
     sql_debug("\n");
 
-    if (strcmp(last_msg, msg) != 0) {
-        if (last_msg[0] != '\0') {
-            handle_sql_motion_start();
-        }
-        strcpy(last_msg, msg);
+    if (rowid > last_rowid) {
+        last_rowid = rowid;
+        handle_sql_motion_start();
         return 0;
     }
 
@@ -321,6 +569,129 @@ static void handle_sql_command(int cmd)
 // GETTERS AND SETTERS
 //-----------------------------------------------------------------------------
 
+/*
+ * Start a transaction: the next updates are written together, with one
+ * commit, by sql_update_end.
+ */
+int sql_update_begin()
+{
+    int ret;
+
+    if (updates_pending >= 0)
+        return 0;
+
+    ret = sqlite3_exec(dbc_upd, "begin;", NULL, NULL, NULL);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "Failed to begin transaction: %s\n", sqlite3_errmsg(dbc_upd));
+        return -1;
+    }
+    updates_pending = 0;
+
+    return 0;
+}
+
+int sql_update_end()
+{
+    int ret;
+
+    if (updates_pending < 0)
+        return 0;
+
+    ret = sqlite3_exec(dbc_upd, "commit;", NULL, NULL, NULL);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "Failed to commit %d updates: %s\n", updates_pending, sqlite3_errmsg(dbc_upd));
+        sqlite3_exec(dbc_upd, "rollback;", NULL, NULL, NULL);
+        // Report the state that is really in the db
+        if (updates_pending > 0) {
+            sys_updated = 1;
+            sql_wakeup();
+        }
+        updates_pending = -1;
+        return -1;
+    }
+    sql_debug("COMMITTED %d UPDATES\n", updates_pending);
+
+    if (updates_pending > 0) {
+        sys_updated = 1;
+        sql_wakeup();
+    }
+    updates_pending = -1;
+
+    return 0;
+}
+
+/*
+ * Write a setting received by mqtt (the keys of sql_cmd_params).
+ * The thread reads the db again and reports the new state at once,
+ * or after sql_update_end inside a transaction.
+ */
+int sql_update(char *key, char *value)
+{
+    int ret;
+    char buffer[1024];
+    char stmp[16];
+
+    if (strcasecmp("no", value) == 0) {
+        strcpy(stmp, "0");
+    } else if (strcasecmp("yes", value) == 0) {
+        strcpy(stmp, "1");
+    } else {
+        strcpy(stmp, "");
+    }
+
+    if (strcasecmp("sensitivity", key) == 0) {
+        if (strcasecmp("off", value) == 0) {
+            sprintf (buffer, "update t_mdarea set c_sensitivity=%s where c_index=0;", "0");
+        } else if (strcasecmp("low", value) == 0) {
+            sprintf (buffer, "update t_mdarea set c_sensitivity=%s where c_index=0;", "25");
+        } else if (strcasecmp("medium", value) == 0) {
+            sprintf (buffer, "update t_mdarea set c_sensitivity=%s where c_index=0;", "50");
+        } else if (strcasecmp("high", value) == 0) {
+            sprintf (buffer, "update t_mdarea set c_sensitivity=%s where c_index=0;", "75");
+        } else {
+            sprintf (buffer, "update t_mdarea set c_sensitivity=%d where c_index=0;", atoi(value));
+        }
+    } else if ((strcasecmp("motion_detection", key) == 0) && (strlen(stmp) > 0)) {
+        sprintf (buffer, "update t_mdarea set c_enable=%s where c_index=0;", stmp);
+    } else if ((strcasecmp("local_record", key) == 0) && (strlen(stmp) > 0)) {
+        sprintf (buffer, "update t_record_plan set c_enabled=%s where c_recplan_no=1;", stmp);
+    } else if (strcasecmp("ir", key) == 0) {
+        if (strcasecmp("auto", value) == 0) {
+            sprintf (buffer, "update t_sys_param set c_param_value=%s where c_param_name=\"InfraredLamp\";", "2");
+        } else if (strcasecmp("on", value) == 0) {
+            sprintf (buffer, "update t_sys_param set c_param_value=%s where c_param_name=\"InfraredLamp\";", "0");
+        } else if (strcasecmp("off", value) == 0) {
+            sprintf (buffer, "update t_sys_param set c_param_value=%s where c_param_name=\"InfraredLamp\";", "1");
+        } else {
+            fprintf(stderr, "Wrong value %s for %s\n", value, key);
+            return -1;
+        }
+    } else if ((strcasecmp("rotate", key) == 0) && (strlen(stmp) > 0)) {
+        sprintf (buffer, "update t_sys_param set c_param_value=%s where c_param_name=\"flip\" or c_param_name=\"mirror\";", stmp);
+    } else if (strcasecmp("switch_on", key) == 0) {
+        return 0;
+    } else {
+        fprintf(stderr, "Unknown key %s or wrong value %s\n", key, value);
+        return -1;
+    }
+
+    ret = sqlite3_exec(dbc_upd, buffer, NULL, NULL, NULL);
+    if (ret != SQLITE_OK) {
+        fprintf(stderr, "Failed to update data: %s\n", sqlite3_errmsg(dbc_upd));
+        return -2;
+    }
+
+    if (updates_pending >= 0) {
+        updates_pending++;
+        return 0;
+    }
+
+    sys_updated = 1;
+    sql_wakeup();
+
+    return 0;
+}
+
 int sql_set_callback(SQL_MESSAGE_TYPE type, void (*f)())
 {
     if(type >= SQL_MSG_LAST)
@@ -0,0 +1,134 @@
+/*
+ * Compare the two ways of finding new alarms in t_alarm_log:
+ * - the old probe: select max(c_alarm_time)
+ * - the rowid cursor of sql.c: select max(rowid), then the rows after
+ *   the last one seen (none here, as in most polls)
+ * on tables of 1000, 10000 and 100000 rows in a scratch db.
+ *
+ * Usage: bench_alarm_query DB [POLLS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#define DEFAULT_POLLS          200
+
+static double now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static int fill_table(sqlite3 *db, int rows)
+{
+    sqlite3_stmt *stmt;
+    char buffer[32];
+    int i;
+
+    sqlite3_exec(db, "drop table if exists t_alarm_log;"
+            "create table t_alarm_log (c_alarm_time text, c_alarm_type integer);"
+            "begin;", NULL, NULL, NULL);
+    if (sqlite3_prepare_v2(db, "insert into t_alarm_log values (?, 1);", -1, &stmt, NULL) != SQLITE_OK)
+        return -1;
+    for (i = 0; i < rows; i++) {
+        // One alarm every 10 s, the times are unique and sorted
+        sprintf(buffer, "%d", 1600000000 + i * 10);
+        sqlite3_bind_text(stmt, 1, buffer, -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    return (sqlite3_exec(db, "commit;", NULL, NULL, NULL) == SQLITE_OK) ? 0 : -1;
+}
+
+static double bench_max_time(sqlite3 *db, int polls)
+{
+    sqlite3_stmt *stmt;
+    double t;
+    int i;
+
+    sqlite3_prepare_v2(db, "select max(c_alarm_time) from t_alarm_log;", -1, &stmt, NULL);
+    t = now_us();
+    for (i = 0; i < polls; i++) {
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    t = now_us() - t;
+    sqlite3_finalize(stmt);
+
+    return t / polls;
+}
+
+static double bench_rowid(sqlite3 *db, int polls)
+{
+    sqlite3_stmt *stmt_max, *stmt;
+    sqlite3_int64 last_rowid = -1, max_rowid;
+    double t;
+    int i;
+
+    sqlite3_prepare_v2(db, "select max(rowid) from t_alarm_log;", -1, &stmt_max, NULL);
+    sqlite3_prepare_v2(db, "select rowid, c_alarm_time from t_alarm_log where rowid > ? order by rowid;", -1, &stmt, NULL);
+    t = now_us();
+    for (i = 0; i < polls; i++) {
+        max_rowid = 0;
+        if (sqlite3_step(stmt_max) == SQLITE_ROW)
+            max_rowid = sqlite3_column_int64(stmt_max, 0);
+        sqlite3_reset(stmt_max);
+        if (max_rowid > last_rowid) {
+            sqlite3_bind_int64(stmt, 1, last_rowid);
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+                last_rowid = sqlite3_column_int64(stmt, 0);
+            sqlite3_reset(stmt);
+            // The first poll reads the whole table, the cursor starts from there
+            if (i == 0)
+                t = now_us();
+        }
+    }
+    t = now_us() - t;
+    sqlite3_finalize(stmt_max);
+    sqlite3_finalize(stmt);
+
+    return t / (polls - 1);
+}
+
+int main(int argc, char **argv)
+{
+    int sizes[] = { 1000, 10000, 100000 };
+    int polls = DEFAULT_POLLS;
+    sqlite3 *db;
+    unsigned int i;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s DB [POLLS]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2)
+        polls = atoi(argv[2]);
+    if (polls < 2)
+        polls = DEFAULT_POLLS;
+
+    if (sqlite3_open(argv[1], &db) != SQLITE_OK) {
+        fprintf(stderr, "Can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("%d polls\n", polls);
+    printf("  rows      max(c_alarm_time)   rowid cursor\n");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (fill_table(db, sizes[i]) != 0) {
+            fprintf(stderr, "Can't fill the table: %s\n", sqlite3_errmsg(db));
+            return 1;
+        }
+        printf("%6d    %10.0f us/poll   %7.0f us/poll\n", sizes[i],
+                bench_max_time(db, polls), bench_rowid(db, polls));
+    }
+
+    sqlite3_close(db);
+
+    return 0;
+}
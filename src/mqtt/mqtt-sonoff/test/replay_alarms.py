@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# Replay alarm inserts against a scratch ipcsys.db and measure how long
+# the sql thread of mqtt-sonoff takes to report them.
+#
+# Usage: replay_alarms.py HARNESS DB [REPLAY_FILE]
+#
+# HARNESS is sql_latency built for DB (see the Makefile). REPLAY_FILE has
+# one transaction per line: "<delay ms> <rows>", the rows are inserted
+# together after the delay; without it a default sequence is used.
+# The latency of a row goes from the return of the commit of its
+# transaction to its MOTION callback: it can be slightly negative, the
+# thread can read the rows before the commit call returns.
+# The exit code is 1 if a row is not reported.
+#
+
+import os
+import random
+import sqlite3
+import subprocess
+import sys
+import threading
+import time
+
+SETTLE_TIME = 0.5       # s, after the first pass of the sql thread
+DRAIN_TIME = 1.0        # s, after the last insert
+
+def create_db(path):
+    for ext in ("", "-journal", "-wal", "-shm"):
+        if os.path.exists(path + ext):
+            os.remove(path + ext)
+    db = sqlite3.connect(path, isolation_level=None)
+    db.executescript("""
+        create table t_alarm_log (c_alarm_time text, c_alarm_type integer);
+        create table t_mdarea (c_index integer, c_sensitivity integer, c_enable integer);
+        create table t_record_plan (c_recplan_no integer, c_enabled integer);
+        create table t_sys_param (c_param_name text, c_param_value text);
+        insert into t_mdarea values (0, 50, 1);
+        insert into t_record_plan values (1, 1);
+        insert into t_sys_param values ("InfraredLamp", "2");
+        insert into t_sys_param values ("mirror", "0");
+        insert into t_sys_param values ("flip", "0");
+    """)
+    return db
+
+def default_sequence():
+    random.seed(1)
+    seq = []
+    # Single alarms at irregular intervals, then bursts
+    for i in range(40):
+        seq.append((random.randint(50, 400), 1))
+    for i in range(10):
+        seq.append((random.randint(100, 400), 3))
+    # Back to back transactions
+    for i in range(10):
+        seq.append((0, 1))
+    return seq
+
+def read_sequence(path):
+    seq = []
+    with open(path) as f:
+        for line in f:
+            line = line.split("#")[0].split()
+            if len(line) == 2:
+                seq.append((int(line[0]), int(line[1])))
+    return seq
+
+def read_output(proc, motions, ready):
+    for line in proc.stdout:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == "READY":
+            ready.set()
+        elif fields[0] == "MOTION":
+            motions.append(float(fields[1]))
+
+def percentile(values, p):
+    values = sorted(values)
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+def main():
+    if len(sys.argv) < 3:
+        print("Usage: %s HARNESS DB [REPLAY_FILE]" % sys.argv[0], file=sys.stderr)
+        return 2
+
+    harness, db_path = sys.argv[1], sys.argv[2]
+    seq = read_sequence(sys.argv[3]) if len(sys.argv) > 3 else default_sequence()
+
+    db = create_db(db_path)
+
+    motions = []
+    ready = threading.Event()
+    proc = subprocess.Popen([harness], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                            universal_newlines=True)
+    reader = threading.Thread(target=read_output, args=(proc, motions, ready))
+    reader.start()
+    if not ready.wait(5):
+        print("The harness didn't start", file=sys.stderr)
+        proc.kill()
+        return 2
+    time.sleep(SETTLE_TIME)
+
+    # Commit time of every inserted row, CLOCK_MONOTONIC in ms like the harness
+    commits = []
+    for delay, rows in seq:
+        time.sleep(delay / 1000.0)
+        db.execute("begin")
+        for i in range(rows):
+            db.execute("insert into t_alarm_log values (datetime('now'), 1)")
+        db.execute("commit")
+        t = time.monotonic() * 1000.0
+        commits.extend([t] * rows)
+
+    time.sleep(DRAIN_TIME)
+    proc.stdin.close()
+    proc.wait()
+    reader.join()
+    db.close()
+
+    latency = [m - c for c, m in zip(commits, motions)]
+    print("transactions %d, rows %d, reported %d" % (len(seq), len(commits), len(motions)))
+    if latency:
+        print("latency ms: min %.2f p50 %.2f p99 %.2f max %.2f" %
+              (min(latency), percentile(latency, 50), percentile(latency, 99), max(latency)))
+
+    return 0 if len(motions) == len(commits) else 1
+
+if __name__ == "__main__":
+    sys.exit(main())
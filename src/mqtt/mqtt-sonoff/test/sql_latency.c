@@ -0,0 +1,54 @@
+/*
+ * Host harness for the change detection of sql.c.
+ * Runs the sql thread on the scratch db of the Makefile and prints a line
+ * with the CLOCK_MONOTONIC time of every callback:
+ *   MOTION <ms>
+ *   COMMAND <cmd> <ms>
+ * It exits when stdin is closed. Driven by replay_alarms.py.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "sql.h"
+
+static double now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void callback_motion_start(void *arg)
+{
+    printf("MOTION %.3f\n", now_ms());
+    fflush(stdout);
+}
+
+static void callback_command(void *arg)
+{
+    printf("COMMAND %d %.3f\n", *((int *) arg), now_ms());
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    char line[256];
+
+    sql_set_callback(SQL_MSG_MOTION_START, &callback_motion_start);
+    sql_set_callback(SQL_MSG_COMMAND, &callback_command);
+
+    if (sql_init(1) != 0) {
+        fprintf(stderr, "Can't open %s\n", IPCSYS_DB);
+        return 1;
+    }
+    printf("READY %.3f\n", now_ms());
+    fflush(stdout);
+
+    while (fgets(line, sizeof(line), stdin) != NULL);
+
+    sql_stop();
+
+    return 0;
+}
@@ -11,6 +11,7 @@
 
 ServiceContext::ServiceContext():
     port     ( 1000    ),
+    cache    ( true    ),
     user     ( "admin" ),
     password ( "admin" ),
 
@@ -67,6 +68,63 @@ std::string ServiceContext::getXAddr(soap *soap) const
 
 
 
+bool ServiceContext::find_response(soap *soap, const std::string& key, std::string& xml)
+{
+    if( !cache )
+        return false;
+
+    return response_cache.find(getServerIpFromClientIp(htonl(soap->ip)), cache_key(soap, key), xml);
+}
+
+
+
+std::string ServiceContext::cache_key(soap *soap, const std::string& key) const
+{
+    // SOAP 1.1 and 1.2 clients get different envelopes
+    return key + (soap->version == 2 ? "@1.2" : "@1.1");
+}
+
+
+
+bool ResponseCache::find(const std::string& server_ip, const std::string& key, std::string& xml)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&mutex);
+
+    auto ip = entries.find(server_ip);
+    if( ip != entries.end() )
+    {
+        auto it = ip->second.find(key);
+        if( it != ip->second.end() )
+        {
+            xml   = it->second;
+            found = true;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return found;
+}
+
+
+
+void ResponseCache::add(const std::string& server_ip, const std::string& key, const std::string& xml, size_t max_ips)
+{
+    pthread_mutex_lock(&mutex);
+
+    // a new server IP when all interfaces already have one: an address has changed
+    if( !entries.count(server_ip) && (entries.size() >= max_ips) )
+        entries.clear();
+
+    entries[server_ip][key] = xml;
+
+    pthread_mutex_unlock(&mutex);
+}
+
+
+
 bool ServiceContext::add_profile(const StreamProfile &profile)
 {
     if( !profile.is_valid() )
@@ -579,6 +637,8 @@ bool StreamProfile::is_valid() const
 void PTZNode::clear()
 {
     enable = false;
+    native = false;
+    reverse = false;
 
     move_left.clear();
     move_right.clear();
@@ -587,6 +647,7 @@ void PTZNode::clear()
     move_stop.clear();
     move_preset.clear();
     set_preset.clear();
+    ptz_socket.clear();
 }
 
 
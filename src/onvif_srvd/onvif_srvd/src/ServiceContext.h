@@ -5,9 +5,12 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <pthread.h>
+#include <arpa/inet.h>
 
 #include "soapH.h"
 #include "eth_dev_param.h"
+#include "stools.h"
 
 
 
@@ -77,6 +80,8 @@ class PTZNode
         PTZNode() { clear(); }
 
         bool         enable;
+        bool         native;  // the commands are sent to ptzd, the processes only if it is not running
+        bool         reverse; // the image is rotated, directions and positions are swapped
 
         std::string  get_move_left   (void) const { return move_left;   }
         std::string  get_move_right  (void) const { return move_right;  }
@@ -85,6 +90,7 @@ class PTZNode
         std::string  get_move_stop   (void) const { return move_stop;   }
         std::string  get_move_preset (void) const { return move_preset;   }
         std::string  get_set_preset  (void) const { return set_preset;   }
+        std::string  get_ptz_socket  (void) const { return ptz_socket;  }
 
 
 
@@ -96,6 +102,7 @@ class PTZNode
         bool set_move_stop   (const char *new_val) { return set_str_value(new_val, move_stop  ); }
         bool set_move_preset (const char *new_val) { return set_str_value(new_val, move_preset); }
         bool set_set_preset  (const char *new_val) { return set_str_value(new_val, set_preset ); }
+        bool set_ptz_socket  (const char *new_val) { return set_str_value(new_val, ptz_socket ); }
 
 
         std::string get_str_err()  const { return str_err;         }
@@ -113,6 +120,7 @@ class PTZNode
         std::string  move_stop;
         std::string  move_preset;
         std::string  set_preset;
+        std::string  ptz_socket;
 
 
         std::string  str_err;
@@ -124,6 +132,34 @@ class PTZNode
 
 
 
+/*
+ * NVRs poll the same requests (GetCapabilities, GetProfiles, ...) constantly,
+ * the responses depend only on the configuration and on the server IP (XAddr).
+ * The cache keeps the serialized Body of them per server IP. The configuration
+ * does not change while the daemon runs, so the entries are dropped only
+ * when a new server IP appears (the address of an interface has changed).
+ */
+class ResponseCache
+{
+    public:
+
+        ResponseCache()  { pthread_mutex_init(&mutex, NULL); }
+        ~ResponseCache() { pthread_mutex_destroy(&mutex);    }
+
+        bool find(const std::string& server_ip, const std::string& key, std::string& xml);
+        void add (const std::string& server_ip, const std::string& key, const std::string& xml, size_t max_ips);
+
+
+    private:
+
+        std::map<std::string, std::map<std::string, std::string> > entries; //server IP -> key -> Body XML
+        pthread_mutex_t mutex;
+};
+
+
+
+
+
 class ServiceContext
 {
     public:
@@ -132,6 +168,7 @@ class ServiceContext
 
 
         int         port;
+        bool        cache; // see ResponseCache
         std::string user;
         std::string password;
 
@@ -153,6 +190,27 @@ class ServiceContext
         std::string getXAddr(struct soap* soap) const;
 
 
+        // cache of the responses that depend only on the configuration and the server IP
+        bool find_response(struct soap* soap, const std::string& key, std::string& xml);
+
+        template<typename T>
+        int add_response(struct soap* soap, const std::string& key, T& response, const char *tag)
+        {
+            std::string xml;
+
+            // Without the cache the generated code sends the response
+            if( !cache )
+                return SOAP_OK;
+
+            if( soap_response_to_xml(soap, response, tag, xml) != SOAP_OK )
+                return soap->error;
+
+            response_cache.add(getServerIpFromClientIp(htonl(soap->ip)), cache_key(soap, key), xml, eth_ifs.size() + 1);
+
+            return soap_send_xml(soap, xml);
+        }
+
+
 
         std::string get_str_err() const { return str_err;         }
         const char* get_cstr_err()const { return str_err.c_str(); }
@@ -188,7 +246,11 @@ class ServiceContext
         std::map<std::string, StreamProfile> profiles;
         PTZNode ptz_node;
 
+        ResponseCache response_cache;
+
         std::string  str_err;
+
+        std::string cache_key(struct soap* soap, const std::string& key) const;
 };
 
 
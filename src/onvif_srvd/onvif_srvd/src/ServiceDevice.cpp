@@ -29,6 +29,11 @@ int DeviceBindingService::GetServices(_tds__GetServices *tds__GetServices, _tds_
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
 
+    std::string key = tds__GetServices->IncludeCapability ? "tds:GetServices+caps" : "tds:GetServices";
+    std::string xml;
+    if( ctx->find_response(this->soap, key, xml) )
+        return soap_send_xml(this->soap, xml);
+
     std::string XAddr = ctx->getXAddr(this->soap);
 
 
@@ -74,7 +79,7 @@ int DeviceBindingService::GetServices(_tds__GetServices *tds__GetServices, _tds_
     }
 
 
-    return SOAP_OK;
+    return ctx->add_response(this->soap, key, tds__GetServicesResponse, "tds:GetServicesResponse");
 }
 
 
@@ -85,9 +90,14 @@ int DeviceBindingService::GetServiceCapabilities(_tds__GetServiceCapabilities *t
     DEBUG_MSG("Device: %s\n", __FUNCTION__);
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
+
+    std::string xml;
+    if( ctx->find_response(this->soap, "tds:GetServiceCapabilities", xml) )
+        return soap_send_xml(this->soap, xml);
+
     tds__GetServiceCapabilitiesResponse.Capabilities = ctx->getDeviceServiceCapabilities(this->soap);
 
-    return SOAP_OK;
+    return ctx->add_response(this->soap, "tds:GetServiceCapabilities", tds__GetServiceCapabilitiesResponse, "tds:GetServiceCapabilitiesResponse");
 }
 
 
@@ -99,13 +109,18 @@ int DeviceBindingService::GetDeviceInformation(_tds__GetDeviceInformation *tds__
 
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
+
+    std::string xml;
+    if( ctx->find_response(this->soap, "tds:GetDeviceInformation", xml) )
+        return soap_send_xml(this->soap, xml);
+
     tds__GetDeviceInformationResponse.Manufacturer    = ctx->manufacturer;
     tds__GetDeviceInformationResponse.Model           = ctx->model;
     tds__GetDeviceInformationResponse.FirmwareVersion = ctx->firmware_version;
     tds__GetDeviceInformationResponse.SerialNumber    = ctx->serial_number;
     tds__GetDeviceInformationResponse.HardwareId      = ctx->hardware_id;
 
-    return SOAP_OK;
+    return ctx->add_response(this->soap, "tds:GetDeviceInformation", tds__GetDeviceInformationResponse, "tds:GetDeviceInformationResponse");
 }
 
 
@@ -212,12 +227,16 @@ int DeviceBindingService::GetScopes(_tds__GetScopes *tds__GetScopes, _tds__GetSc
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
 
+    std::string xml;
+    if( ctx->find_response(this->soap, "tds:GetScopes", xml) )
+        return soap_send_xml(this->soap, xml);
+
     for(size_t i = 0; i < ctx->scopes.size(); ++i)
     {
         tds__GetScopesResponse.Scopes.push_back(soap_new_req_tt__Scope(soap, tt__ScopeDefinition__Fixed, ctx->scopes[i]));
     }
 
-    return SOAP_OK;
+    return ctx->add_response(this->soap, "tds:GetScopes", tds__GetScopesResponse, "tds:GetScopesResponse");
 }
 
 
@@ -370,6 +389,16 @@ int DeviceBindingService::GetCapabilities(_tds__GetCapabilities *tds__GetCapabil
     }
 
 
+    // the response depends on the requested categories
+    std::string key = "tds:GetCapabilities";
+    for(size_t i = 0; i < categories.size(); ++i)
+        key += "+" + std::to_string(categories[i]);
+
+    std::string xml;
+    if( ctx->find_response(this->soap, key, xml) )
+        return soap_send_xml(this->soap, xml);
+
+
     for(tt__CapabilityCategory category : categories)
     {
         if(!tds__GetCapabilitiesResponse.Capabilities->Device && ( (category == tt__CapabilityCategory__All) || (category == tt__CapabilityCategory__Device) ) )
@@ -407,7 +436,7 @@ int DeviceBindingService::GetCapabilities(_tds__GetCapabilities *tds__GetCapabil
         }
     }
 
-    return SOAP_OK;
+    return ctx->add_response(this->soap, key, tds__GetCapabilitiesResponse, "tds:GetCapabilitiesResponse");
 }
 
 
@@ -24,10 +24,15 @@ int MediaBindingService::GetServiceCapabilities(_trt__GetServiceCapabilities *tr
 
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
+
+    std::string xml;
+    if( ctx->find_response(this->soap, "trt:GetServiceCapabilities", xml) )
+        return soap_send_xml(this->soap, xml);
+
     trt__GetServiceCapabilitiesResponse.Capabilities = ctx->getMediaServiceCapabilities(this->soap);
 
 
-    return SOAP_OK;
+    return ctx->add_response(this->soap, "trt:GetServiceCapabilities", trt__GetServiceCapabilitiesResponse, "trt:GetServiceCapabilitiesResponse");
 }
 
 
@@ -40,6 +45,10 @@ int MediaBindingService::GetVideoSources(_trt__GetVideoSources *trt__GetVideoSou
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
 
+    std::string xml;
+    if( ctx->find_response(this->soap, "trt:GetVideoSources", xml) )
+        return soap_send_xml(this->soap, xml);
+
     auto profiles = ctx->get_profiles();
 
 
@@ -51,7 +60,7 @@ int MediaBindingService::GetVideoSources(_trt__GetVideoSources *trt__GetVideoSou
     }
 
 
-    return SOAP_OK;
+    return ctx->add_response(this->soap, "trt:GetVideoSources", trt__GetVideoSourcesResponse, "trt:GetVideoSourcesResponse");
 }
 
 
@@ -108,6 +117,10 @@ int MediaBindingService::GetProfiles(_trt__GetProfiles *trt__GetProfiles, _trt__
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
 
+    std::string xml;
+    if( ctx->find_response(this->soap, "trt:GetProfiles", xml) )
+        return soap_send_xml(this->soap, xml);
+
     auto profiles = ctx->get_profiles();
 
 
@@ -117,7 +130,7 @@ int MediaBindingService::GetProfiles(_trt__GetProfiles *trt__GetProfiles, _trt__
     }
 
 
-    return SOAP_OK;
+    return ctx->add_response(this->soap, "trt:GetProfiles", trt__GetProfilesResponse, "trt:GetProfilesResponse");
 }
 
 
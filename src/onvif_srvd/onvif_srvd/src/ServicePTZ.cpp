@@ -9,10 +9,146 @@
 
 
 #include <sstream>
+#include <algorithm>
 #include "soapPTZBindingService.h"
 #include "ServiceContext.h"
 #include "smacros.h"
 #include "stools.h"
+#include "ptzd_client.h"
+
+
+// DefaultPTZTimeout of the PTZ configuration (ms)
+#define DEFAULT_PTZ_TIMEOUT 5000
+
+
+
+// Preset token to number, -2 if it is not a number
+static int get_preset_num(const std::string& token)
+{
+    char *endptr;
+    long num = strtol(token.c_str(), &endptr, 10);
+
+    if( token.empty() || (*endptr != '\0') )
+        return -2;
+
+    return num;
+}
+
+
+
+// The directions are swapped if the image is rotated (see --ptz_reverse)
+static int reverse_action(int action)
+{
+    switch( action )
+    {
+        case ACTION_RIGHT: return ACTION_LEFT;
+        case ACTION_LEFT:  return ACTION_RIGHT;
+        case ACTION_UP:    return ACTION_DOWN;
+        case ACTION_DOWN:  return ACTION_UP;
+        default:           return action;
+    }
+}
+
+
+
+// Generic space (-1..1) to motor position (min..max). x grows moving right,
+// y moving up, so both are mirrored if the image is rotated.
+static int space_to_pos(float val, int min, int max, bool reverse)
+{
+    if( reverse )
+        val = -val;
+
+    if( val < -1.0f )
+        val = -1.0f;
+    else if( val > 1.0f )
+        val = 1.0f;
+
+    return min + (int)((val + 1.0f) * (max - min) / 2.0f + 0.5f);
+}
+
+
+
+static float pos_to_space(int pos, int min, int max, bool reverse)
+{
+    float val = 2.0f * (pos - min) / (max - min) - 1.0f;
+
+    return reverse ? -val : val;
+}
+
+
+
+// Move with ptzd or run the process from the options (other hardware, ptzd not running)
+static void ptz_move(ServiceContext* ctx, int action)
+{
+    PTZNode* ptz_node = ctx->get_ptz_node();
+
+    if( ptz_node->native )
+    {
+        int native_action = ptz_node->reverse ? reverse_action(action) : action;
+
+        // ptzd stops after the time like the ptz command does
+        if( ptzd_client_move(native_action, (native_action == ACTION_STOP) ? 0 : DEFAULT_ACTION_TIME) != PTZD_NOT_RUNNING )
+            return;
+    }
+
+    switch( action )
+    {
+        case ACTION_RIGHT: system(ptz_node->get_move_right().c_str()); break;
+        case ACTION_LEFT:  system(ptz_node->get_move_left().c_str());  break;
+        case ACTION_UP:    system(ptz_node->get_move_up().c_str());    break;
+        case ACTION_DOWN:  system(ptz_node->get_move_down().c_str());  break;
+        default:           system(ptz_node->get_move_stop().c_str());  break;
+    }
+}
+
+
+
+// Move until the timeout (ms, ptzd takes up to PTZD_MAX_TIME) or the next command,
+// the speed is fixed
+static int ptz_continuous_move(ServiceContext* ctx, float vx, float vy, int timeout)
+{
+    bool reverse = ctx->get_ptz_node()->reverse;
+    int  action;
+
+    if( (vx == 0) && (vy == 0) )
+        return ptzd_client_move(ACTION_STOP, 0);
+
+    if( (vx != 0) && (vy != 0) )
+    {
+        // The motors move in one direction at a time, go towards the corner instead
+        return ptzd_client_go(space_to_pos((vx > 0) ? 1.0f : -1.0f, MIN_X, MAX_X, reverse),
+                              space_to_pos((vy > 0) ? 1.0f : -1.0f, MIN_Y, MAX_Y, reverse), timeout);
+    }
+
+    if( vx != 0 )
+        action = (vx > 0) ? ACTION_RIGHT : ACTION_LEFT;
+    else
+        action = (vy > 0) ? ACTION_UP : ACTION_DOWN;
+
+    if( reverse )
+        action = reverse_action(action);
+
+    return ptzd_client_move(action, timeout);
+}
+
+
+
+// Translation in the generic space from the current position
+static int ptz_relative_move(ServiceContext* ctx, float dx, float dy)
+{
+    bool reverse = ctx->get_ptz_node()->reverse;
+    int  x, y, moving;
+    int  ret;
+
+    ret = ptzd_client_get_status(&x, &y, &moving);
+    if( ret != 0 )
+        return ret;
+
+    x = space_to_pos(pos_to_space(x, MIN_X, MAX_X, reverse) + dx, MIN_X, MAX_X, reverse);
+    y = space_to_pos(pos_to_space(y, MIN_Y, MAX_Y, reverse) + dy, MIN_Y, MAX_Y, reverse);
+
+    return ptzd_client_go(x, y, 0);
+}
 
 
 
@@ -88,6 +224,18 @@ int PTZBindingService::SetPreset(_tptz__SetPreset *tptz__SetPreset, _tptz__SetPr
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
 
+    if (ctx->get_ptz_node()->native) {
+        // If preset token is not specified take the first free preset
+        int preset_num = (tptz__SetPreset->PresetToken != NULL) ? get_preset_num(*tptz__SetPreset->PresetToken) : -1;
+        preset_num = ptzd_client_set_preset(preset_num, ((tptz__SetPreset->PresetName != NULL) && !tptz__SetPreset->PresetName->empty()) ? tptz__SetPreset->PresetName->c_str() : "no_name");
+        if (preset_num >= 0) {
+            tptz__SetPresetResponse.PresetToken = std::to_string(preset_num);
+        }
+        if (preset_num != PTZD_NOT_RUNNING) {
+            return SOAP_OK;
+        }
+    }
+
     if (!ctx->get_ptz_node()->get_set_preset().empty()) {
         preset_cmd = ctx->get_ptz_node()->get_set_preset().c_str();
     } else {
@@ -150,6 +298,11 @@ int PTZBindingService::RemovePreset(_tptz__RemovePreset *tptz__RemovePreset, _tp
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
 
+    if (ctx->get_ptz_node()->native &&
+            (ptzd_client_clear_preset(get_preset_num(tptz__RemovePreset->PresetToken)) != PTZD_NOT_RUNNING)) {
+        return SOAP_OK;
+    }
+
     if (!ctx->get_ptz_node()->get_set_preset().empty()) {
         preset_cmd = ctx->get_ptz_node()->get_set_preset().c_str();
     } else {
@@ -195,6 +348,11 @@ int PTZBindingService::GotoPreset(_tptz__GotoPreset *tptz__GotoPreset, _tptz__Go
         return SOAP_OK;
     }
 
+    if (ctx->get_ptz_node()->native &&
+            (ptzd_client_go_preset(get_preset_num(tptz__GotoPreset->PresetToken)) != PTZD_NOT_RUNNING)) {
+        return SOAP_OK;
+    }
+
     if (!ctx->get_ptz_node()->get_move_preset().empty()) {
         preset_cmd = ctx->get_ptz_node()->get_move_preset().c_str();
     } else {
@@ -218,7 +376,36 @@ int PTZBindingService::GotoPreset(_tptz__GotoPreset *tptz__GotoPreset, _tptz__Go
 
 int PTZBindingService::GetStatus(_tptz__GetStatus *tptz__GetStatus, _tptz__GetStatusResponse &tptz__GetStatusResponse)
 {
-    SOAP_EMPTY_HANDLER(tptz__GetStatus, "PTZ");
+    UNUSED(tptz__GetStatus);
+    DEBUG_MSG("PTZ: %s\n", __FUNCTION__);
+
+
+    ServiceContext* ctx = (ServiceContext*)this->soap->user;
+    bool reverse = ctx->get_ptz_node()->reverse;
+    int x, y, moving;
+
+    // The processes can't read the position
+    if (!ctx->get_ptz_node()->native) {
+        return SOAP_OK;
+    }
+    if (ptzd_client_get_status(&x, &y, &moving) != 0) {
+        return SOAP_OK;
+    }
+
+    tt__PTZStatus* ptzs = soap_new_tt__PTZStatus(soap);
+    tptz__GetStatusResponse.PTZStatus = ptzs;
+
+    ptzs->Position = soap_new_tt__PTZVector(soap);
+    ptzs->Position->PanTilt = soap_new_req_tt__Vector2D(soap, pos_to_space(x, MIN_X, MAX_X, reverse), pos_to_space(y, MIN_Y, MAX_Y, reverse));
+    ptzs->Position->PanTilt->space = soap_new_std__string(soap);
+    *ptzs->Position->PanTilt->space = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/PositionGenericSpace";
+
+    ptzs->MoveStatus = soap_new_tt__PTZMoveStatus(soap);
+    ptzs->MoveStatus->PanTilt = soap_new_ptr(soap, moving ? tt__MoveStatus__MOVING : tt__MoveStatus__IDLE);
+
+    ptzs->UtcTime = time(NULL);
+
+    return SOAP_OK;
 }
 
 
@@ -291,6 +478,18 @@ int GetPTZNode(struct soap *soap, tt__PTZNode* ptzn)
     ptzs6->URI         = "http://www.onvif.org/ver10/tptz/ZoomSpaces/ZoomGenericSpeedSpace";
     ptzs6->XRange      = soap_new_req_tt__FloatRange(soap, 0.0f, 1.0f);
 
+    // Only ptzd knows the position
+    if (((ServiceContext*)soap->user)->get_ptz_node()->native) {
+        soap_default_std__vectorTemplateOfPointerTott__Space2DDescription(soap, &ptzn->SupportedPTZSpaces->tt__PTZSpaces::AbsolutePanTiltPositionSpace);
+
+        auto ptzs7 = soap_new_tt__Space2DDescription(soap);
+        ptzn->SupportedPTZSpaces->AbsolutePanTiltPositionSpace.push_back(ptzs7);
+
+        ptzs7->URI     = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/PositionGenericSpace";
+        ptzs7->XRange  = soap_new_req_tt__FloatRange(soap, -1.0f, 1.0f);
+        ptzs7->YRange  = soap_new_req_tt__FloatRange(soap, -1.0f, 1.0f);
+    }
+
 
     ptzn->MaximumNumberOfPresets = 15;
     ptzn->HomeSupported          = true;
@@ -367,6 +566,10 @@ int PTZBindingService::GotoHomePosition(_tptz__GotoHomePosition *tptz__GotoHomeP
         return SOAP_OK;
     }
 
+    if (ctx->get_ptz_node()->native && (ptzd_client_go_preset(1) != PTZD_NOT_RUNNING)) {
+        return SOAP_OK;
+    }
+
     if (!ctx->get_ptz_node()->get_move_preset().empty()) {
         preset_cmd = ctx->get_ptz_node()->get_move_preset().c_str();
     } else {
@@ -395,6 +598,10 @@ int PTZBindingService::SetHomePosition(_tptz__SetHomePosition *tptz__SetHomePosi
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
 
+    if (ctx->get_ptz_node()->native && (ptzd_client_set_preset(1, "Home") != PTZD_NOT_RUNNING)) {
+        return SOAP_OK;
+    }
+
     if (!ctx->get_ptz_node()->get_set_preset().empty()) {
         preset_cmd = ctx->get_ptz_node()->get_set_preset().c_str();
     } else {
@@ -440,15 +647,26 @@ int PTZBindingService::ContinuousMove(_tptz__ContinuousMove *tptz__ContinuousMov
         return SOAP_OK;
     }
 
+    if (ctx->get_ptz_node()->native) {
+        LONG64 timeout = DEFAULT_PTZ_TIMEOUT;
+        if ((tptz__ContinuousMove->Timeout != NULL) && (*tptz__ContinuousMove->Timeout > 0)) {
+            // PTZTimeout range of the configuration options
+            timeout = std::min(*tptz__ContinuousMove->Timeout, (LONG64)100000);
+        }
+        if (ptz_continuous_move(ctx, tptz__ContinuousMove->Velocity->PanTilt->x, tptz__ContinuousMove->Velocity->PanTilt->y, (int)timeout) != PTZD_NOT_RUNNING) {
+            return SOAP_OK;
+        }
+    }
+
     if (tptz__ContinuousMove->Velocity->PanTilt->x > 0) {
-        system(ctx->get_ptz_node()->get_move_right().c_str());
+        ptz_move(ctx, ACTION_RIGHT);
     } else if (tptz__ContinuousMove->Velocity->PanTilt->x < 0) {
-        system(ctx->get_ptz_node()->get_move_left().c_str());
+        ptz_move(ctx, ACTION_LEFT);
     }
     if (tptz__ContinuousMove->Velocity->PanTilt->y > 0) {
-        system(ctx->get_ptz_node()->get_move_up().c_str());
+        ptz_move(ctx, ACTION_UP);
     } else if (tptz__ContinuousMove->Velocity->PanTilt->y < 0) {
-        system(ctx->get_ptz_node()->get_move_down().c_str());
+        ptz_move(ctx, ACTION_DOWN);
     }
 
     return SOAP_OK;
@@ -474,23 +692,28 @@ int PTZBindingService::RelativeMove(_tptz__RelativeMove *tptz__RelativeMove, _tp
         return SOAP_OK;
     }
 
+    if (ctx->get_ptz_node()->native &&
+            (ptz_relative_move(ctx, tptz__RelativeMove->Translation->PanTilt->x, tptz__RelativeMove->Translation->PanTilt->y) != PTZD_NOT_RUNNING)) {
+        return SOAP_OK;
+    }
+
     if (tptz__RelativeMove->Translation->PanTilt->x > 0) {
-        system(ctx->get_ptz_node()->get_move_right().c_str());
+        ptz_move(ctx, ACTION_RIGHT);
         usleep(300000);
-        system(ctx->get_ptz_node()->get_move_stop().c_str());
+        ptz_move(ctx, ACTION_STOP);
     } else if (tptz__RelativeMove->Translation->PanTilt->x < 0) {
-        system(ctx->get_ptz_node()->get_move_left().c_str());
+        ptz_move(ctx, ACTION_LEFT);
         usleep(300000);
-        system(ctx->get_ptz_node()->get_move_stop().c_str());
+        ptz_move(ctx, ACTION_STOP);
     }
     if (tptz__RelativeMove->Translation->PanTilt->y > 0) {
-        system(ctx->get_ptz_node()->get_move_up().c_str());
+        ptz_move(ctx, ACTION_UP);
         usleep(300000);
-        system(ctx->get_ptz_node()->get_move_stop().c_str());
+        ptz_move(ctx, ACTION_STOP);
     } else if (tptz__RelativeMove->Translation->PanTilt->y < 0) {
-        system(ctx->get_ptz_node()->get_move_down().c_str());
+        ptz_move(ctx, ACTION_DOWN);
         usleep(300000);
-        system(ctx->get_ptz_node()->get_move_stop().c_str());
+        ptz_move(ctx, ACTION_STOP);
     }
 
     return SOAP_OK;
@@ -507,7 +730,32 @@ int PTZBindingService::SendAuxiliaryCommand(_tptz__SendAuxiliaryCommand *tptz__S
 
 int PTZBindingService::AbsoluteMove(_tptz__AbsoluteMove *tptz__AbsoluteMove, _tptz__AbsoluteMoveResponse &tptz__AbsoluteMoveResponse)
 {
-    SOAP_EMPTY_HANDLER(tptz__AbsoluteMove, "PTZ");
+    UNUSED(tptz__AbsoluteMoveResponse);
+    DEBUG_MSG("PTZ: %s\n", __FUNCTION__);
+
+
+    ServiceContext* ctx = (ServiceContext*)this->soap->user;
+    bool reverse = ctx->get_ptz_node()->reverse;
+
+    if (tptz__AbsoluteMove == NULL) {
+        return SOAP_OK;
+    }
+    if (tptz__AbsoluteMove->Position == NULL) {
+        return SOAP_OK;
+    }
+    if (tptz__AbsoluteMove->Position->PanTilt == NULL) {
+        return SOAP_OK;
+    }
+
+    // The processes can't move to a position
+    if (!ctx->get_ptz_node()->native) {
+        return SOAP_OK;
+    }
+
+    ptzd_client_go(space_to_pos(tptz__AbsoluteMove->Position->PanTilt->x, MIN_X, MAX_X, reverse),
+                   space_to_pos(tptz__AbsoluteMove->Position->PanTilt->y, MIN_Y, MAX_Y, reverse), 0);
+
+    return SOAP_OK;
 }
 
 
@@ -520,7 +768,7 @@ int PTZBindingService::Stop(_tptz__Stop *tptz__Stop, _tptz__StopResponse &tptz__
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
 
-    system(ctx->get_ptz_node()->get_move_stop().c_str());
+    ptz_move(ctx, ACTION_STOP);
 
     return SOAP_OK;
 }
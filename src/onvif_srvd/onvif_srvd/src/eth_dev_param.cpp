@@ -158,10 +158,12 @@ int Eth_Dev_Param::get_ip(char *IP) const
         return -1;
 
 
-    if( ioctl(_sd, SIOCGIFADDR, &_ifr) != 0 )
+    struct ifreq ifr = _ifr; // _ifr is shared by the threads
+
+    if( ioctl(_sd, SIOCGIFADDR, &ifr) != 0 )
         return -1;
 
-    struct sockaddr_in* addr = (struct sockaddr_in*)&_ifr.ifr_addr;
+    struct sockaddr_in* addr = (struct sockaddr_in*)&ifr.ifr_addr;
 
 
     if( inet_ntop(AF_INET, &addr->sin_addr, IP, INET_ADDRSTRLEN) != NULL )
@@ -179,10 +181,12 @@ int Eth_Dev_Param::get_ip(uint32_t *IP) const
         return -1;
 
 
-    if( ioctl(_sd, SIOCGIFDSTADDR, &_ifr) != 0 )
+    struct ifreq ifr = _ifr; // _ifr is shared by the threads
+
+    if( ioctl(_sd, SIOCGIFDSTADDR, &ifr) != 0 )
         return -1;
 
-    struct sockaddr_in* addr = (struct sockaddr_in*)&_ifr.ifr_addr;
+    struct sockaddr_in* addr = (struct sockaddr_in*)&ifr.ifr_addr;
 
     *IP = addr->sin_addr.s_addr;
 
@@ -236,10 +240,12 @@ int Eth_Dev_Param::get_mask(char *mask) const
         return -1;
 
 
-    if( ioctl(_sd, SIOCGIFNETMASK, &_ifr) != 0 )
+    struct ifreq ifr = _ifr; // _ifr is shared by the threads
+
+    if( ioctl(_sd, SIOCGIFNETMASK, &ifr) != 0 )
         return -1;
 
-    struct sockaddr_in* addr = (struct sockaddr_in*)&_ifr.ifr_addr;
+    struct sockaddr_in* addr = (struct sockaddr_in*)&ifr.ifr_addr;
 
 
     if( inet_ntop(AF_INET, &addr->sin_addr, mask, INET_ADDRSTRLEN) != NULL )
@@ -257,10 +263,12 @@ int Eth_Dev_Param::get_mask(uint32_t *mask) const
         return -1;
 
 
-    if( ioctl(_sd, SIOCGIFNETMASK, &_ifr) != 0 )
+    struct ifreq ifr = _ifr; // _ifr is shared by the threads
+
+    if( ioctl(_sd, SIOCGIFNETMASK, &ifr) != 0 )
         return -1;
 
-    struct sockaddr_in* addr = (struct sockaddr_in*)&_ifr.ifr_addr;
+    struct sockaddr_in* addr = (struct sockaddr_in*)&ifr.ifr_addr;
 
     *mask = addr->sin_addr.s_addr;
 
@@ -456,15 +464,17 @@ int Eth_Dev_Param::get_hwaddr(char *hwaddr) const
         return -1;
 
 
-    if( ioctl(_sd, SIOCGIFHWADDR, &_ifr) != 0 )
+    struct ifreq ifr = _ifr; // _ifr is shared by the threads
+
+    if( ioctl(_sd, SIOCGIFHWADDR, &ifr) != 0 )
         return -1;
 
 
-    if( _ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER )
+    if( ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER )
         return -1;
 
 
-    uint8_t *tmp_mac = (uint8_t *)_ifr.ifr_hwaddr.sa_data;
+    uint8_t *tmp_mac = (uint8_t *)ifr.ifr_hwaddr.sa_data;
 
 
     sprintf(hwaddr, "%02x:%02x:%02x:%02x:%02x:%02x",
@@ -482,15 +492,17 @@ int Eth_Dev_Param::get_hwaddr(uint8_t *hwaddr) const
         return -1;
 
 
-    if( ioctl(_sd, SIOCGIFHWADDR, &_ifr) != 0 )
+    struct ifreq ifr = _ifr; // _ifr is shared by the threads
+
+    if( ioctl(_sd, SIOCGIFHWADDR, &ifr) != 0 )
         return -1;
 
 
-    if( _ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER )
+    if( ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER )
         return -1;
 
 
-    memcpy(hwaddr, _ifr.ifr_hwaddr.sa_data, 6);
+    memcpy(hwaddr, ifr.ifr_hwaddr.sa_data, 6);
 
 
     return 0; //good job
@@ -7,11 +7,13 @@
 #include <string.h>
 #include <signal.h>
 #include <getopt.h>
+#include <pthread.h>
 
 
 #include "daemon.h"
 #include "smacros.h"
 #include "ServiceContext.h"
+#include "ptzd_client.h"
 
 // ---- gsoap ----
 #include "DeviceBinding.nsmap"
@@ -42,6 +44,8 @@ static const char *help_str =
         "       --pid_file     [value] Set pid file name\n"
         "       --log_file     [value] Set log file name\n\n"
         "       --port         [value] Set socket port for Services   (default = 1000)\n"
+        "       --threads      [value] Set number of serving threads  (default = 4, max = 16)\n"
+        "       --no_cache             Don't cache the responses (see tools/onvif_cache_check.py)\n"
         "       --user         [value] Set user name for Services     (default = admin)\n"
         "       --password     [value] Set user password for Services (default = admin)\n"
         "       --model        [value] Set model device for Services  (default = Model)\n"
@@ -67,6 +71,9 @@ static const char *help_str =
         "       --move_stop    [value] Set process to call for PTZ stop movement\n"
         "       --move_preset  [value] Set process to call for PTZ goto preset movement\n"
         "       --set_preset   [value] Set process to call for PTZ set preset\n"
+        "       --ptz_socket   [value] Set socket of ptzd and send it the PTZ commands instead of\n"
+        "                              calling the processes, they are used if ptzd is not running\n"
+        "       --ptz_reverse          Swap the directions of ptzd (rotated image)\n"
         "  -v,  --version              Display daemon version\n"
         "  -h,  --help                 Display this help\n\n";
 
@@ -91,6 +98,8 @@ namespace LongOpts
 
         //ONVIF Service options (context)
         port,
+        threads,
+        no_cache,
         user,
         password,
         manufacturer,
@@ -117,7 +126,9 @@ namespace LongOpts
         move_down,
         move_stop,
         move_preset,
-        set_preset
+        set_preset,
+        ptz_socket,
+        ptz_reverse
     };
 }
 
@@ -141,6 +152,8 @@ static const struct option long_opts[] =
 
     //ONVIF Service options (context)
     { "port",         required_argument, NULL, LongOpts::port          },
+    { "threads",      required_argument, NULL, LongOpts::threads       },
+    { "no_cache",     no_argument,       NULL, LongOpts::no_cache      },
     { "user",         required_argument, NULL, LongOpts::user          },
     { "password",     required_argument, NULL, LongOpts::password      },
     { "manufacturer", required_argument, NULL, LongOpts::manufacturer  },
@@ -168,6 +181,8 @@ static const struct option long_opts[] =
     { "move_stop",     required_argument, NULL, LongOpts::move_stop    },
     { "move_preset",   required_argument, NULL, LongOpts::move_preset  },
     { "set_preset",    required_argument, NULL, LongOpts::set_preset   },
+    { "ptz_socket",    required_argument, NULL, LongOpts::ptz_socket   },
+    { "ptz_reverse",   no_argument,       NULL, LongOpts::ptz_reverse  },
 
     { NULL,           no_argument,       NULL,  0                      }
 };
@@ -207,19 +222,49 @@ static const struct option long_opts[] =
 
 #define DECLARE_SERVICE(service, soap) service service ## _inst(soap);
 
+// SOAP_STOP - the operation has sent the response itself (see soap_send_xml)
 #define DISPATCH_SERVICE(service, soap)                                  \
                 else if (service ## _inst.dispatch() != SOAP_NO_METHOD) {\
                     soap_send_fault(soap);                               \
-                    soap_stream_fault(soap, std::cerr);                  \
+                    if (soap->error != SOAP_STOP)                        \
+                        soap_stream_fault(soap, std::cerr);              \
                 }
 
 
 
 
+#define DEFAULT_THREADS    4
+#define MAX_THREADS        16
+#define QUEUE_SIZE         16        // accepted connections waiting for a thread
+#define THREAD_STACK_SIZE  (256*1024)
+#define MAX_KEEP_ALIVE     20        // requests per connection, then it is closed to free the thread
+
+
+
 static struct soap *soap;
 
 ServiceContext service_ctx;
 
+static int threads_num = DEFAULT_THREADS;
+
+
+
+// Accepted connections, the main thread only accepts and
+// the serving threads take them from this queue
+struct Connection
+{
+    SOAP_SOCKET   socket;
+    unsigned long ip;
+    int           port;
+};
+
+static Connection      conn_queue[QUEUE_SIZE];
+static int             conn_head  = 0;
+static int             conn_count = 0;
+static pthread_mutex_t conn_mutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  conn_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  conn_not_full  = PTHREAD_COND_INITIALIZER;
+
 
 
 
@@ -315,6 +360,14 @@ void processing_cmd(int argc, char *argv[])
                         service_ctx.port = atoi(optarg);
                         break;
 
+            case LongOpts::threads:
+                        threads_num = atoi(optarg);
+                        break;
+
+            case LongOpts::no_cache:
+                        service_ctx.cache = false;
+                        break;
+
             case LongOpts::user:
                         service_ctx.user = optarg;
                         break;
@@ -459,6 +512,18 @@ void processing_cmd(int argc, char *argv[])
                         break;
 
 
+            case LongOpts::ptz_socket:
+                        if( !service_ctx.get_ptz_node()->set_ptz_socket(optarg) )
+                            daemon_error_exit("Can't set socket of ptzd: %s\n", service_ctx.get_ptz_node()->get_cstr_err());
+
+                        break;
+
+
+            case LongOpts::ptz_reverse:
+                        service_ctx.get_ptz_node()->reverse = true;
+                        break;
+
+
             default:
                         puts("for more detail see help\n\n");
                         exit_if_not_daemonized(EXIT_FAILURE);
@@ -531,6 +596,12 @@ void processing_conf_file()
         //ONVIF Service options (context)
         } else if (param == "port") {
             service_ctx.port = atoi(value.c_str());
+        } else if (param == "threads") {
+            threads_num = atoi(value.c_str());
+        } else if (param == "no_cache") {
+            if (value == "1") {
+                service_ctx.cache = false;
+            }
         } else if (param == "user") {
             service_ctx.user = value;
         } else if (param == "password") {
@@ -601,6 +672,11 @@ void processing_conf_file()
         } else if (param == "set_preset") {
             if( !service_ctx.get_ptz_node()->set_set_preset(value.c_str()) )
                 daemon_error_exit("Can't set process for set preset movement: %s\n", service_ctx.get_ptz_node()->get_cstr_err());
+        } else if (param == "ptz_socket") {
+            if( !service_ctx.get_ptz_node()->set_ptz_socket(value.c_str()) )
+                daemon_error_exit("Can't set socket of ptzd: %s\n", service_ctx.get_ptz_node()->get_cstr_err());
+        } else if (param == "ptz_reverse") {
+            service_ctx.get_ptz_node()->reverse = true;
         } else {
             daemon_error_exit("Unrecognized option: %s\n", line.c_str());
         }
@@ -621,13 +697,17 @@ void check_service_ctx(void)
 
     if(service_ctx.get_profiles().empty())
         daemon_error_exit("Error: not set no one profile more details see --help\n");
+
+
+    if( (threads_num < 1) || (threads_num > MAX_THREADS) )
+        daemon_error_exit("Error: threads number is bad, correct range: 1-%d\n", MAX_THREADS);
 }
 
 
 
 void init_gsoap(void)
 {
-    soap = soap_new();
+    soap = soap_new1(SOAP_IO_KEEPALIVE);
 
     if(!soap)
         daemon_error_exit("Can't get mem for SOAP\n");
@@ -644,6 +724,8 @@ void init_gsoap(void)
     soap->send_timeout = 3; // timeout in sec
     soap->recv_timeout = 3; // timeout in sec
 
+    soap->max_keep_alive = MAX_KEEP_ALIVE;
+
 
     //save pointer of service_ctx in soap
     soap->user = (void*)&service_ctx;
@@ -651,16 +733,149 @@ void init_gsoap(void)
 
 
 
+void init_ptz(void)
+{
+    PTZNode *ptz_node = service_ctx.get_ptz_node();
+
+    // ptzd owns the device and the presets, when it is not running the
+    // processes (move_left, ...) are used
+    if( ptz_node->enable && !ptz_node->get_ptz_socket().empty() )
+    {
+        ptzd_client_init(ptz_node->get_ptz_socket().c_str());
+        ptz_node->native = true;
+    }
+}
+
+
+
 void init(void *data)
 {
     UNUSED(data);
     init_signals();
     check_service_ctx();
+    init_ptz();
     init_gsoap();
 }
 
 
 
+void push_connection(SOAP_SOCKET socket, unsigned long ip, int port)
+{
+    pthread_mutex_lock(&conn_mutex);
+
+    // all threads are busy, the next clients wait in the listen backlog
+    while( conn_count == QUEUE_SIZE )
+        pthread_cond_wait(&conn_not_full, &conn_mutex);
+
+    Connection &conn = conn_queue[(conn_head + conn_count) % QUEUE_SIZE];
+    conn.socket = socket;
+    conn.ip     = ip;
+    conn.port   = port;
+    conn_count++;
+
+    pthread_cond_signal(&conn_not_empty);
+    pthread_mutex_unlock(&conn_mutex);
+}
+
+
+
+Connection pop_connection(void)
+{
+    pthread_mutex_lock(&conn_mutex);
+
+    while( conn_count == 0 )
+        pthread_cond_wait(&conn_not_empty, &conn_mutex);
+
+    Connection conn = conn_queue[conn_head];
+    conn_head = (conn_head + 1) % QUEUE_SIZE;
+    conn_count--;
+
+    pthread_cond_signal(&conn_not_full);
+    pthread_mutex_unlock(&conn_mutex);
+
+    return conn;
+}
+
+
+
+void* serve_thread(void *data)
+{
+    // every thread has its own copy of the soap context and its own services,
+    // service_ctx is shared and only read after init
+    struct soap *tsoap = (struct soap *)data;
+
+    FOREACH_SERVICE(DECLARE_SERVICE, tsoap)
+
+    while( true )
+    {
+        Connection conn = pop_connection();
+
+        tsoap->socket = conn.socket;
+        tsoap->ip     = conn.ip;
+        tsoap->port   = conn.port;
+
+
+        // serve the requests while the client keeps the connection alive,
+        // but not more than max_keep_alive (like soap_serve does)
+        tsoap->keep_alive = tsoap->max_keep_alive + 1;
+
+        do
+        {
+            if( tsoap->keep_alive > 0 )
+                tsoap->keep_alive--;
+
+            // process service
+            if( soap_begin_serve(tsoap) )
+            {
+                if( tsoap->error != SOAP_EOF ) // EOF: the client has closed the connection
+                    soap_stream_fault(tsoap, std::cerr);
+
+                tsoap->keep_alive = 0;
+            }
+            FOREACH_SERVICE(DISPATCH_SERVICE, tsoap)
+            else
+            {
+                DEBUG_MSG("Unknown service\n");
+            }
+
+            soap_destroy(tsoap); // delete managed C++ objects
+            soap_end(tsoap);     // delete managed memory
+
+        } while( tsoap->keep_alive && soap_valid_socket(tsoap->socket) );
+
+        soap_force_closesock(tsoap);
+    }
+
+    return NULL;
+}
+
+
+
+void start_threads(void)
+{
+    pthread_t      thread;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, THREAD_STACK_SIZE);
+
+    for(int i = 0; i < threads_num; i++)
+    {
+        struct soap *tsoap = soap_copy(soap);
+
+        if(!tsoap)
+            daemon_error_exit("Can't get mem for SOAP\n");
+
+        if( pthread_create(&thread, &attr, serve_thread, tsoap) != 0 )
+            daemon_error_exit("Can't create serving thread: %m\n");
+    }
+
+    pthread_attr_destroy(&attr);
+}
+
+
+
 int main(int argc, char *argv[])
 {
     processing_cmd(argc, argv);
@@ -668,7 +883,7 @@ int main(int argc, char *argv[])
         processing_conf_file();
     daemonize2(init, NULL);
 
-    FOREACH_SERVICE(DECLARE_SERVICE, soap)
+    start_threads();
 
     while( true )
     {
@@ -680,19 +895,9 @@ int main(int argc, char *argv[])
         }
 
 
-        // process service
-        if( soap_begin_serve(soap) )
-        {
-            soap_stream_fault(soap, std::cerr);
-        }
-        FOREACH_SERVICE(DISPATCH_SERVICE, soap)
-        else
-        {
-            DEBUG_MSG("Unknown service\n");
-        }
-
-        soap_destroy(soap); // delete managed C++ objects
-        soap_end(soap);     // delete managed memory
+        // a serving thread owns the socket from now on
+        push_connection(soap->socket, soap->ip, soap->port);
+        soap->socket = SOAP_INVALID_SOCKET;
     }
 
 
@@ -3,6 +3,8 @@
 
 #include <memory>
 #include <limits>
+#include <string>
+#include <sstream>
 
 #include "soapH.h"
 
@@ -21,6 +23,99 @@ T* soap_new_ptr(struct soap* soap, T value)
 
 
 
+/*
+ * Serialize the response of the service operation into the string xml,
+ * only the content of the SOAP Body: the result must not depend on the
+ * request, it can be sent again with soap_send_xml().
+ * It runs on a temporary context with the output options and namespaces
+ * of soap, so the state of the request being served is not touched.
+ */
+template<typename T>
+int soap_response_to_xml(struct soap* soap, T& response, const char *tag, std::string& xml)
+{
+    std::ostringstream os;
+    struct soap*       tmp;
+    int                err;
+
+    // Only the formatting options, the output goes to os
+    tmp = soap_new1(soap->omode & ~(SOAP_IO | SOAP_IO_UDP | SOAP_ENC_ZLIB |
+                                    SOAP_ENC_DIME | SOAP_ENC_MIME | SOAP_ENC_MTOM));
+    if( !tmp )
+        return soap->error = SOAP_EOM;
+
+    soap_set_namespaces(tmp, soap->namespaces);
+    tmp->version       = soap->version;
+    tmp->encodingStyle = NULL;
+    tmp->os            = &os;
+
+    response.soap_serialize(tmp);
+
+    err = soap_begin_send(tmp);
+    if( !err )
+    {
+        // Inside Envelope and Body, their namespaces are declared by the
+        // Envelope of soap_send_xml()
+        tmp->level = 2;
+        tmp->ns    = 1;
+        if( response.soap_put(tmp, tag, "") || soap_end_send(tmp) )
+            err = tmp->error;
+    }
+
+    soap_destroy(tmp);
+    soap_end(tmp);
+    soap_free(tmp);
+
+    if( err )
+        return soap->error = err;
+
+    xml = os.str();
+
+    return SOAP_OK;
+}
+
+
+
+/*
+ * Send the Body saved by soap_response_to_xml() as the response of the
+ * current request, with the same steps of the generated dispatch code:
+ * the header of the request is echoed as for the other operations.
+ * Returns SOAP_STOP, so the dispatch code does not serialize the response.
+ */
+inline int soap_send_xml(struct soap* soap, const std::string& xml)
+{
+    soap->encodingStyle = NULL;
+    soap_serializeheader(soap);
+
+    if( soap_begin_count(soap) )
+        return soap->error;
+
+    if( soap->mode & SOAP_IO_LENGTH )
+    {
+        if( soap_envelope_begin_out(soap)
+         || soap_putheader(soap)
+         || soap_body_begin_out(soap)
+         || soap_send_raw(soap, xml.data(), xml.size())
+         || soap_body_end_out(soap)
+         || soap_envelope_end_out(soap) )
+            return soap->error;
+    }
+
+    if( soap_end_count(soap)
+     || soap_response(soap, SOAP_OK)
+     || soap_envelope_begin_out(soap)
+     || soap_putheader(soap)
+     || soap_body_begin_out(soap)
+     || soap_send_raw(soap, xml.data(), xml.size())
+     || soap_body_end_out(soap)
+     || soap_envelope_end_out(soap)
+     || soap_end_send(soap) )
+        return soap->error;
+
+    return SOAP_STOP;
+}
+
+
+
 
 
 #endif // STOOLS_H
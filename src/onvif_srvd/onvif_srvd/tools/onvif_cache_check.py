@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# Check that the cached responses of onvif_srvd are the same, byte for
+# byte, as the ones sent by the generated code without the cache.
+#
+# Usage: onvif_cache_check.py [options] -- DAEMON_COMMAND...
+#
+# The daemon command must keep the daemon in the foreground (--no_fork) and
+# listen on --port (default 1000). It is started once with --no_cache and
+# every cached operation is sent as SOAP 1.1 and as SOAP 1.2, then it is
+# started again with the cache and every request is sent twice: the first
+# reply fills the cache, the second comes from it. Both must match the reply
+# without the cache, HTTP status, Content-Type and body.
+# The requests have a fixed wsa:MessageID, so the echoed header is the same.
+# The exit code is 1 if a reply differs.
+#
+
+import argparse
+import http.client
+import socket
+import subprocess
+import sys
+import time
+
+# The operations that go through ServiceContext::find_response()/add_response()
+OPERATIONS = [
+    ("GetServices",              "/onvif/device_service", "tds", "http://www.onvif.org/ver10/device/wsdl",
+     "<tds:GetServices><tds:IncludeCapability>false</tds:IncludeCapability></tds:GetServices>"),
+    ("GetServices+caps",         "/onvif/device_service", "tds", "http://www.onvif.org/ver10/device/wsdl",
+     "<tds:GetServices><tds:IncludeCapability>true</tds:IncludeCapability></tds:GetServices>"),
+    ("GetServiceCapabilities",   "/onvif/device_service", "tds", "http://www.onvif.org/ver10/device/wsdl",
+     "<tds:GetServiceCapabilities/>"),
+    ("GetDeviceInformation",     "/onvif/device_service", "tds", "http://www.onvif.org/ver10/device/wsdl",
+     "<tds:GetDeviceInformation/>"),
+    ("GetScopes",                "/onvif/device_service", "tds", "http://www.onvif.org/ver10/device/wsdl",
+     "<tds:GetScopes/>"),
+    ("GetCapabilities",          "/onvif/device_service", "tds", "http://www.onvif.org/ver10/device/wsdl",
+     "<tds:GetCapabilities><tds:Category>All</tds:Category></tds:GetCapabilities>"),
+    ("Media GetServiceCapabilities", "/onvif/media_service", "trt", "http://www.onvif.org/ver10/media/wsdl",
+     "<trt:GetServiceCapabilities/>"),
+    ("GetVideoSources",          "/onvif/media_service", "trt", "http://www.onvif.org/ver10/media/wsdl",
+     "<trt:GetVideoSources/>"),
+    ("GetProfiles",              "/onvif/media_service", "trt", "http://www.onvif.org/ver10/media/wsdl",
+     "<trt:GetProfiles/>"),
+]
+
+SOAP_VERSIONS = {
+    "1.1": ("http://schemas.xmlsoap.org/soap/envelope/", "text/xml; charset=utf-8"),
+    "1.2": ("http://www.w3.org/2003/05/soap-envelope", "application/soap+xml; charset=utf-8"),
+}
+
+ENVELOPE = ('<?xml version="1.0" encoding="UTF-8"?>'
+            '<s:Envelope xmlns:s="%s"'
+            ' xmlns:a="http://www.w3.org/2005/08/addressing" xmlns:%s="%s">'
+            '<s:Header><a:MessageID>urn:uuid:6f0b2c1e-5a4d-4c3b-9e8f-0123456789ab</a:MessageID></s:Header>'
+            '<s:Body>%s</s:Body></s:Envelope>')
+
+def request(args, op, version):
+    name, path, prefix, ns, body = op
+    env_ns, content_type = SOAP_VERSIONS[version]
+    headers = {"Content-Type": content_type, "Connection": "close"}
+    if version == "1.1":
+        headers["SOAPAction"] = '""'
+    conn = http.client.HTTPConnection("127.0.0.1", args.port, timeout=args.timeout)
+    try:
+        conn.request("POST", path, (ENVELOPE % (env_ns, prefix, ns, body)).encode(), headers)
+        resp = conn.getresponse()
+        return (resp.status, resp.getheader("Content-Type"), resp.read())
+    finally:
+        conn.close()
+
+def start(args, extra):
+    daemon = subprocess.Popen(args.command + extra)
+    deadline = time.monotonic() + args.timeout
+    while time.monotonic() < deadline:
+        if daemon.poll() is not None:
+            sys.exit("the daemon exited with %d" % daemon.returncode)
+        try:
+            socket.create_connection(("127.0.0.1", args.port), 0.5).close()
+            return daemon
+        except OSError:
+            time.sleep(0.1)
+    daemon.kill()
+    sys.exit("the daemon doesn't listen on port %d" % args.port)
+
+def stop(daemon):
+    daemon.terminate()
+    try:
+        daemon.wait(5)
+    except subprocess.TimeoutExpired:
+        daemon.kill()
+        daemon.wait()
+
+def first_difference(a, b):
+    for i, (x, y) in enumerate(zip(a, b)):
+        if x != y:
+            return i
+    return min(len(a), len(b))
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare the cached responses of onvif_srvd with the uncached ones")
+    parser.add_argument("--port", type=int, default=1000, help="port of the daemon (default 1000)")
+    parser.add_argument("--timeout", type=float, default=10.0, help="socket and start timeout in s")
+    parser.add_argument("command", nargs="+", help="daemon command, after --")
+    args = parser.parse_args()
+
+    daemon = start(args, ["--no_cache"])
+    try:
+        expected = {(op[0], v): request(args, op, v) for op in OPERATIONS for v in SOAP_VERSIONS}
+    finally:
+        stop(daemon)
+
+    failures = 0
+    daemon = start(args, [])
+    try:
+        for op in OPERATIONS:
+            for version in SOAP_VERSIONS:
+                ref = expected[(op[0], version)]
+                for attempt in ("first", "cached"):
+                    reply = request(args, op, version)
+                    if reply == ref:
+                        continue
+                    failures += 1
+                    print("%s SOAP %s %s reply: status %d/%d, Content-Type %s/%s, body differs at byte %d"
+                          % (op[0], version, attempt, reply[0], ref[0], reply[1], ref[1],
+                             first_difference(reply[2], ref[2])))
+                    print("  cached:   %r" % reply[2][:600])
+                    print("  uncached: %r" % ref[2][:600])
+                if ref[0] != 200:
+                    print("%s SOAP %s: status %d without the cache" % (op[0], version, ref[0]))
+    finally:
+        stop(daemon)
+
+    print("%d operations, SOAP 1.1 and 1.2: %d differences" % (len(OPERATIONS), failures))
+
+    return 1 if failures else 0
+
+if __name__ == "__main__":
+    raise SystemExit(main())
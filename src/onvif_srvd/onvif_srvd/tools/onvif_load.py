@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+#
+# Load test of onvif_srvd: N clients send the same ONVIF request in a loop
+# and the latency of every request is collected.
+#
+# Usage: onvif_load.py [options] HOST:PORT
+#
+# By default it runs GetProfiles with 1, 4 and 16 clients, 200 requests
+# per client, a new connection per request, and prints p50/p99 for each
+# run. With --keep-alive every client keeps its connection open (the
+# daemon closes it after MAX_KEEP_ALIVE requests, the client reconnects).
+# GetStreamUri and GetSnapshotUri need a ProfileToken: it is taken from
+# the first profile of a GetProfiles reply, unless --profile is given.
+# A request fails if the status is not 200 or the reply doesn't contain
+# the response element; with --check-header the reply must also echo the
+# wsa:MessageID of the request in its Header.
+# The exit code is 1 if a request fails.
+#
+
+import argparse
+import http.client
+import re
+import threading
+import time
+import uuid
+
+OPERATIONS = {
+    "GetDeviceInformation": ("/onvif/device_service", "tds",
+                             "http://www.onvif.org/ver10/device/wsdl",
+                             "<tds:GetDeviceInformation/>"),
+    "GetCapabilities":      ("/onvif/device_service", "tds",
+                             "http://www.onvif.org/ver10/device/wsdl",
+                             "<tds:GetCapabilities><tds:Category>All</tds:Category></tds:GetCapabilities>"),
+    "GetServices":          ("/onvif/device_service", "tds",
+                             "http://www.onvif.org/ver10/device/wsdl",
+                             "<tds:GetServices><tds:IncludeCapability>false</tds:IncludeCapability></tds:GetServices>"),
+    "GetProfiles":          ("/onvif/media_service", "trt",
+                             "http://www.onvif.org/ver10/media/wsdl",
+                             "<trt:GetProfiles/>"),
+    "GetStreamUri":         ("/onvif/media_service", "trt",
+                             "http://www.onvif.org/ver10/media/wsdl",
+                             "<trt:GetStreamUri><trt:StreamSetup><tt:Stream>RTP-Unicast</tt:Stream>"
+                             "<tt:Transport><tt:Protocol>RTSP</tt:Protocol></tt:Transport></trt:StreamSetup>"
+                             "<trt:ProfileToken>%(token)s</trt:ProfileToken></trt:GetStreamUri>"),
+    "GetSnapshotUri":       ("/onvif/media_service", "trt",
+                             "http://www.onvif.org/ver10/media/wsdl",
+                             "<trt:GetSnapshotUri><trt:ProfileToken>%(token)s</trt:ProfileToken></trt:GetSnapshotUri>"),
+}
+
+ENVELOPE = ('<?xml version="1.0" encoding="UTF-8"?>'
+            '<s:Envelope xmlns:s="http://www.w3.org/2003/05/soap-envelope"'
+            ' xmlns:a="http://www.w3.org/2005/08/addressing"'
+            ' xmlns:tt="http://www.onvif.org/ver10/schema" xmlns:%s="%s">'
+            '<s:Header><a:MessageID>%s</a:MessageID></s:Header>'
+            '<s:Body>%s</s:Body></s:Envelope>')
+
+def make_request(op, token=""):
+    path, prefix, ns, body = OPERATIONS[op]
+    msg_id = "urn:uuid:" + str(uuid.uuid4())
+    body = body % {"token": token}
+    return path, msg_id, (ENVELOPE % (prefix, ns, msg_id, body)).encode()
+
+def get_profile_token(args):
+    path, msg_id, payload = make_request("GetProfiles")
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    try:
+        conn.request("POST", path, payload, {"Content-Type": "application/soap+xml; charset=utf-8",
+                                             "Connection": "close"})
+        resp = conn.getresponse()
+        data = resp.read()
+    except (OSError, http.client.HTTPException) as e:
+        raise SystemExit("GetProfiles failed: %s" % e)
+    finally:
+        conn.close()
+    match = re.search(rb'<(?:[\w.-]+:)?Profiles\b[^>]*?\stoken="([^"]*)"', data)
+    if resp.status != 200 or match is None:
+        raise SystemExit("No profile token in the GetProfiles reply (status %d)" % resp.status)
+    return match.group(1).decode()
+
+def check_reply(op, msg_id, status, data, check_header):
+    if status != 200 or (op + "Response").encode() not in data:
+        return False
+    if check_header and msg_id.encode() not in data.split(b"Body>")[0]:
+        return False
+    return True
+
+def client(args, latency, errors):
+    conn = None
+    for i in range(args.requests):
+        path, msg_id, payload = make_request(args.op, args.profile)
+        headers = {"Content-Type": "application/soap+xml; charset=utf-8"}
+        if not args.keep_alive:
+            headers["Connection"] = "close"
+        t = time.monotonic()
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+            conn.request("POST", path, payload, headers)
+            resp = conn.getresponse()
+            data = resp.read()
+            ok = check_reply(args.op, msg_id, resp.status, data, args.check_header)
+            if not args.keep_alive or resp.will_close:
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException):
+            ok = False
+            if conn is not None:
+                conn.close()
+                conn = None
+        if ok:
+            latency.append((time.monotonic() - t) * 1000.0)
+        else:
+            errors.append(i)
+    if conn is not None:
+        conn.close()
+
+def percentile(values, p):
+    values = sorted(values)
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+def run(args, clients):
+    latency = []
+    errors = []
+    threads = [threading.Thread(target=client, args=(args, latency, errors))
+               for i in range(clients)]
+    t = time.monotonic()
+    for th in threads:
+        th.start()
+    for th in threads:
+        th.join()
+    t = time.monotonic() - t
+
+    line = "%3d clients  %6d requests  %5d errors  %7.1f req/s" % (
+           clients, len(latency) + len(errors), len(errors), len(latency) / t)
+    if latency:
+        line += "  p50 %7.2f ms  p99 %7.2f ms" % (percentile(latency, 50), percentile(latency, 99))
+    print(line, flush=True)
+
+    return len(errors)
+
+def main():
+    parser = argparse.ArgumentParser(description="Load test of onvif_srvd")
+    parser.add_argument("address", help="HOST:PORT of the daemon")
+    parser.add_argument("--op", choices=sorted(OPERATIONS), default="GetProfiles")
+    parser.add_argument("--clients", default="1,4,16",
+                        help="comma separated numbers of clients (default 1,4,16)")
+    parser.add_argument("--requests", type=int, default=200, help="requests per client")
+    parser.add_argument("--keep-alive", action="store_true", help="reuse the connections")
+    parser.add_argument("--check-header", action="store_true",
+                        help="the reply must echo the wsa:MessageID")
+    parser.add_argument("--timeout", type=float, default=10.0, help="socket timeout in s")
+    parser.add_argument("--profile", help="ProfileToken of GetStreamUri and GetSnapshotUri"
+                        " (default the first profile of GetProfiles)")
+    args = parser.parse_args()
+
+    args.host, _, port = args.address.rpartition(":")
+    args.port = int(port)
+    if args.profile is None and "%(token)s" in OPERATIONS[args.op][3]:
+        args.profile = get_profile_token(args)
+
+    print("%s %s%s, %d requests per client, %s" % (args.address, args.op,
+          " (profile %s)" % args.profile if args.profile else "", args.requests,
+          "keep-alive" if args.keep_alive else "one connection per request"))
+    errors = 0
+    for clients in [int(c) for c in args.clients.split(",")]:
+        errors += run(args, clients)
+
+    return 1 if errors else 0
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -20,6 +20,17 @@ void stop_config()
         fclose(fp);
 }
 
+// Write the buffered data and wait until it is on the storage
+int config_sync()
+{
+    if (fp == NULL)
+        return -1;
+    if ((fflush(fp) != 0) || (fsync(fileno(fp)) != 0))
+        return -1;
+
+    return 0;
+}
+
 void config_set_handler(void (*f)(char* key, char* value))
 {
     if (f != NULL)
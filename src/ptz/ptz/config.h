@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 #include "ptz.h"
 
 #define MAX_LINE_LENGTH     512
@@ -12,6 +13,7 @@
 
 int init_config(const char* config_filename, char *mode);
 void stop_config();
+int config_sync();
 
 void config_save(struct preset pr[], int size);
 
@@ -30,13 +30,29 @@
 
 #define DEVICE "/dev/ptz"
 
+// The device stays open, a daemon calls these functions for every move
+static int fd_driver = -1;
+
+static int open_driver() {
+    if (fd_driver == -1) {
+        fd_driver = open(DEVICE, O_RDWR);
+        if (fd_driver == -1) {
+            printf("ERROR: could not open \"%s\".\n", DEVICE);
+            printf("    errno = %s\n", strerror(errno));
+        }
+    }
+    return fd_driver;
+}
+
+// Reopen the device at the next call after an error
+static void reset_driver() {
+    close(fd_driver);
+    fd_driver = -1;
+}
 
 int hw_ptz_sendptz(int *ptz_arg) {
     int error = 0;
-    int fd_driver = open(DEVICE, O_RDWR);
-    if (fd_driver == -1) {
-        printf("ERROR: could not open \"%s\".\n", DEVICE);
-        printf("    errno = %s\n", strerror(errno));
+    if (open_driver() == -1) {
         return -1;
     }
     unsigned int value=0x1;
@@ -73,8 +89,8 @@ int hw_ptz_sendptz(int *ptz_arg) {
 			error = 1;
         }
     }
-    close(fd_driver);
     if (error) {
+        reset_driver();
         return -1;
     }
     return 0;
@@ -82,10 +98,7 @@ int hw_ptz_sendptz(int *ptz_arg) {
 
 int hw_ptz_pos_read(int arg1, int *buffer, int arg3, int arg4) {
     int error = 0;
-    int fd_driver = open(DEVICE, O_RDWR);
-    if (fd_driver == -1) {
-        printf("ERROR: could not open \"%s\".\n", DEVICE);
-        printf("    errno = %s\n", strerror(errno));
+    if (open_driver() == -1) {
         return -1;
     }
     if (read(fd_driver, (char *)buffer, 40) < 0) {
@@ -93,8 +106,8 @@ int hw_ptz_pos_read(int arg1, int *buffer, int arg3, int arg4) {
         printf("    errno = %s\n", strerror(errno));
         error = 1;
     }
-    close(fd_driver);
     if (error) {
+        reset_driver();
         return -1;
     }
     return 0;
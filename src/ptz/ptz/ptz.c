@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include "ptz.h"
+#include "ptzd_client.h"
 #include "config.h"
 #include "libptz.h"
 
@@ -37,9 +38,10 @@ void print_usage(char *progname)
     fprintf(stderr, "\nUsage: %s OPTIONS\n\n", progname);
     fprintf(stderr, "\t-a ACTION, --action ACTION\n");
     fprintf(stderr, "\t\tset PTZ action: stop, right, left, down, up, go, go_preset, set_preset, get_coord\n");
+    fprintf(stderr, "\t\twatch (print the position when it changes, needs ptzd)\n");
     fprintf(stderr, "\t-t TIME, --time TIME\n");
     fprintf(stderr, "\t\tset action duration in milliseconds (right, left, down and up)\n");
-    fprintf(stderr, "\t\tdefault 500\n");
+    fprintf(stderr, "\t\tdefault 500, with ptzd 0 keeps moving until the next action\n");
     fprintf(stderr, "\t-x X, --x X\n");
     fprintf(stderr, "\t\tset X coordinate when using GO action\n");
     fprintf(stderr, "\t-y Y, --y Y\n");
@@ -57,6 +59,7 @@ void print_usage(char *progname)
     fprintf(stderr, "\t\tset description (used with SET_PRESET action)\n");
     fprintf(stderr, "\t-f PRESET_FILE, --file PRESET_FILE\n");
     fprintf(stderr, "\t\tset preset configuration file (GO_PRESET and SET_PRESET actions)\n");
+    fprintf(stderr, "\t\tignored if ptzd is running, it uses its own\n");
     fprintf(stderr, "\t-d, --debug\n");
     fprintf(stderr, "\t\tenable debug\n");
     fprintf(stderr, "\t-h, --help\n");
@@ -153,6 +156,89 @@ int ptz_save_config(char *filename)
     return 0;
 }
 
+// Send the action to ptzd and print the result like the code below does
+int ptzd_run(int fd, int action, int time, int x, int y, int preset_num, int clear, char *desc)
+{
+    char request[MAXLINE + 256];
+    char reply[MAXLINE];
+
+    switch (action) {
+        case ACTION_STOP:
+            sprintf(request, "stop\n");
+            break;
+        case ACTION_RIGHT:
+            sprintf(request, "right %d\n", time);
+            break;
+        case ACTION_LEFT:
+            sprintf(request, "left %d\n", time);
+            break;
+        case ACTION_DOWN:
+            sprintf(request, "down %d\n", time);
+            break;
+        case ACTION_UP:
+            sprintf(request, "up %d\n", time);
+            break;
+        case ACTION_GO:
+            sprintf(request, "go %d %d\n", x, y);
+            break;
+        case ACTION_GO_PRESET:
+            sprintf(request, "go_preset %d\n", preset_num);
+            break;
+        case ACTION_SET_PRESET:
+            if (clear == 1)
+                sprintf(request, "clear_preset %d\n", preset_num);
+            else
+                sprintf(request, "set_preset %d %s\n", preset_num, desc);
+            break;
+        case ACTION_GET_COORD:
+            sprintf(request, "get_coord\n");
+            break;
+        case ACTION_WATCH:
+            sprintf(request, "watch\n");
+            break;
+        default:
+            return -1;
+    }
+
+    if (debug) fprintf(stderr, "ptzd request: %s", request);
+
+    if ((write(fd, request, strlen(request)) != strlen(request)) ||
+            (ptzd_read_line(fd, reply, sizeof(reply)) < 0)) {
+        fprintf(stderr, "Error talking to ptzd\n");
+        close(fd);
+        return -2;
+    }
+
+    if (debug) fprintf(stderr, "ptzd reply: %s\n", reply);
+
+    if (strncmp(reply, "OK", 2) != 0) {
+        fprintf(stderr, "ptzd: %s\n", reply);
+        if ((action == ACTION_SET_PRESET) && (clear != 1) && (preset_num == -1)) {
+            // Same output of the code below
+            printf("%d\n", -1);
+        }
+        close(fd);
+        return -2;
+    }
+
+    if ((action == ACTION_SET_PRESET) && (clear != 1)) {
+        // Print the number of preset
+        printf("%s\n", reply + 3);
+    } else if (action == ACTION_GET_COORD) {
+        if (sscanf(reply, "OK %d %d", &x, &y) == 2)
+            fprintf(stderr, "Current position: (%d, %d)\n", x, y);
+    } else if (action == ACTION_WATCH) {
+        while (ptzd_read_line(fd, reply, sizeof(reply)) >= 0) {
+            printf("%s\n", reply);
+            fflush(stdout);
+        }
+    }
+
+    close(fd);
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     int action;
@@ -168,6 +254,7 @@ int main(int argc, char **argv)
     int ptz_arg[8];
     int i;
     int preset_buffer[10];
+    int fd;
 
     // Setting default
     action = ACTION_NONE;
@@ -177,6 +264,7 @@ int main(int argc, char **argv)
     preset_file[0] = '\0';
     preset_num = -1;
     clear = 0;
+    desc[0] = '\0';
     debug = 0;
 
     while (1) {
@@ -225,6 +313,8 @@ int main(int argc, char **argv)
                 action = ACTION_GO_PRESET;
             } else if (strcasecmp("get_coord", optarg) == 0) {
                 action = ACTION_GET_COORD;
+            } else if (strcasecmp("watch", optarg) == 0) {
+                action = ACTION_WATCH;
             }
             break;
 
@@ -349,12 +439,6 @@ int main(int argc, char **argv)
         print_usage(argv[0]);
         return -1;
     }
-    if (((action == ACTION_SET_PRESET) || (action == ACTION_GO_PRESET)) &&
-            (preset_file[0] == '\0')) {
-        fprintf(stderr, "preset_file cannot be empty.\n");
-        print_usage(argv[0]);
-        return -1;
-    }
     if ((clear == 1) && (action != ACTION_SET_PRESET)) {
         fprintf(stderr, "clear flag must be used with set_preset action.\n");
         print_usage(argv[0]);
@@ -366,6 +450,22 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    // ptzd keeps the device and the presets loaded, the code below runs only without it
+    fd = ptzd_connect(PTZD_SOCKET);
+    if (fd != -1) {
+        return ptzd_run(fd, action, time, x, y, preset_num, clear, desc);
+    }
+    if (action == ACTION_WATCH) {
+        fprintf(stderr, "watch action needs ptzd.\n");
+        return -1;
+    }
+    if (((action == ACTION_SET_PRESET) || (action == ACTION_GO_PRESET)) &&
+            (preset_file[0] == '\0')) {
+        fprintf(stderr, "preset_file cannot be empty.\n");
+        print_usage(argv[0]);
+        return -1;
+    }
+
     if (action == ACTION_GET_COORD) {
         memset(preset_buffer, '\0', sizeof(preset_buffer));
         if (hw_ptz_pos_read(0, preset_buffer, 0, 0) != 0) {
@@ -33,6 +33,7 @@
 #define ACTION_GO_PRESET       214
 
 #define ACTION_GET_COORD       300
+#define ACTION_WATCH           301
 
 #define DEFAULT_ACTION_TIME    500
 
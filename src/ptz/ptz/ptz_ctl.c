@@ -0,0 +1,585 @@
+/*
+ * PTZ control library: the actions of the ptz command without running it.
+ * The hardware library is loaded once and the presets stay in memory,
+ * so a daemon (ptzd) can move the camera without fork/exec.
+ * All the functions are thread safe.
+ * ptz_ctl_post() queues a command to the ptz_ctl thread and returns at once,
+ * the thread also sends the stop when the time of a move is over.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "ptz_ctl.h"
+#include "config.h"
+
+// Same choice of system.sh between ptz_p (libptz.so) and ptz_h (libhardware.so):
+// libhardware.so only if the firmware has it without libptz.so
+#define FW_LIB_DIR "/mnt/mtd/ipc/app/lib"
+
+static const char *hw_libs[] = {
+    "libptz.so",
+    "libhardware.so",
+    NULL
+};
+
+static const char *hw_libs_h[] = {
+    "libhardware.so",
+    "libptz.so",
+    NULL
+};
+
+static void *hw_lib;
+static int (*hw_sendptz)(int *ptz_arg);
+static int (*hw_pos_read)(int ptz_arg1, int *ptz_arg2, int ptz_arg3, int ptz_arg4);
+
+static pthread_mutex_t ptz_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// State of the motors, updated by send_ptz()
+#define STATE_IDLE    0
+#define STATE_MOVING  1
+#define STATE_GOING   2
+
+static int hw_state = STATE_IDLE;
+static int hw_action = ACTION_STOP;
+static int target_x, target_y;
+static int last_x = -1, last_y = -1;   // last position read and since when (ms)
+static long long last_time;
+
+// A go is over when the position doesn't change for this time (ms)
+#define GO_SETTLE_TIME 200
+
+// Command waiting for the ptz_ctl thread, a new one replaces it
+struct ptz_cmd {
+    int action;
+    int x;
+    int y;
+    int time;
+};
+
+static pthread_t cmd_thread;
+static pthread_mutex_t cmd_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cmd_cond;
+static clockid_t cmd_clock = CLOCK_MONOTONIC;  // clock of the cmd_cond timeouts
+static struct ptz_cmd cmd_next;
+static int cmd_pending;
+static int cmd_thread_started;
+
+static struct preset presets[PRESET_NUM];
+static char presets_file[1024];
+static time_t presets_mtime;
+static off_t presets_size;
+static int presets_loaded;
+
+static void presets_handler(char *key, char *value)
+{
+    struct preset pr;
+    int num;
+
+    num = atoi(key);
+    if ((num < 0) || (num >= PRESET_NUM))
+        return;
+
+    if (sscanf(value, "%255[^|]|%d|%d", pr.desc, &pr.x, &pr.y) != 3) {
+        fprintf(stderr, "Error reading preset %d\n", num);
+        return;
+    }
+
+    presets[num] = pr;
+}
+
+// Load the presets if the file has changed (the web ui and the ptz command write it too)
+static int presets_load()
+{
+    struct stat st;
+    int i;
+
+    if (stat(presets_file, &st) != 0)
+        return -1;
+
+    if (presets_loaded && (st.st_mtime == presets_mtime) && (st.st_size == presets_size))
+        return 0;
+
+    for (i = 0; i < PRESET_NUM; i++) {
+        presets[i].x = -1;
+        presets[i].y = -1;
+        strcpy(presets[i].desc, "empty");
+    }
+
+    if (init_config(presets_file, "r") != 0)
+        return -1;
+
+    config_set_handler(&presets_handler);
+    config_parse();
+    stop_config();
+
+    presets_mtime = st.st_mtime;
+    presets_size = st.st_size;
+    presets_loaded = 1;
+
+    return 0;
+}
+
+// Make the rename of a file in the directory of path durable
+static void sync_dir(const char *path)
+{
+    char dir[sizeof(presets_file)];
+    char *p;
+    int fd;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    p = strrchr(dir, '/');
+    if (p == NULL)
+        strcpy(dir, ".");
+    else if (p == dir)
+        p[1] = '\0';
+    else
+        *p = '\0';
+
+    fd = open(dir, O_RDONLY);
+    if (fd < 0)
+        return;
+    fsync(fd);
+    close(fd);
+}
+
+// Write a temporary file and rename it, the readers never see a half written file.
+// The data is on the sd before the rename, a power cut leaves the old or the new file.
+static int presets_save()
+{
+    char tmp_file[sizeof(presets_file) + 4];
+    struct stat st;
+    int ret;
+
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", presets_file);
+    if (init_config(tmp_file, "w") != 0)
+        return -1;
+
+    config_save(presets, PRESET_NUM);
+    ret = config_sync();
+    stop_config();
+
+    if ((ret != 0) || (rename(tmp_file, presets_file) != 0)) {
+        fprintf(stderr, "Can't write %s: %s\n", presets_file, strerror(errno));
+        unlink(tmp_file);
+        return -1;
+    }
+    sync_dir(presets_file);
+
+    if (stat(presets_file, &st) == 0) {
+        presets_mtime = st.st_mtime;
+        presets_size = st.st_size;
+    }
+
+    return 0;
+}
+
+static int send_ptz(int action, int x, int y)
+{
+    int ptz_arg[8];
+
+    ptz_arg[0] = action % 100;
+    ptz_arg[1] = 0;
+    ptz_arg[2] = 1; // 1, 2 or 3
+    ptz_arg[3] = x; // absolute position x
+    ptz_arg[4] = y; // absolute position y
+    ptz_arg[5] = 0; // ptz crz
+    ptz_arg[6] = 0;
+    ptz_arg[7] = 0;
+
+    if (hw_sendptz(ptz_arg) != 0)
+        return -1;
+
+    hw_action = action;
+    if (action == ACTION_STOP) {
+        hw_state = STATE_IDLE;
+    } else if (action == ACTION_GO) {
+        hw_state = STATE_GOING;
+        target_x = x;
+        target_y = y;
+        // The positions read before the go don't tell if the motors stopped
+        last_x = -1;
+        last_y = -1;
+    } else {
+        hw_state = STATE_MOVING;
+    }
+
+    return 0;
+}
+
+static long long now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int read_coord(int *x, int *y)
+{
+    int buffer[10];
+
+    memset(buffer, '\0', sizeof(buffer));
+    if (hw_pos_read(0, buffer, 0, 0) != 0) {
+        fprintf(stderr, "Error reading position\n");
+        return -1;
+    }
+
+    *x = buffer[3];
+    *y = buffer[4];
+
+    return 0;
+}
+
+static void *cmd_thread_func(void *arg)
+{
+    struct ptz_cmd cmd;
+    struct timespec stop_time;
+    int stop_pending = 0;
+    int ret;
+
+    pthread_mutex_lock(&cmd_mutex);
+
+    for (;;) {
+        if (cmd_pending) {
+            cmd = cmd_next;
+            cmd_pending = 0;
+
+            // The stop of the previous move is replaced by this one
+            stop_pending = ((cmd.action != ACTION_STOP) && (cmd.time > 0));
+            if (stop_pending) {
+                clock_gettime(cmd_clock, &stop_time);
+                stop_time.tv_sec += cmd.time / 1000;
+                stop_time.tv_nsec += (cmd.time % 1000) * 1000000L;
+                if (stop_time.tv_nsec >= 1000000000L) {
+                    stop_time.tv_sec++;
+                    stop_time.tv_nsec -= 1000000000L;
+                }
+            }
+            pthread_mutex_unlock(&cmd_mutex);
+
+            // The same direction again (a held key) only moves the stop further
+            pthread_mutex_lock(&ptz_mutex);
+            if ((cmd.action >= ACTION_RIGHT) && (cmd.action <= ACTION_UP) &&
+                    (hw_state == STATE_MOVING) && (hw_action == cmd.action))
+                ret = 0;
+            else
+                ret = send_ptz(cmd.action, cmd.x, cmd.y);
+            pthread_mutex_unlock(&ptz_mutex);
+            if (ret != 0)
+                fprintf(stderr, "Error sending PTZ action %d\n", cmd.action);
+
+            pthread_mutex_lock(&cmd_mutex);
+        } else if (stop_pending) {
+            ret = pthread_cond_timedwait(&cmd_cond, &cmd_mutex, &stop_time);
+            if ((ret == ETIMEDOUT) && !cmd_pending) {
+                stop_pending = 0;
+                pthread_mutex_unlock(&cmd_mutex);
+
+                pthread_mutex_lock(&ptz_mutex);
+                send_ptz(ACTION_STOP, 0, 0);
+                pthread_mutex_unlock(&ptz_mutex);
+
+                pthread_mutex_lock(&cmd_mutex);
+            }
+        } else {
+            pthread_cond_wait(&cmd_cond, &cmd_mutex);
+        }
+    }
+
+    return NULL;
+}
+
+static int cmd_thread_start()
+{
+    pthread_condattr_t attr;
+
+    if (cmd_thread_started)
+        return 0;
+
+    // Some uclibc builds have no monotonic condition variables,
+    // the deadline is then computed on the realtime clock (like event.c of mqtt-sonoff)
+    pthread_condattr_init(&attr);
+    if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0)
+        cmd_clock = CLOCK_REALTIME;
+    pthread_cond_init(&cmd_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&cmd_thread, NULL, cmd_thread_func, NULL) != 0) {
+        fprintf(stderr, "Can't create the PTZ thread\n");
+        return -1;
+    }
+    pthread_detach(cmd_thread);
+    cmd_thread_started = 1;
+
+    return 0;
+}
+
+int ptz_ctl_init(const char *preset_file)
+{
+    const char **libs = hw_libs;
+    int i;
+
+    if ((access(FW_LIB_DIR "/libhardware.so", F_OK) == 0) &&
+            (access(FW_LIB_DIR "/libptz.so", F_OK) != 0))
+        libs = hw_libs_h;
+
+    pthread_mutex_lock(&ptz_mutex);
+
+    for (i = 0; (hw_lib == NULL) && (libs[i] != NULL); i++) {
+        hw_lib = dlopen(libs[i], RTLD_NOW);
+    }
+    if (hw_lib == NULL) {
+        fprintf(stderr, "Can't load the PTZ library: %s\n", dlerror());
+        pthread_mutex_unlock(&ptz_mutex);
+        return -1;
+    }
+
+    *(void **) (&hw_sendptz) = dlsym(hw_lib, "hw_ptz_sendptz");
+    *(void **) (&hw_pos_read) = dlsym(hw_lib, "hw_ptz_pos_read");
+    if ((hw_sendptz == NULL) || (hw_pos_read == NULL)) {
+        fprintf(stderr, "Wrong PTZ library: %s\n", dlerror());
+        dlclose(hw_lib);
+        hw_lib = NULL;
+        pthread_mutex_unlock(&ptz_mutex);
+        return -1;
+    }
+
+    snprintf(presets_file, sizeof(presets_file), "%s", preset_file);
+    presets_loaded = 0;
+    presets_load();
+
+    pthread_mutex_unlock(&ptz_mutex);
+
+    pthread_mutex_lock(&cmd_mutex);
+    i = cmd_thread_start();
+    pthread_mutex_unlock(&cmd_mutex);
+
+    return i;
+}
+
+// Queue the command and return without waiting for the hardware.
+// action: ACTION_STOP, a direction (x, y ignored) or ACTION_GO (x, y absolute position).
+// time: ms after which the ptz_ctl thread stops the move, 0 keeps moving until the next command.
+int ptz_ctl_post(int action, int x, int y, int time)
+{
+    if ((action < ACTION_STOP) || ((action > ACTION_UP) && (action != ACTION_GO)))
+        return -1;
+
+    if ((action == ACTION_GO) &&
+            ((x < MIN_X) || (x > MAX_X) || (y < MIN_Y) || (y > MAX_Y)))
+        return -1;
+
+    pthread_mutex_lock(&cmd_mutex);
+
+    if (!cmd_thread_started) {
+        pthread_mutex_unlock(&cmd_mutex);
+        return -1;
+    }
+
+    cmd_next.action = action;
+    cmd_next.x = x;
+    cmd_next.y = y;
+    cmd_next.time = time;
+    cmd_pending = 1;
+    pthread_cond_signal(&cmd_cond);
+
+    pthread_mutex_unlock(&cmd_mutex);
+
+    return 0;
+}
+
+// Move in the direction, then stop after time ms (0: keep moving until ptz_ctl_stop).
+// Like ptz_ctl_stop() and ptz_ctl_go() it goes through the ptz_ctl thread,
+// so it replaces the stop still pending of a previous move.
+int ptz_ctl_move(int action, int time)
+{
+    if ((action < ACTION_RIGHT) || (action > ACTION_UP))
+        return -1;
+
+    return ptz_ctl_post(action, 0, 0, time);
+}
+
+int ptz_ctl_stop()
+{
+    return ptz_ctl_post(ACTION_STOP, 0, 0, 0);
+}
+
+int ptz_ctl_go(int x, int y)
+{
+    return ptz_ctl_post(ACTION_GO, x, y, 0);
+}
+
+int ptz_ctl_get_coord(int *x, int *y)
+{
+    int ret;
+
+    pthread_mutex_lock(&ptz_mutex);
+    ret = read_coord(x, y);
+    pthread_mutex_unlock(&ptz_mutex);
+
+    return ret;
+}
+
+// Position and whether the motors are moving. The end of a go is detected
+// when the position is the target or hasn't changed for GO_SETTLE_TIME ms
+// since the go was sent.
+int ptz_ctl_get_status(int *x, int *y, int *moving)
+{
+    long long now;
+    int ret;
+
+    pthread_mutex_lock(&ptz_mutex);
+
+    ret = read_coord(x, y);
+    if (ret == 0) {
+        now = now_ms();
+        if ((*x != last_x) || (*y != last_y)) {
+            last_x = *x;
+            last_y = *y;
+            last_time = now;
+        }
+
+        if ((hw_state == STATE_GOING) &&
+                (((*x == target_x) && (*y == target_y)) || (now - last_time >= GO_SETTLE_TIME)))
+            hw_state = STATE_IDLE;
+
+        *moving = (hw_state != STATE_IDLE);
+    }
+
+    pthread_mutex_unlock(&ptz_mutex);
+
+    return ret;
+}
+
+int ptz_ctl_go_preset(int preset_num)
+{
+    int x = -1, y = -1;
+
+    if ((preset_num < 0) || (preset_num > 14))
+        return -1;
+
+    pthread_mutex_lock(&ptz_mutex);
+
+    if (preset_num <= 9) {
+        presets_load();
+        x = presets[preset_num].x;
+        y = presets[preset_num].y;
+    } else {
+        switch (preset_num) {
+            case 10:
+                x = MAX_X / 2;
+                y = MAX_Y / 2;
+                break;
+            case 11:
+                x = MAX_X;
+                y = MAX_Y;
+                break;
+            case 12:
+                x = MIN_X;
+                y = MAX_Y;
+                break;
+            case 13:
+                x = MIN_X;
+                y = MIN_Y;
+                break;
+            case 14:
+                x = MAX_X;
+                y = MIN_Y;
+                break;
+        }
+    }
+
+    pthread_mutex_unlock(&ptz_mutex);
+
+    if ((x < 0) || (y < 0)) {
+        // Empty preset
+        return -1;
+    }
+
+    // Queued like the other moves, a stop pending from a timed move would stop it halfway
+    return ptz_ctl_post(ACTION_GO, x, y, 0);
+}
+
+// Save the current position, preset_num -1 takes the first free preset.
+// Return the number of the preset or -1.
+int ptz_ctl_set_preset(int preset_num, const char *desc)
+{
+    int x, y;
+    int i;
+
+    if ((preset_num < -1) || (preset_num > 9))
+        return -1;
+
+    pthread_mutex_lock(&ptz_mutex);
+
+    presets_load();
+
+    if (preset_num == -1) {
+        for (i = 0; i < 10; i++) {
+            if (strcasecmp("empty", presets[i].desc) == 0) {
+                preset_num = i;
+                break;
+            }
+        }
+    }
+
+    if ((preset_num == -1) || (read_coord(&x, &y) != 0)) {
+        pthread_mutex_unlock(&ptz_mutex);
+        return -1;
+    }
+
+    presets[preset_num].x = x;
+    presets[preset_num].y = y;
+    snprintf(presets[preset_num].desc, sizeof(presets[preset_num].desc), "%s", desc);
+
+    if (presets_save() != 0)
+        preset_num = -1;
+
+    pthread_mutex_unlock(&ptz_mutex);
+
+    return preset_num;
+}
+
+int ptz_ctl_clear_preset(int preset_num)
+{
+    int ret;
+
+    if ((preset_num < 0) || (preset_num > 9))
+        return -1;
+
+    pthread_mutex_lock(&ptz_mutex);
+
+    presets_load();
+    presets[preset_num].x = -1;
+    presets[preset_num].y = -1;
+    strcpy(presets[preset_num].desc, "empty");
+    ret = presets_save();
+
+    pthread_mutex_unlock(&ptz_mutex);
+
+    return ret;
+}
+
+int ptz_ctl_get_preset(int preset_num, struct preset *pr)
+{
+    if ((preset_num < 0) || (preset_num >= PRESET_NUM))
+        return -1;
+
+    pthread_mutex_lock(&ptz_mutex);
+
+    presets_load();
+    *pr = presets[preset_num];
+
+    pthread_mutex_unlock(&ptz_mutex);
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * In process PTZ control, see ptz_ctl.c
+ */
+
+#ifndef PTZ_CTL_H
+#define PTZ_CTL_H
+
+#include "ptz.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ptz_ctl_init(const char *preset_file);
+
+int ptz_ctl_move(int action, int time);
+int ptz_ctl_stop();
+int ptz_ctl_go(int x, int y);
+int ptz_ctl_get_coord(int *x, int *y);
+int ptz_ctl_get_status(int *x, int *y, int *moving);
+
+int ptz_ctl_post(int action, int x, int y, int time);
+
+int ptz_ctl_go_preset(int preset_num);
+int ptz_ctl_set_preset(int preset_num, const char *desc);
+int ptz_ctl_clear_preset(int preset_num);
+int ptz_ctl_get_preset(int preset_num, struct preset *pr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //PTZ_CTL_H
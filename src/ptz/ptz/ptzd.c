@@ -0,0 +1,400 @@
+/*
+ * ptzd: PTZ daemon.
+ * Keeps the hardware library and the presets loaded (see ptz_ctl.c) and
+ * serves the commands of ptzd.h on a UNIX socket, so the ptz command, the
+ * web ui and the boot preset don't load everything for every move.
+ * It is the only owner of /dev/ptz: onvif_srvd sends its commands here too
+ * (ptzd_client.c), one stop timer and one position for all of them.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <getopt.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ptz.h"
+#include "ptz_ctl.h"
+#include "ptzd.h"
+
+#define MAX_CLIENTS            8
+#define WATCH_INTERVAL         200 // ms
+
+struct client {
+    int fd;
+    int watch;
+    int len;
+    char buf[MAXLINE * 3];
+};
+
+static struct client clients[MAX_CLIENTS];
+static int last_x = -1, last_y = -1, last_moving = -1;
+static int debug;
+
+void print_usage(char *progname)
+{
+    fprintf(stderr, "\nUsage: %s OPTIONS\n\n", progname);
+    fprintf(stderr, "\t-f PRESET_FILE, --file PRESET_FILE\n");
+    fprintf(stderr, "\t\tset preset configuration file\n");
+    fprintf(stderr, "\t-s SOCKET, --socket SOCKET\n");
+    fprintf(stderr, "\t\tset command socket (default %s)\n", PTZD_SOCKET);
+    fprintf(stderr, "\t-d, --debug\n");
+    fprintf(stderr, "\t\tenable debug\n");
+    fprintf(stderr, "\t-h, --help\n");
+    fprintf(stderr, "\t\tprint this help\n");
+}
+
+static int parse_int(const char *str, int *value)
+{
+    char *endptr;
+    long n;
+
+    if (str == NULL)
+        return -1;
+
+    errno = 0;
+    n = strtol(str, &endptr, 10);
+    if ((errno != 0) || (endptr == str) || (*endptr != '\0'))
+        return -1;
+
+    *value = n;
+    return 0;
+}
+
+static void client_send(struct client *cl, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void client_send(struct client *cl, const char *fmt, ...)
+{
+    char msg[MAXLINE * 3];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(msg, sizeof(msg) - 1, fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return;
+    if (len > (int) sizeof(msg) - 2)
+        len = sizeof(msg) - 2;
+    msg[len++] = '\n';
+
+    // A client that doesn't read its socket loses the messages, it can't block the others
+    if (send(cl->fd, msg, len, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            close(cl->fd);
+            cl->fd = -1;
+        }
+    }
+}
+
+static int direction(const char *cmd)
+{
+    if (strcasecmp("right", cmd) == 0)
+        return ACTION_RIGHT;
+    if (strcasecmp("left", cmd) == 0)
+        return ACTION_LEFT;
+    if (strcasecmp("down", cmd) == 0)
+        return ACTION_DOWN;
+    if (strcasecmp("up", cmd) == 0)
+        return ACTION_UP;
+
+    return ACTION_NONE;
+}
+
+static void handle_command(struct client *cl, char *line)
+{
+    char *cmd, *arg1, *arg2, *arg3, *save;
+    int action;
+    int n, x, y, moving;
+
+    n = strlen(line);
+    while ((n > 0) && ((line[n - 1] == '\r') || (line[n - 1] == ' ') || (line[n - 1] == '\t')))
+        line[--n] = '\0';
+
+    if (debug) fprintf(stderr, "Command: %s\n", line);
+
+    cmd = strtok_r(line, " \t\r", &save);
+    if (cmd == NULL)
+        return;
+    arg1 = strtok_r(NULL, " \t\r", &save);
+    // The description of set_preset is the rest of the line
+    arg2 = (save != NULL) ? save + strspn(save, " \t") : NULL;
+    if ((arg2 != NULL) && (*arg2 == '\0'))
+        arg2 = NULL;
+
+    action = direction(cmd);
+
+    if (strcasecmp("stop", cmd) == 0) {
+        if (ptz_ctl_post(ACTION_STOP, 0, 0, 0) != 0) {
+            client_send(cl, "ERR stop");
+            return;
+        }
+    } else if (action != ACTION_NONE) {
+        n = DEFAULT_ACTION_TIME;
+        if ((arg1 != NULL) && ((parse_int(arg1, &n) != 0) || (n < 0) || (n > PTZD_MAX_TIME))) {
+            client_send(cl, "ERR time");
+            return;
+        }
+        // Queued: the reply doesn't wait for the move and a new move replaces it
+        if (ptz_ctl_post(action, 0, 0, n) != 0) {
+            client_send(cl, "ERR move");
+            return;
+        }
+    } else if (strcasecmp("go", cmd) == 0) {
+        // arg2 is the rest of the line: Y [TIME]
+        arg2 = (arg2 != NULL) ? strtok_r(arg2, " \t", &save) : NULL;
+        arg3 = (arg2 != NULL) ? strtok_r(NULL, " \t", &save) : NULL;
+        n = 0;
+        if ((parse_int(arg1, &x) != 0) || (parse_int(arg2, &y) != 0) ||
+                ((arg3 != NULL) && ((parse_int(arg3, &n) != 0) || (n < 0) || (n > PTZD_MAX_TIME))) ||
+                (ptz_ctl_post(ACTION_GO, x, y, n) != 0)) {
+            client_send(cl, "ERR position");
+            return;
+        }
+    } else if (strcasecmp("go_preset", cmd) == 0) {
+        if ((parse_int(arg1, &n) != 0) || (ptz_ctl_go_preset(n) != 0)) {
+            client_send(cl, "ERR preset");
+            return;
+        }
+    } else if (strcasecmp("set_preset", cmd) == 0) {
+        if ((parse_int(arg1, &n) != 0) || (arg2 == NULL)) {
+            client_send(cl, "ERR preset");
+            return;
+        }
+        n = ptz_ctl_set_preset(n, arg2);
+        if (n == -1) {
+            client_send(cl, "ERR preset");
+            return;
+        }
+        client_send(cl, "OK %d", n);
+        return;
+    } else if (strcasecmp("clear_preset", cmd) == 0) {
+        if ((parse_int(arg1, &n) != 0) || (ptz_ctl_clear_preset(n) != 0)) {
+            client_send(cl, "ERR preset");
+            return;
+        }
+    } else if (strcasecmp("get_coord", cmd) == 0) {
+        if (ptz_ctl_get_status(&x, &y, &moving) != 0) {
+            client_send(cl, "ERR position");
+            return;
+        }
+        client_send(cl, "OK %d %d %d", x, y, moving);
+        return;
+    } else if (strcasecmp("watch", cmd) == 0) {
+        cl->watch = 1;
+        last_moving = -1; // send the position at the next poll
+    } else {
+        client_send(cl, "ERR command");
+        return;
+    }
+
+    client_send(cl, "OK");
+}
+
+static void client_read(struct client *cl)
+{
+    char *line, *end;
+    int n;
+
+    n = read(cl->fd, cl->buf + cl->len, sizeof(cl->buf) - 1 - cl->len);
+    if (n <= 0) {
+        close(cl->fd);
+        cl->fd = -1;
+        return;
+    }
+    cl->len += n;
+    cl->buf[cl->len] = '\0';
+
+    line = cl->buf;
+    while ((cl->fd != -1) && ((end = strchr(line, '\n')) != NULL)) {
+        *end = '\0';
+        handle_command(cl, line);
+        line = end + 1;
+    }
+    if (cl->fd == -1)
+        return;
+
+    cl->len -= line - cl->buf;
+    if (cl->len == sizeof(cl->buf) - 1) {
+        // Line too long
+        close(cl->fd);
+        cl->fd = -1;
+        return;
+    }
+    memmove(cl->buf, line, cl->len);
+}
+
+// Send the position to the watching clients when it changes
+static void watch_position()
+{
+    int x, y, moving;
+    int i;
+
+    if (ptz_ctl_get_status(&x, &y, &moving) != 0)
+        return;
+    if ((x == last_x) && (y == last_y) && (moving == last_moving))
+        return;
+
+    last_x = x;
+    last_y = y;
+    last_moving = moving;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if ((clients[i].fd != -1) && clients[i].watch)
+            client_send(&clients[i], "POS %d %d %d", x, y, moving);
+    }
+}
+
+static int open_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        fprintf(stderr, "Can't create the socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if ((bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) ||
+            (listen(fd, MAX_CLIENTS) != 0)) {
+        fprintf(stderr, "Can't listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    char preset_file[1024];
+    char socket_file[108];
+    struct pollfd fds[MAX_CLIENTS + 1];
+    int idx[MAX_CLIENTS + 1];
+    int listen_fd;
+    int nfds;
+    int watching;
+    int c, i, j;
+
+    preset_file[0] = '\0';
+    strcpy(socket_file, PTZD_SOCKET);
+    debug = 0;
+
+    while (1) {
+        static struct option long_options[] =
+        {
+            {"file",  required_argument, 0, 'f'},
+            {"socket",  required_argument, 0, 's'},
+            {"debug",  no_argument, 0, 'd'},
+            {"help",  no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+
+        c = getopt_long (argc, argv, "f:s:dh",
+                         long_options, &option_index);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+
+        case 'f':
+            snprintf(preset_file, sizeof(preset_file), "%s", optarg);
+            break;
+
+        case 's':
+            snprintf(socket_file, sizeof(socket_file), "%s", optarg);
+            break;
+
+        case 'd':
+            fprintf (stderr, "debug on\n");
+            debug = 1;
+            break;
+
+        case 'h':
+        default:
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (preset_file[0] == '\0') {
+        fprintf(stderr, "preset_file cannot be empty.\n");
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (ptz_ctl_init(preset_file) != 0)
+        return -2;
+
+    listen_fd = open_socket(socket_file);
+    if (listen_fd == -1)
+        return -2;
+
+    for (i = 0; i < MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+
+    while (1) {
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        nfds = 1;
+        watching = 0;
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].fd == -1)
+                continue;
+            fds[nfds].fd = clients[i].fd;
+            fds[nfds].events = POLLIN;
+            idx[nfds] = i;
+            nfds++;
+            watching |= clients[i].watch;
+        }
+
+        // Poll the position only when someone is watching it
+        if (poll(fds, nfds, watching ? WATCH_INTERVAL : -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "poll: %s\n", strerror(errno));
+            return -2;
+        }
+
+        for (i = 1; i < nfds; i++) {
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                client_read(&clients[idx[i]]);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            c = accept(listen_fd, NULL, NULL);
+            if (c != -1) {
+                for (j = 0; (j < MAX_CLIENTS) && (clients[j].fd != -1); j++);
+                if (j == MAX_CLIENTS) {
+                    close(c);
+                } else {
+                    clients[j].fd = c;
+                    clients[j].watch = 0;
+                    clients[j].len = 0;
+                }
+            }
+        }
+
+        if (watching)
+            watch_position();
+    }
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+/*
+ * ptzd command socket, shared by the daemon and its clients (ptz command,
+ * onvif_srvd), see ptzd_client.c.
+ *
+ * One command per line, one reply per line: "OK [values]" or "ERR reason".
+ *
+ *   stop
+ *   right|left|down|up [TIME]   move and stop after TIME ms (default 500,
+ *                               0 keeps moving until the next command)
+ *   go X Y [TIME]               go to the absolute position, stop after TIME
+ *                               ms if it is set (0 goes all the way)
+ *   go_preset NUM               0-9 presets, 10-14 center and corners
+ *   set_preset NUM DESC         save the position, NUM -1 takes the first
+ *                               free preset, reply "OK NUM"
+ *   clear_preset NUM
+ *   get_coord                   reply "OK X Y MOVING"
+ *   watch                       reply "OK", then "POS X Y MOVING" every time
+ *                               the position changes
+ */
+
+#ifndef PTZD_H
+#define PTZD_H
+
+#define PTZD_SOCKET            "/tmp/ptzd.sock"
+
+#define PTZD_MAX_TIME          5000
+
+#endif //PTZD_H
@@ -0,0 +1,218 @@
+/*
+ * Client of the ptzd command socket (see ptzd.h).
+ * ptzd is the only process that drives /dev/ptz and writes the presets,
+ * the others send it their commands so a timed move of one can't stop
+ * the move of another and the position is the same for everybody.
+ * ptzd_client_*() keep one connection for the whole process and are
+ * thread safe. They return PTZD_NOT_RUNNING if ptzd can't be reached,
+ * so the caller can fall back to its own way of moving the camera.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ptzd_client.h"
+
+// ptzd replies at once, the moves are queued
+#define REPLY_TIMEOUT          2 // s
+
+static pthread_mutex_t client_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char client_path[108] = PTZD_SOCKET;
+static int client_fd = -1;
+
+// Connect to ptzd, -1 if it's not running
+int ptzd_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Read a line of ptzd without the newline
+int ptzd_read_line(int fd, char *line, int size)
+{
+    int len = 0;
+
+    while (len < size - 1) {
+        if (read(fd, &line[len], 1) != 1)
+            return -1;
+        if (line[len] == '\n')
+            break;
+        len++;
+    }
+    line[len] = '\0';
+
+    return len;
+}
+
+void ptzd_client_init(const char *path)
+{
+    pthread_mutex_lock(&client_mutex);
+
+    snprintf(client_path, sizeof(client_path), "%s", path);
+    if (client_fd != -1) {
+        close(client_fd);
+        client_fd = -1;
+    }
+
+    pthread_mutex_unlock(&client_mutex);
+}
+
+// Send a command and read its reply, 0 if it is "OK"
+int ptzd_client_command(char *reply, int size, const char *fmt, ...)
+{
+    char request[MAXLINE + 256];
+    struct timeval tv;
+    va_list ap;
+    int len, i;
+
+    va_start(ap, fmt);
+    len = vsnprintf(request, sizeof(request) - 1, fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return PTZD_ERROR;
+    if (len > (int) sizeof(request) - 2)
+        len = sizeof(request) - 2;
+    // A description can't add a command
+    for (i = 0; i < len; i++) {
+        if ((request[i] == '\n') || (request[i] == '\r'))
+            request[i] = ' ';
+    }
+    request[len++] = '\n';
+
+    pthread_mutex_lock(&client_mutex);
+
+    // The connection is lost if ptzd was restarted, try again once with a new one
+    for (i = 0; i < 2; i++) {
+        if (client_fd == -1) {
+            client_fd = ptzd_connect(client_path);
+            if (client_fd == -1)
+                break;
+            tv.tv_sec = REPLY_TIMEOUT;
+            tv.tv_usec = 0;
+            setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        }
+        if (send(client_fd, request, len, MSG_NOSIGNAL) == len)
+            break;
+        close(client_fd);
+        client_fd = -1;
+    }
+    if (client_fd == -1) {
+        pthread_mutex_unlock(&client_mutex);
+        return PTZD_NOT_RUNNING;
+    }
+
+    if (ptzd_read_line(client_fd, reply, size) < 0) {
+        // A late reply would be taken for the one of the next command
+        close(client_fd);
+        client_fd = -1;
+        pthread_mutex_unlock(&client_mutex);
+        return PTZD_ERROR;
+    }
+
+    pthread_mutex_unlock(&client_mutex);
+
+    return (strncmp(reply, "OK", 2) == 0) ? 0 : PTZD_ERROR;
+}
+
+// ptzd takes times up to PTZD_MAX_TIME
+static int client_time(int time)
+{
+    if (time < 0)
+        return 0;
+    if (time > PTZD_MAX_TIME)
+        return PTZD_MAX_TIME;
+
+    return time;
+}
+
+// Move in the direction and stop after time ms (0: until the next command), or stop
+int ptzd_client_move(int action, int time)
+{
+    static const char *cmds[] = { "stop", "right", "left", "down", "up" };
+    char reply[MAXLINE];
+
+    if ((action < ACTION_STOP) || (action > ACTION_UP))
+        return PTZD_ERROR;
+
+    if (action == ACTION_STOP)
+        return ptzd_client_command(reply, sizeof(reply), "stop");
+
+    return ptzd_client_command(reply, sizeof(reply), "%s %d", cmds[action], client_time(time));
+}
+
+// Go to the position, stop after time ms if it is not 0
+int ptzd_client_go(int x, int y, int time)
+{
+    char reply[MAXLINE];
+
+    if (time == 0)
+        return ptzd_client_command(reply, sizeof(reply), "go %d %d", x, y);
+
+    return ptzd_client_command(reply, sizeof(reply), "go %d %d %d", x, y, client_time(time));
+}
+
+int ptzd_client_get_status(int *x, int *y, int *moving)
+{
+    char reply[MAXLINE];
+    int ret;
+
+    ret = ptzd_client_command(reply, sizeof(reply), "get_coord");
+    if (ret != 0)
+        return ret;
+
+    if (sscanf(reply, "OK %d %d %d", x, y, moving) != 3)
+        return PTZD_ERROR;
+
+    return 0;
+}
+
+int ptzd_client_go_preset(int preset_num)
+{
+    char reply[MAXLINE];
+
+    return ptzd_client_command(reply, sizeof(reply), "go_preset %d", preset_num);
+}
+
+// Save the position, preset_num -1 takes the first free preset. Return the number of the preset
+int ptzd_client_set_preset(int preset_num, const char *desc)
+{
+    char reply[MAXLINE];
+    int ret;
+
+    ret = ptzd_client_command(reply, sizeof(reply), "set_preset %d %s", preset_num, desc);
+    if (ret != 0)
+        return ret;
+
+    if ((sscanf(reply, "OK %d", &preset_num) != 1) || (preset_num < 0))
+        return PTZD_ERROR;
+
+    return preset_num;
+}
+
+int ptzd_client_clear_preset(int preset_num)
+{
+    char reply[MAXLINE];
+
+    return ptzd_client_command(reply, sizeof(reply), "clear_preset %d", preset_num);
+}
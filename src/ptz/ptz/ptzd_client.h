@@ -0,0 +1,38 @@
+/*
+ * Client of the ptzd command socket, see ptzd_client.c
+ */
+
+#ifndef PTZD_CLIENT_H
+#define PTZD_CLIENT_H
+
+#include "ptz.h"
+#include "ptzd.h"
+
+// Errors of the ptzd_client functions
+#define PTZD_NOT_RUNNING       -1
+#define PTZD_ERROR             -2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ptzd_connect(const char *path);
+int ptzd_read_line(int fd, char *line, int size);
+
+void ptzd_client_init(const char *path);
+int ptzd_client_command(char *reply, int size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+int ptzd_client_move(int action, int time);
+int ptzd_client_go(int x, int y, int time);
+int ptzd_client_get_status(int *x, int *y, int *moving);
+
+int ptzd_client_go_preset(int preset_num);
+int ptzd_client_set_preset(int preset_num, const char *desc);
+int ptzd_client_clear_preset(int preset_num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //PTZD_CLIENT_H
@@ -21,51 +21,200 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include "record.h"
 
+int debug;
+
 void print_usage(char *progname)
 {
-    fprintf(stderr, "\nUsage: %s [-f filename] [-d] [-h]\n\n", progname);
+    fprintf(stderr, "\nUsage: %s [-f filename] [-t timeout] [-d] [-h]\n\n", progname);
     fprintf(stderr, "\t-f filename, --file filename\n");
-    fprintf(stderr, "\t\twrite mp4 to file\n");
+    fprintf(stderr, "\t\twrite mp4 to file, exit when the encoder closes it\n");
+    fprintf(stderr, "\t-t timeout, --timeout timeout\n");
+    fprintf(stderr, "\t\tmax time in ms without new data (default %d)\n", RECORD_TIMEOUT);
     fprintf(stderr, "\t-d,     --debug\n");
     fprintf(stderr, "\t\tenable debug\n");
     fprintf(stderr, "\t-h,     --help\n");
     fprintf(stderr, "\t\tprint this help\n");
 }
 
+long long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Copy the file from *offset to end to out.
+ * Use sendfile and fall back to read/write if out doesn't support it.
+ * Return 0 or -1 if out is closed.
+ */
+int copy_range(int out, int in, off_t *offset, off_t end)
+{
+    static int use_sendfile = 1;
+    char buffer[4096];
+    ssize_t n, w, len;
+
+    while (*offset < end) {
+        len = end - *offset;
+        if (use_sendfile) {
+            n = sendfile(out, in, offset, len);
+            if (n > 0)
+                continue;
+            if ((n < 0) && ((errno == EINVAL) || (errno == ENOSYS))) {
+                use_sendfile = 0;
+                continue;
+            }
+        } else {
+            if (len > (ssize_t) sizeof(buffer))
+                len = sizeof(buffer);
+            n = pread(in, buffer, len, *offset);
+            if (n > 0) {
+                for (w = 0; w < n; w += len) {
+                    len = write(out, buffer + w, n - w);
+                    if (len <= 0)
+                        return -1;
+                }
+                *offset += n;
+                continue;
+            }
+        }
+        if ((n < 0) && (errno == EINTR))
+            continue;
+        // The file was truncated or the output is closed
+        return (n == 0) ? 0 : -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Wait until the encoder closes the file, watching its folder with ifd,
+ * then copy it to out (if out >= 0).
+ * The mp4 is not fragmented, it's valid only when the encoder closes it.
+ * Return 0 or a negative error.
+ */
+int wait_file(int ifd, int sockfd, const char *filename, const char *name,
+                int out, int timeout)
+{
+    char ev_buf[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    struct pollfd fds[2];
+    struct stat st;
+    char ack[1024];
+    long long last;
+    off_t offset = 0;
+    int fd = -1;
+    int closed = 0;
+    int nfds, len;
+    int ret = 0;
+    char *p;
+
+    last = now_ms();
+    while (1) {
+        fds[0].fd = ifd;
+        fds[0].events = POLLIN;
+        fds[1].fd = sockfd;
+        fds[1].events = POLLIN;
+
+        // Wake up from time to time to check the timeout
+        nfds = poll(fds, 2, RECORD_CHECK_INTERVAL);
+        if ((nfds < 0) && (errno != EINTR)) {
+            fprintf(stderr, "Poll failed\n");
+            ret = -4;
+            break;
+        }
+
+        if ((nfds > 0) && (fds[1].revents & POLLIN)) {
+            len = recv(sockfd, ack, sizeof(ack), 0);
+            if (debug) fprintf(stderr, "Confirmation received (%d bytes packet)\n", len);
+        }
+        if ((nfds > 0) && (fds[0].revents & POLLIN)) {
+            while ((len = read(ifd, ev_buf, sizeof(ev_buf))) > 0) {
+                for (p = ev_buf; p < ev_buf + len; p += sizeof(struct inotify_event) + ev->len) {
+                    ev = (struct inotify_event *) p;
+                    if ((ev->len == 0) || (strcmp(ev->name, name) != 0))
+                        continue;
+                    // Any event of the file means the encoder is still writing
+                    last = now_ms();
+                    if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                        closed = 1;
+                }
+            }
+        }
+
+        if (closed) {
+            fd = open(filename, O_RDONLY);
+            if (fd < 0) {
+                fprintf(stderr, "Could not open %s\n", filename);
+                ret = -5;
+            } else if (fstat(fd, &st) != 0) {
+                ret = -5;
+            } else if ((out >= 0) && (copy_range(out, fd, &offset, st.st_size) < 0)) {
+                if (debug) fprintf(stderr, "Output closed\n");
+                ret = -6;
+            } else {
+                if (debug) fprintf(stderr, "File %s completed, %lld bytes\n", filename, (long long) st.st_size);
+            }
+            break;
+        }
+
+        if (now_ms() - last > timeout) {
+            fprintf(stderr, "Timeout waiting for %s\n", filename);
+            ret = -3;
+            break;
+        }
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    return ret;
+}
+
 int main(int argc, char **argv)
 {
     char filename[1024];
-    struct stat st;
-    int debug;
+    char dir[1024];
+    const char *name;
     int c;
     int errno;
     char *endptr;
     int stdout_output;
+    int timeout;
 
-    int sockfd;
+    int sockfd, ifd;
     struct sockaddr_in local_addr, avencode_addr;
     char *message;
-
-    FILE *fp;
-    char buffer[4096];
-    int n_recv;
-    size_t n_read;
+    char *p;
+    int ret;
 
     // Setting default
-    tmpnam(filename);
+    sprintf(filename, "%s/record.%d.mp4", RECORD_TMP_DIR, (int) getpid());
     stdout_output = 1;
+    timeout = RECORD_TIMEOUT;
     debug = 0;
 
     while (1) {
         static struct option long_options[] =
         {
             {"filename",  required_argument, 0, 'f'},
+            {"timeout",  required_argument, 0, 't'},
             {"debug",  no_argument, 0, 'd'},
             {"help",  no_argument, 0, 'h'},
             {0, 0, 0, 0}
@@ -73,7 +222,7 @@ int main(int argc, char **argv)
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "f:dh",
+        c = getopt_long (argc, argv, "f:t:dh",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -85,12 +234,20 @@ int main(int argc, char **argv)
         case 'f':
             memset(filename, '\0', 1024);
             if (strlen(optarg) >= 1024)
-                strncpy(filename, optarg, 1024);
+                strncpy(filename, optarg, 1023);
             else 
                 strncpy(filename, optarg, strlen(optarg));
             stdout_output = 0;
             break;
 
+        case 't':
+            timeout = strtol(optarg, &endptr, 10);
+            if ((endptr == optarg) || (timeout <= 0)) {
+                print_usage(argv[0]);
+                return -1;
+            }
+            break;
+
         case 'd':
             fprintf (stderr, "debug on\n");
             debug = 1;
@@ -113,6 +270,40 @@ int main(int argc, char **argv)
 
     if (debug) fprintf(stderr, "Starting program\n");
 
+    if (strlen(filename) > MSG_SIZE - sizeof(MSG_MP4_PART_1)) {
+        fprintf(stderr, "File name too long\n");
+        return -1;
+    }
+
+    // Split folder and file name
+    strcpy(dir, filename);
+    p = strrchr(dir, '/');
+    if (p == NULL) {
+        strcpy(dir, ".");
+        name = filename;
+    } else {
+        name = filename + (p - dir) + 1;
+        if (p == dir)
+            p++;
+        *p = '\0';
+    }
+
+    // A client closing the connection must not kill us before the cleanup
+    signal(SIGPIPE, SIG_IGN);
+
+    // Watch the folder before sending the request to not miss the events
+    unlink(filename);
+    ifd = inotify_init();
+    if (ifd < 0) {
+        fprintf(stderr, "Could not init inotify\n");
+        return -1;
+    }
+    fcntl(ifd, F_SETFL, O_NONBLOCK);
+    if (inotify_add_watch(ifd, dir, IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "Could not watch %s\n", dir);
+        return -1;
+    }
+
     // Create UDP socket
     sockfd = socket(AF_INET , SOCK_DGRAM , 0);
     if (sockfd == -1) {
@@ -151,24 +342,18 @@ int main(int argc, char **argv)
         return -1;
     }
     if (debug) fprintf(stderr, "Data successfully sent\n");
+    free(message);
 
-    n_recv = recv(sockfd, (char *)buffer, 1024, 0);
-    if (debug) fprintf(stderr, "Confirmation received (%d bytes packet)\n", n_recv);
-
-    sleep(1);
-
-    // Read file and send to stdout
-    if (stdout_output == 1) {
-        fp = fopen(filename, "r");
-        if (fp == NULL)
-            return -1;
+    // With -f exit when the file is complete, otherwise send it to stdout
+    ret = wait_file(ifd, sockfd, filename, name, stdout_output ? STDOUT_FILENO : -1, timeout);
 
-        while ((n_read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
-            fwrite(buffer, 1, n_read, stdout);
-
-        fclose(fp);
+    close(sockfd);
+    close(ifd);
+    if (stdout_output == 1)
         remove(filename);
-    }
+    if (ret < 0)
+        return ret;
+
     if (debug) fprintf(stderr, "Program completed successfully\n");
 
     return 0;
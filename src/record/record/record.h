@@ -24,3 +24,10 @@
 #define LOCAL_IP "127.0.0.1"
 #define AVENCODE_IP "127.0.0.1"
 #define AVENCODE_PORT 12000
+
+// Temporary file when the mp4 is sent to stdout
+#define RECORD_TMP_DIR "/tmp"
+// Max time without new data from the encoder, in ms
+#define RECORD_TIMEOUT 10000
+// Max wait between two checks of the file, in ms
+#define RECORD_CHECK_INTERVAL 200
@@ -1,9 +1,110 @@
 #include "add_water.h"
 
-int WMInit(WaterMarkInfo *WM_info, char WMPath[30])
+/*
+ * The glyphs converted to yuv420sp are cached in an atlas file:
+ * a header followed by the y, alpha and c planes of every glyph.
+ * The atlas is mapped read-only, so the pages are shared by all the
+ * processes that add a watermark.
+ */
+static void WMAtlasName(char *name, int size, const char *WMPath)
+{
+    int i, n;
+
+    n = snprintf(name, size, "%s/wm", WM_ATLAS_DIR);
+    for (i = 0; (WMPath[i] != '\0') && (n < size - 1); i++, n++)
+        name[n] = (WMPath[i] == '/') ? '_' : WMPath[i];
+    name[n] = '\0';
+    strncat(name, ".atlas", size - n - 1);
+}
+
+static int WMAtlasMap(WaterMarkInfo *WM_info, const char *name)
+{
+    int fd, i;
+    struct stat st;
+    WMAtlasHeader *header;
+    unsigned char *p;
+    unsigned int pic_size;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if ((fstat(fd, &st) < 0) || (st.st_size < sizeof(WMAtlasHeader))) {
+        close(fd);
+        return -1;
+    }
+    p = (unsigned char *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    header = (WMAtlasHeader *) p;
+    pic_size = header->width * header->height * 5 / 2;
+    if ((header->magic != WM_ATLAS_MAGIC) || (header->number != WM_PIC_NUM) ||
+            (st.st_size != sizeof(WMAtlasHeader) + header->number * pic_size)) {
+        munmap(p, st.st_size);
+        return -1;
+    }
+
+    WM_info->width = header->width;
+    WM_info->height = header->height;
+    p += sizeof(WMAtlasHeader);
+    for (i = 0; i < header->number; i++) {
+        WM_info->single_pic[i].id = i;
+        WM_info->single_pic[i].y = p + i * pic_size;
+        WM_info->single_pic[i].alph = WM_info->single_pic[i].y + WM_info->width * WM_info->height;
+        WM_info->single_pic[i].c = WM_info->single_pic[i].alph + WM_info->width * WM_info->height;
+    }
+    WM_info->picture_number = header->number;
+    WM_info->atlas = header;
+    WM_info->atlas_size = st.st_size;
+
+    return 0;
+}
+
+static int WMAtlasWrite(WaterMarkInfo *WM_info, const char *name)
+{
+    char tmp[256];
+    FILE *fp;
+    WMAtlasHeader header;
+    unsigned int pic_size;
+    int i;
+
+    // Write a temporary file, other processes see only complete atlases
+    snprintf(tmp, sizeof(tmp), "%s.%d", name, getpid());
+    fp = fopen(tmp, "w");
+    if (fp == NULL)
+        return -1;
+
+    header.magic = WM_ATLAS_MAGIC;
+    header.width = WM_info->width;
+    header.height = WM_info->height;
+    header.number = WM_info->picture_number;
+    pic_size = header.width * header.height * 5 / 2;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        unlink(tmp);
+        return -1;
+    }
+    for (i = 0; i < header.number; i++) {
+        if (fwrite(WM_info->single_pic[i].y, pic_size, 1, fp) != 1) {
+            fclose(fp);
+            unlink(tmp);
+            return -1;
+        }
+    }
+    if (fclose(fp) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    return rename(tmp, name);
+}
+
+static int WMLoadBMP(WaterMarkInfo *WM_info, char *WMPath)
 {
     int i;
-    int watermark_pic_num = 13;
+    int watermark_pic_num = WM_PIC_NUM;
     char filename[64];
     FILE *icon_hdle = NULL;
     unsigned char *tmp_argb = NULL;
@@ -20,6 +121,9 @@ int WMInit(WaterMarkInfo *WM_info, char WMPath[30])
         icon_hdle = fopen(filename, "r");
         if (icon_hdle == NULL) {
             fprintf(stderr, "get watermark %s error\n", filename);
+            if (tmp_argb != NULL)
+                free(tmp_argb);
+            WMRelease(WM_info);
             return -1;
         }
 
@@ -59,11 +163,38 @@ int WMInit(WaterMarkInfo *WM_info, char WMPath[30])
     return 0;
 }
 
+int WMInit(WaterMarkInfo *WM_info, char WMPath[30])
+{
+    char name[256];
+
+    memset(WM_info, 0, sizeof(WaterMarkInfo));
+
+    WMAtlasName(name, sizeof(name), WMPath);
+    if (WMAtlasMap(WM_info, name) == 0)
+        return 0;
+
+    // First run: convert the bmp files and create the atlas
+    if (WMLoadBMP(WM_info, WMPath) < 0)
+        return -1;
+    if (WMAtlasWrite(WM_info, name) < 0)
+        fprintf(stderr, "unable to write watermark atlas %s\n", name);
+
+    return 0;
+}
+
 int WMRelease(WaterMarkInfo *WM_info)
 {
-    int watermark_pic_num = 13;
+    int watermark_pic_num = WM_PIC_NUM;
     int i;
 
+    if (WM_info->atlas != NULL) {
+        munmap(WM_info->atlas, WM_info->atlas_size);
+        WM_info->atlas = NULL;
+        for (i = 0; i < watermark_pic_num; i++)
+            WM_info->single_pic[i].y = NULL;
+        return 0;
+    }
+
     for (i = 0; i < watermark_pic_num; i++) {
         if (WM_info->single_pic[i].y) {
             free(WM_info->single_pic[i].y);
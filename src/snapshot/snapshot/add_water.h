@@ -19,6 +19,20 @@
 #include <errno.h>
 #include "water_mark.h"
 
+#define WM_PIC_NUM      13
+
+// Cache of the converted glyphs, one file for each resource path
+#define WM_ATLAS_DIR    "/tmp"
+#define WM_ATLAS_MAGIC  0x31414D57  // "WMA1"
+
+typedef struct WMAtlasHeader
+{
+    unsigned int magic;
+    unsigned int width;
+    unsigned int height;
+    unsigned int number;
+}WMAtlasHeader;
+
 int WMInit(WaterMarkInfo *WM_info, char WMPath[30]);
 int WMRelease(WaterMarkInfo *WM_info);
 int AddWM (WaterMarkInfo *WM_info, unsigned int bg_width, unsigned int bg_height, void *bg_y_vir,
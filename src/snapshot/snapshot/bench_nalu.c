@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compare the start code search that imggrabber used before nalu.c with
+ * the nalu_next() scan that replaced it.
+ * Both searches run on the same buffer (a h264/h265 frame file as written
+ * by the grabber, or a synthetic h264 frame) and must find the same
+ * parameter sets and IDR; the time of each pass is printed.
+ *
+ * Build on the host with "make bench_nalu".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nalu.h"
+
+#define DEFAULT_LOOPS          200
+#define SYNTH_SIZE             (256 * 1024)
+#define PADDING                8
+
+typedef struct {
+    int vps;
+    int sps;
+    int pps;
+    int idr;
+    int codec;
+} result_t;
+
+/*
+ * The search of the old imggrabber, unchanged apart from the variables.
+ * It needs 4 bytes of padding after the buffer.
+ */
+static void old_search(unsigned char *h26x_file_buffer, long h26x_file_size, result_t *r)
+{
+    int sps_start_found = -1, sps_end_found = -1;
+    int pps_start_found = -1, pps_end_found = -1;
+    int vps_start_found = -1, vps_end_found = -1;
+    int idr_start_found = -1;
+    int i, j, f, start_code, is_hevc = 0;
+
+    for (f=0; f<h26x_file_size; f++) {
+        for (i=f; i<h26x_file_size; i++) {
+            if(h26x_file_buffer[i] == 0 && h26x_file_buffer[i+1] == 0 && h26x_file_buffer[i+2] == 0 && h26x_file_buffer[i+3] == 1) {
+                start_code = 4;
+            } else {
+                continue;
+            }
+
+            if ((h26x_file_buffer[i+start_code]&0x7E) == 0x40) {
+                is_hevc = 1;
+                vps_start_found = i;
+                break;
+            } else if ((h26x_file_buffer[i+start_code]&0x1F) == 0x7) {
+                is_hevc = 0;
+                sps_start_found = i;
+                break;
+            } else if ((h26x_file_buffer[i+start_code]&0x7E) == 0x42) {
+                is_hevc = 1;
+                sps_start_found = i;
+                break;
+            } else if ((is_hevc == 0) && ((h26x_file_buffer[i+start_code]&0x1F) == 0x8)) {
+                pps_start_found = i;
+                break;
+            } else if ((is_hevc == 1) && ((h26x_file_buffer[i+start_code]&0x7E) == 0x44)) {
+                pps_start_found = i;
+                break;
+            } else if (((h26x_file_buffer[i+start_code]&0x1F) == 0x5) || ((h26x_file_buffer[i+start_code]&0x7E) == 0x26)) {
+                idr_start_found = i;
+                break;
+            }
+        }
+        for (j = i + 4; j<h26x_file_size; j++) {
+            if (h26x_file_buffer[j] == 0 && h26x_file_buffer[j+1] == 0 && h26x_file_buffer[j+2] == 0 && h26x_file_buffer[j+3] == 1) {
+                start_code = 4;
+            } else {
+                continue;
+            }
+
+            if ((h26x_file_buffer[j+start_code]&0x7E) == 0x42) {
+                vps_end_found = j;
+                break;
+            } else if ((is_hevc == 0) && ((h26x_file_buffer[j+start_code]&0x1F) == 0x8)) {
+                sps_end_found = j;
+                break;
+            } else if ((is_hevc == 1) && ((h26x_file_buffer[j+start_code]&0x7E) == 0x44)) {
+                sps_end_found = j;
+                break;
+            } else if (((h26x_file_buffer[j+start_code]&0x1F) == 0x5) || ((h26x_file_buffer[j+start_code]&0x7E) == 0x26)) {
+                pps_end_found = j;
+                break;
+            }
+        }
+        f = j - 1;
+    }
+
+    // The end offsets are only used for the lengths
+    (void) sps_end_found;
+    (void) pps_end_found;
+    (void) vps_end_found;
+
+    r->vps = vps_start_found;
+    r->sps = sps_start_found;
+    r->pps = pps_start_found;
+    r->idr = idr_start_found;
+    r->codec = is_hevc ? NALU_CODEC_HEVC : NALU_CODEC_H264;
+}
+
+// The search of the current imggrabber
+static void new_search(const unsigned char *buf, int size, result_t *r)
+{
+    nalu_t nalu;
+    int pos = 0;
+
+    r->vps = r->sps = r->pps = r->idr = -1;
+    r->codec = nalu_detect_codec(buf, size);
+
+    while ((pos = nalu_next(buf, pos, size, r->codec, &nalu)) >= 0) {
+        if ((r->codec == NALU_CODEC_HEVC) && (nalu.type == NALU_HEVC_VPS)) {
+            if (r->vps < 0) r->vps = nalu.offset;
+        } else if (((r->codec == NALU_CODEC_HEVC) && (nalu.type == NALU_HEVC_SPS)) ||
+                ((r->codec == NALU_CODEC_H264) && (nalu.type == NALU_H264_SPS))) {
+            if (r->sps < 0) r->sps = nalu.offset;
+        } else if (((r->codec == NALU_CODEC_HEVC) && (nalu.type == NALU_HEVC_PPS)) ||
+                ((r->codec == NALU_CODEC_H264) && (nalu.type == NALU_H264_PPS))) {
+            if (r->pps < 0) r->pps = nalu.offset;
+        } else if (nalu_is_idr(r->codec, nalu.type) && (r->sps >= 0) && (r->pps >= 0)) {
+            r->idr = nalu.offset;
+            break;
+        }
+    }
+}
+
+static int put_nalu(unsigned char *buf, int pos, unsigned char header, int len)
+{
+    int i;
+
+    buf[pos++] = 0;
+    buf[pos++] = 0;
+    buf[pos++] = 0;
+    buf[pos++] = 1;
+    buf[pos++] = header;
+    for (i = 1; i < len; i++, pos++) {
+        buf[pos] = rand() & 0xFF;
+        // Emulation prevention: no start code inside the payload
+        if ((buf[pos - 1] == 0) && (buf[pos - 2] == 0) && (buf[pos] <= 3))
+            buf[pos] = 3;
+    }
+
+    return pos;
+}
+
+// SPS, PPS and an IDR slice that fills the rest of the buffer
+static int synth_frame(unsigned char *buf, int size)
+{
+    int pos = 0;
+
+    srand(1);
+    pos = put_nalu(buf, pos, 0x67, 20);
+    pos = put_nalu(buf, pos, 0x68, 4);
+    pos = put_nalu(buf, pos, 0x65, size - pos - 5);
+
+    return pos;
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned char *buf;
+    long size;
+    FILE *f;
+    result_t r_old, r_new;
+    double t_old, t_new, t;
+    int loops = DEFAULT_LOOPS;
+    int i;
+
+    if ((argc > 1) && (strcmp(argv[1], "-h") == 0)) {
+        fprintf(stderr, "Usage: %s [FRAME_FILE [LOOPS]]\n", argv[0]);
+        return -1;
+    }
+    if (argc > 2)
+        loops = atoi(argv[2]);
+    if (loops <= 0)
+        loops = DEFAULT_LOOPS;
+
+    if (argc > 1) {
+        f = fopen(argv[1], "r");
+        if (f == NULL) {
+            fprintf(stderr, "Unable to open %s\n", argv[1]);
+            return -1;
+        }
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        buf = (unsigned char *) calloc(1, size + PADDING);
+        if ((buf == NULL) || (fread(buf, 1, size, f) != size)) {
+            fprintf(stderr, "Unable to read %s\n", argv[1]);
+            fclose(f);
+            return -1;
+        }
+        fclose(f);
+    } else {
+        buf = (unsigned char *) calloc(1, SYNTH_SIZE + PADDING);
+        if (buf == NULL) {
+            fprintf(stderr, "Unable to allocate memory\n");
+            return -1;
+        }
+        size = synth_frame(buf, SYNTH_SIZE);
+    }
+
+    old_search(buf, size, &r_old);
+    new_search(buf, size, &r_new);
+
+    printf("file: %s, %ld bytes, %d loops\n", (argc > 1) ? argv[1] : "synthetic h264", size, loops);
+    printf("old: codec h26%d vps %d sps %d pps %d idr %d\n",
+            r_old.codec, r_old.vps, r_old.sps, r_old.pps, r_old.idr);
+    printf("new: codec h26%d vps %d sps %d pps %d idr %d\n",
+            r_new.codec, r_new.vps, r_new.sps, r_new.pps, r_new.idr);
+
+    t = now_ms();
+    for (i = 0; i < loops; i++)
+        old_search(buf, size, &r_old);
+    t_old = (now_ms() - t) / loops;
+
+    t = now_ms();
+    for (i = 0; i < loops; i++)
+        new_search(buf, size, &r_new);
+    t_new = (now_ms() - t) / loops;
+
+    printf("old: %.3f ms/pass\n", t_old);
+    printf("new: %.3f ms/pass (%.1fx)\n", t_new, (t_new > 0) ? t_old / t_new : 0);
+
+    free(buf);
+
+    if (memcmp(&r_old, &r_new, sizeof(result_t)) != 0) {
+        printf("MISMATCH\n");
+        return 1;
+    }
+
+    return 0;
+}
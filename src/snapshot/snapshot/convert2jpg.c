@@ -22,6 +22,8 @@
 
 extern int camera_dbg_en;
 
+int jpeg_raw_input = 1;
+
 /**
  * Converts a YUYV raw buffer to a JPEG buffer.
  * Input is YUYV (YUV 420SP NV12). Output is JPEG binary.
@@ -38,7 +40,7 @@ int YUVtoJPG(char *output_file, unsigned char *input, const int width, const int
     uint8_t* outbuffer = NULL;
     unsigned long outlen = 0;
 
-    unsigned int wsl, hsl, i, j;
+    unsigned int wsl, hsl, i;
     unsigned int offset;
     unsigned int uv;
 
@@ -73,26 +75,68 @@ int YUVtoJPG(char *output_file, unsigned char *input, const int width, const int
     } else {
         jpeg_set_quality(&cinfo, quality, TRUE);
     }
-    jpeg_start_compress(&cinfo, TRUE);
 
-    uint8_t tmprowbuf[dest_width * 3];
+    // The raw path needs whole 4:2:0 MCUs and a crop aligned to the chroma
+    if (jpeg_raw_input && ((dest_width % 16) == 0) && ((wsl % 4) == 0) && ((hsl % 4) == 0)) {
+        // Feed libjpeg with the planes, chroma is already subsampled
+        JSAMPROW y_rows[16], u_rows[8], v_rows[8];
+        JSAMPARRAY planes[3] = { y_rows, u_rows, v_rows };
+        uint8_t *uv_buf;
+        unsigned int row;
+
+        cinfo.raw_data_in = TRUE;
+        cinfo.comp_info[0].h_samp_factor = 2;
+        cinfo.comp_info[0].v_samp_factor = 2;
+        cinfo.comp_info[1].h_samp_factor = 1;
+        cinfo.comp_info[1].v_samp_factor = 1;
+        cinfo.comp_info[2].h_samp_factor = 1;
+        cinfo.comp_info[2].v_samp_factor = 1;
+        jpeg_start_compress(&cinfo, TRUE);
+
+        uv_buf = (uint8_t *) malloc(dest_width * 8);
+        if (uv_buf == NULL) {
+            jpeg_abort_compress(&cinfo);
+            jpeg_destroy_compress(&cinfo);
+            free(outbuffer);
+            return -1;
+        }
+
+        while (cinfo.next_scanline < cinfo.image_height) {
+            // Rows past the bottom repeat the last one
+            for (i = 0; i < 16; i++) {
+                row = cinfo.next_scanline + i;
+                if (row >= dest_height) row = dest_height - 1;
+                y_rows[i] = input + (row + hsl/2) * width + wsl/2;
+            }
+            for (i = 0; i < 8; i++) {
+                row = cinfo.next_scanline / 2 + i;
+                if (row >= dest_height / 2) row = dest_height / 2 - 1;
+                u_rows[i] = uv_buf + i * dest_width;
+                v_rows[i] = uv_buf + i * dest_width + dest_width / 2;
+                yuv_split_uv_row(u_rows[i], v_rows[i], input + width * height + (row + hsl/4) * width + wsl/2, dest_width);
+            }
+            jpeg_write_raw_data(&cinfo, planes, 16);
+        }
+
+        free(uv_buf);
+    } else {
+        jpeg_start_compress(&cinfo, TRUE);
+
+        uint8_t tmprowbuf[dest_width * 3];
 
-    JSAMPROW row_pointer[1];
-    row_pointer[0] = &tmprowbuf[0];
+        JSAMPROW row_pointer[1];
+        row_pointer[0] = &tmprowbuf[0];
 
-    while (cinfo.next_scanline < cinfo.image_height) {
-        offset = (cinfo.next_scanline + hsl/2) * width + wsl/2;                 //offset to the correct y row
-        uv = width * (height - (cinfo.next_scanline + hsl/2 + 1) / 2) + wsl/2;  //offset to the correct uv row
+        // The uv offset must start on a U byte: crop 1 pixel less on the left if needed
+        wsl &= ~3U;
 
-        for (i = 0, j = 0; i < cinfo.image_width; i += 2, j += 6) { //input strides by 2 bytes, output strides by 6 (2 pixels)
-            tmprowbuf[j + 0] = input[offset + i];          // Y (unique to this pixel)
-            tmprowbuf[j + 1] = input[offset + uv + i];     // U (shared between pixels)
-            tmprowbuf[j + 2] = input[offset + uv + i + 1]; // V (shared between pixels)
-            tmprowbuf[j + 3] = input[offset + i + 1];      // Y (unique to this pixel)
-            tmprowbuf[j + 4] = input[offset + uv + i];     // U (shared between pixels)
-            tmprowbuf[j + 5] = input[offset + uv + i + 1]; // V (shared between pixels)
+        while (cinfo.next_scanline < cinfo.image_height) {
+            offset = (cinfo.next_scanline + hsl/2) * width + wsl/2;                         //offset to the correct y row
+            uv = width * height + ((cinfo.next_scanline + hsl/2) / 2) * width + wsl/2;      //offset to the correct uv row
+
+            yuv_nv12_to_ycbcr_row(tmprowbuf, input + offset, input + uv, dest_width);
+            jpeg_write_scanlines(&cinfo, row_pointer, 1);
         }
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
     }
 
     jpeg_finish_compress(&cinfo);
@@ -102,11 +146,14 @@ int YUVtoJPG(char *output_file, unsigned char *input, const int width, const int
         fwrite(outbuffer, 1, outlen, stdout);
     else {
         fp = fopen(output_file, "wb");
-        if (fp == NULL)
+        if (fp == NULL) {
+            free(outbuffer);
             return -1;
+        }
         fwrite(outbuffer, 1, outlen, fp);
         fclose(fp);
     }
+    free(outbuffer);
 
     return outlen;
 }
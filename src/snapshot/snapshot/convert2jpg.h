@@ -25,7 +25,12 @@
 
 #include <jpeglib.h>
 
+#include "yuv.h"
+
 #define JPEG_QUALITY 90
 
+// Use jpeg_write_raw_data() when the size allows it, scanlines otherwise
+extern int jpeg_raw_input;
+
 int YUVtoJPG(char * output_file, unsigned char *input, const int width, const int height, const int dest_width, const int dest_height, const int quality);
 int convert2jpg(char *output_file, char *input_file, const int width, const int height, const int dest_width, const int dest_height, const int quality);
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * h264/h265 i-frame decoder that keeps the codec contexts open.
+ * The contexts are opened at the first frame of each codec and reused
+ * for the following ones, the decoder is flushed after every frame.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_AV_CONFIG_H
+#undef HAVE_AV_CONFIG_H
+#endif
+
+#include "libavcodec/avcodec.h"
+
+#include "decoder.h"
+#include "nalu.h"
+#include "yuv.h"
+
+extern int debug;
+
+static AVCodecContext *ctx_h264 = NULL;
+static AVCodecContext *ctx_hevc = NULL;
+static AVFrame *picture = NULL;
+
+static AVCodecContext *decoder_open(int codec_type)
+{
+    AVCodec *codec;
+    AVCodecContext *c;
+
+    if (codec_type == NALU_CODEC_H264) {
+        codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+        if (!codec) {
+            if (debug) fprintf(stderr, "Codec h264 not found\n");
+            return NULL;
+        }
+    } else {
+        codec = avcodec_find_decoder(AV_CODEC_ID_HEVC);
+        if (!codec) {
+            if (debug) fprintf(stderr, "Codec hevc not found\n");
+            return NULL;
+        }
+    }
+
+    c = avcodec_alloc_context3(codec);
+    if (c == NULL)
+        return NULL;
+
+    if (avcodec_open2(c, codec, NULL) < 0) {
+        if (debug) fprintf(stderr, "Could not open codec\n");
+        avcodec_free_context(&c);
+        return NULL;
+    }
+
+    return c;
+}
+
+/*
+ * Decode the i-frame in p (length bytes plus AV_INPUT_BUFFER_PADDING_SIZE
+ * zeroed bytes) and write it to outbuffer in NV12 format.
+ * Return 0 on success, a negative value on error.
+ */
+int decoder_decode(unsigned char *outbuffer, int outsize, unsigned char *p, int length, int codec,
+        int *width, int *height)
+{
+    AVCodecContext *c;
+    AVPacket avpkt;
+    int ret;
+
+    if (codec == NALU_CODEC_H264) {
+        if (ctx_h264 == NULL)
+            ctx_h264 = decoder_open(codec);
+        c = ctx_h264;
+    } else {
+        if (ctx_hevc == NULL)
+            ctx_hevc = decoder_open(codec);
+        c = ctx_hevc;
+    }
+    if (c == NULL)
+        return -1;
+
+    if (picture == NULL) {
+        picture = av_frame_alloc();
+        if (picture == NULL)
+            return -1;
+    }
+
+    av_init_packet(&avpkt);
+    avpkt.data = p;
+    avpkt.size = length;
+
+    if (debug) fprintf(stderr, "Decode frame\n");
+    ret = avcodec_send_packet(c, &avpkt);
+    if (ret < 0) {
+        if (debug) fprintf(stderr, "Error decoding frame\n");
+        avcodec_flush_buffers(c);
+        return -2;
+    }
+    ret = avcodec_receive_frame(c, picture);
+    if (ret == AVERROR(EAGAIN)) {
+        // The decoder is holding the frame, drain it
+        avcodec_send_packet(c, NULL);
+        ret = avcodec_receive_frame(c, picture);
+    }
+    // Ready for the next frame, also leaves draining mode
+    avcodec_flush_buffers(c);
+    if (ret < 0) {
+        if (debug) fprintf(stderr, "No input frame\n");
+        return -2;
+    }
+
+    if (picture->width * picture->height * 3 / 2 > outsize) {
+        if (debug) fprintf(stderr, "Frame too big: %dx%d\n", picture->width, picture->height);
+        av_frame_unref(picture);
+        return -3;
+    }
+    *width = picture->width;
+    *height = picture->height;
+
+    if (debug) fprintf(stderr, "Writing yuv buffer\n");
+    yuv_i420_to_nv12(outbuffer, picture->width, picture->height,
+            picture->data[0], picture->linesize[0],
+            picture->data[1], picture->linesize[1],
+            picture->data[2], picture->linesize[2]);
+    av_frame_unref(picture);
+
+    return 0;
+}
+
+void decoder_close(void)
+{
+    av_frame_free(&picture);
+    avcodec_free_context(&ctx_h264);
+    avcodec_free_context(&ctx_hevc);
+}
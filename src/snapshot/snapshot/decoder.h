@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2020 roleo.
+ * Copyright (c) 2022 roleo.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -15,14 +15,14 @@
  */
 
 /*
- * Create a jpg snapshot.
+ * h264/h265 i-frame decoder that keeps the codec contexts open.
  */
 
-#define MSG_SIZE 288
+#ifndef DECODER_H
+#define DECODER_H
 
-#define MSG_PART_1 "\x44\x59\x30\x31\x18\x01\x00\x00\xF1\x03\x00\x00\x88\x77\xB0\x7E\x88\x12\xF6\x76\xB8\x7D\xB0\x7E"
-#define MSG_PART_3 "\x01\x01\xB0\x7E"
+int decoder_decode(unsigned char *outbuffer, int outsize, unsigned char *p, int length, int codec,
+        int *width, int *height);
+void decoder_close(void);
 
-#define LOCAL_IP "127.0.0.1"
-#define AVENCODE_IP "127.0.0.1"
-#define AVENCODE_PORT 11000
+#endif // DECODER_H
@@ -25,6 +25,10 @@
 #include <getopt.h>
 #include <limits.h>
 #include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 
 #ifdef HAVE_AV_CONFIG_H
 #undef HAVE_AV_CONFIG_H
@@ -34,8 +38,12 @@
 
 #include "convert2jpg.h"
 #include "add_water.h"
+#include "decoder.h"
+#include "mp4demux.h"
+#include "nalu.h"
+#include "yuv_scale.h"
 
-#define FF_INPUT_BUFFER_PADDING_SIZE 32
+#define FF_INPUT_BUFFER_PADDING_SIZE AV_INPUT_BUFFER_PADDING_SIZE
 
 #define RESOLUTION_LOW  360
 #define RESOLUTION_HIGH 1080
@@ -72,140 +80,340 @@ struct __attribute__((__packed__)) frame_header {
 int res;
 int debug;
 
-int frame_decode(unsigned char *outbuffer, unsigned char *p, int length, int h26x)
+// Output size, 0 to keep the size of the frame
+static int dest_width, dest_height;
+static unsigned char *bufferdest;
+
+// Number of jpeg encodes to measure, 0 to disable
+static int bench;
+
+static WaterMarkInfo wm_info;
+static int wm_width;
+
+/*
+ * Read the h26x file and copy the parameter sets and the first i-frame
+ * in a new buffer, padded for libavcodec.
+ * Return 0 on success, a negative value on error.
+ */
+int load_h26x(char *file, unsigned char **buffer, int *length, int *codec)
 {
-    AVCodec *codec;
-    AVCodecContext *c= NULL;
-    AVFrame *picture;
-    int got_picture, len;
-    FILE *fOut;
-    uint8_t *inbuf;
-    AVPacket avpkt;
-    int i, j, size;
-
-//////////////////////////////////////////////////////////
-//                    Reading H264                      //
-//////////////////////////////////////////////////////////
-
-    if (debug) fprintf(stderr, "Starting decode\n");
-
-    av_init_packet(&avpkt);
-
-    if (h26x == 4) {
-        codec = avcodec_find_decoder(AV_CODEC_ID_H264);
-        if (!codec) {
-            if (debug) fprintf(stderr, "Codec h264 not found\n");
-            return -2;
-        }
-    } else {
-        codec = avcodec_find_decoder(AV_CODEC_ID_HEVC);
-        if (!codec) {
-            if (debug) fprintf(stderr, "Codec hevc not found\n");
-            return -2;
-        }
-    }
+    FILE *fHF;
+    unsigned char *bufferh26x;
+    struct frame_header fhs, fhp, fhv, fhi;
+    unsigned char *fhs_addr, *fhp_addr, *fhv_addr, *fhi_addr;
 
-    c = avcodec_alloc_context3(codec);
-    picture = av_frame_alloc();
+    nalu_t nalu;
+    int pos;
+    struct timeval tv_start, tv_end;
+    unsigned char *h26x_file_buffer;
+    long h26x_file_size;
+    size_t nread;
 
-    if((codec->capabilities) & AV_CODEC_CAP_TRUNCATED)
-        (c->flags) |= AV_CODEC_FLAG_TRUNCATED;
+    // Read frames from h26x file
+    fhs.len = 0;
+    fhp.len = 0;
+    fhv.len = 0;
+    fhi.len = 0;
+    fhs_addr = NULL;
+    fhp_addr = NULL;
+    fhv_addr = NULL;
+    fhi_addr = NULL;
 
-    if (avcodec_open2(c, codec, NULL) < 0) {
-        if (debug) fprintf(stderr, "Could not open codec h264\n");
-        av_free(c);
-        return -2;
+    fHF = fopen(file, "r");
+    if ( fHF == NULL ) {
+        fprintf(stderr, "Could not get size of %s\n", file);
+        return -6;
     }
+    fseek(fHF, 0, SEEK_END);
+    h26x_file_size = ftell(fHF);
+    fseek(fHF, 0, SEEK_SET);
+    h26x_file_buffer = (unsigned char *) malloc(h26x_file_size);
+    if (h26x_file_buffer == NULL) {
+        fclose(fHF);
+        fprintf(stderr, "Unable to allocate memory\n");
+        return -9;
+    }
+    nread = fread(h26x_file_buffer, 1, h26x_file_size, fHF);
+    fclose(fHF);
+    if (debug) fprintf(stderr, "The size of the file is %ld\n", h26x_file_size);
 
-    // inbuf is already allocated in the main function
-    inbuf = p;
-    memset(inbuf + length, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-
-    // Get only 1 frame
-    memcpy(inbuf, p, length);
-    avpkt.size = length;
-    avpkt.data = inbuf;
+    if (nread != h26x_file_size) {
+        fprintf(stderr, "Read error %s\n", file);
+        free(h26x_file_buffer);
+        return -7;
+    }
 
-    // Decode frame
-    if (debug) fprintf(stderr, "Decode frame\n");
-    if (c->codec_type == AVMEDIA_TYPE_VIDEO ||
-         c->codec_type == AVMEDIA_TYPE_AUDIO) {
+    if (debug) gettimeofday(&tv_start, NULL);
 
-        len = avcodec_send_packet(c, &avpkt);
-        if (len < 0 && len != AVERROR(EAGAIN) && len != AVERROR_EOF) {
-            if (debug) fprintf(stderr, "Error decoding frame\n");
-            return -2;
-        } else {
-            if (len >= 0)
-                avpkt.size = 0;
-            len = avcodec_receive_frame(c, picture);
-            if (len >= 0)
-                got_picture = 1;
+    *codec = nalu_detect_codec(h26x_file_buffer, h26x_file_size);
+    pos = 0;
+    while ((pos = nalu_next(h26x_file_buffer, pos, h26x_file_size, *codec, &nalu)) >= 0) {
+        if ((*codec == NALU_CODEC_HEVC) && (nalu.type == NALU_HEVC_VPS)) {
+            if (fhv_addr == NULL) {
+                fhv.len = nalu.len;
+                fhv_addr = &h26x_file_buffer[nalu.offset];
+            }
+        } else if (((*codec == NALU_CODEC_HEVC) && (nalu.type == NALU_HEVC_SPS)) ||
+                ((*codec == NALU_CODEC_H264) && (nalu.type == NALU_H264_SPS))) {
+            if (fhs_addr == NULL) {
+                fhs.len = nalu.len;
+                fhs_addr = &h26x_file_buffer[nalu.offset];
+            }
+        } else if (((*codec == NALU_CODEC_HEVC) && (nalu.type == NALU_HEVC_PPS)) ||
+                ((*codec == NALU_CODEC_H264) && (nalu.type == NALU_H264_PPS))) {
+            if (fhp_addr == NULL) {
+                fhp.len = nalu.len;
+                fhp_addr = &h26x_file_buffer[nalu.offset];
+            }
+        } else if (nalu_is_idr(*codec, nalu.type) && (fhs_addr != NULL) && (fhp_addr != NULL)) {
+            // The frame goes from the IDR to the end of the file
+            fhi.len = h26x_file_size - nalu.offset;
+            fhi_addr = &h26x_file_buffer[nalu.offset];
+            break;
         }
     }
-    if(!got_picture) {
-        if (debug) fprintf(stderr, "No input frame\n");
-        av_frame_free(&picture);
-        avcodec_close(c);
-        av_free(c);
-        return -2;
+
+    if (debug) {
+        gettimeofday(&tv_end, NULL);
+        fprintf(stderr, "Scan completed in %ld us\n",
+                (tv_end.tv_sec - tv_start.tv_sec) * 1000000L + (tv_end.tv_usec - tv_start.tv_usec));
     }
 
-    if (debug) fprintf(stderr, "Writing yuv buffer\n");
-    memset(outbuffer, 0x80, c->width * c->height * 3 / 2);
-    memcpy(outbuffer, picture->data[0], c->width * c->height);
-    for(i=0; i<c->height/2; i++) {
-        for(j=0; j<c->width/2; j++) {
-            outbuffer[c->width * c->height + c->width * i +  2 * j] = *(picture->data[1] + i * picture->linesize[1] + j);
-            outbuffer[c->width * c->height + c->width * i +  2 * j + 1] = *(picture->data[2] + i * picture->linesize[2] + j);
+    if ((fhi_addr != NULL) && ((*codec == NALU_CODEC_H264) || (fhv_addr != NULL))) {
+        if (debug) {
+            fprintf(stderr, "Found SPS at %d, len %d\n", (int) (fhs_addr - h26x_file_buffer), fhs.len);
+            fprintf(stderr, "Found PPS at %d, len %d\n", (int) (fhp_addr - h26x_file_buffer), fhp.len);
+            if (fhv_addr != NULL) {
+                fprintf(stderr, "Found VPS at %d, len %d\n", (int) (fhv_addr - h26x_file_buffer), fhv.len);
+            }
+            fprintf(stderr, "Found IDR at %d, len %d\n", (int) (fhi_addr - h26x_file_buffer), fhi.len);
         }
+    } else {
+        if (debug) fprintf(stderr, "No frame found\n");
+        free(h26x_file_buffer);
+        return -8;
+    }
+
+    // Add FF_INPUT_BUFFER_PADDING_SIZE to make the size compatible with ffmpeg conversion
+    bufferh26x = (unsigned char *) malloc(fhv.len + fhs.len + fhp.len + fhi.len + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (bufferh26x == NULL) {
+        fprintf(stderr, "Unable to allocate memory\n");
+        free(h26x_file_buffer);
+        return -9;
+    }
+
+    if (fhv_addr != NULL) {
+        memcpy(bufferh26x, fhv_addr, fhv.len);
     }
+    memcpy(bufferh26x + fhv.len, fhs_addr, fhs.len);
+    memcpy(bufferh26x + fhv.len + fhs.len, fhp_addr, fhp.len);
+    memcpy(bufferh26x + fhv.len + fhs.len + fhp.len, fhi_addr, fhi.len);
+    *length = fhv.len + fhs.len + fhp.len + fhi.len;
+    memset(bufferh26x + *length, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+
+    free(h26x_file_buffer);
 
-    // Clean memory
-    if (debug) fprintf(stderr, "Cleaning ffmpeg memory\n");
-    av_frame_free(&picture);
-    avcodec_close(c);
-    av_free(c);
+    *buffer = bufferh26x;
 
     return 0;
 }
 
+/*
+ * Load the watermark resources at the first image, they are kept in
+ * memory for the following ones.
+ */
 int add_watermark(unsigned char *buffer, int w_res, int h_res)
 {
     char path_res[1024];
-    FILE *fBuf;
-    WaterMarkInfo WM_info;
+
+    if (wm_width != w_res) {
+        if (wm_width != 0) {
+            WMRelease(&wm_info);
+            wm_width = 0;
+        }
+        if (w_res != W_LOW) {
+            strcpy(path_res, PATH_RES_HIGH);
+        } else {
+            strcpy(path_res, PATH_RES_LOW);
+        }
+        if (WMInit(&wm_info, path_res) < 0) {
+            fprintf(stderr, "water mark init error\n");
+            return -1;
+        }
+        wm_width = w_res;
+    }
 
     if (w_res != W_LOW) {
-        strcpy(path_res, PATH_RES_HIGH);
+        AddWM(&wm_info, w_res, h_res, buffer,
+            buffer + w_res*h_res, w_res-460, h_res-40, NULL);
     } else {
-        strcpy(path_res, PATH_RES_LOW);
+        AddWM(&wm_info, w_res, h_res, buffer,
+            buffer + w_res*h_res, w_res-230, h_res-20, NULL);
     }
 
-    if (WMInit(&WM_info, path_res) < 0) {
-        fprintf(stderr, "water mark init error\n");
-        return -1;
+    return 0;
+}
+
+/*
+ * Extract the i-frame from file (h26x or mp4), decode it and write the
+ * jpg to output ("stdout" or a file name).
+ * Return 0 on success, a negative value on error.
+ */
+int grab_frame(char *file, char *output, unsigned char *bufferyuv, int yuvsize,
+        int quality, int watermark, long *decode_time)
+{
+    unsigned char *bufferh26x;
+    mp4_frame_t frame;
+    int length, codec;
+    int width, height;
+    int ret;
+    struct timeval tv_start, tv_end;
+
+    if ((strlen(file) > 4) && (strcasecmp(file + strlen(file) - 4, ".mp4") == 0)) {
+        ret = mp4_read_idr(file, &frame);
+        if (ret < 0) {
+            fprintf(stderr, "Error reading mp4 file %s\n", file);
+            return -8;
+        }
+        bufferh26x = frame.buf;
+        length = frame.len;
+        codec = frame.codec;
     } else {
-        if (w_res != W_LOW) {
-            AddWM(&WM_info, w_res, h_res, buffer,
-                buffer + w_res*h_res, w_res-460, h_res-40, NULL);
-        } else {
-            AddWM(&WM_info, w_res, h_res, buffer,
-                buffer + w_res*h_res, w_res-230, h_res-20, NULL);
+        ret = load_h26x(file, &bufferh26x, &length, &codec);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (debug) fprintf(stderr, "Decoding %s frame\n", (codec == NALU_CODEC_H264) ? "h264" : "h265");
+    gettimeofday(&tv_start, NULL);
+    ret = decoder_decode(bufferyuv, yuvsize, bufferh26x, length, codec, &width, &height);
+    gettimeofday(&tv_end, NULL);
+    free(bufferh26x);
+    if (ret < 0) {
+        fprintf(stderr, "Error decoding %s frame\n", (codec == NALU_CODEC_H264) ? "h264" : "h265");
+        return -11;
+    }
+    if (decode_time != NULL)
+        *decode_time = (tv_end.tv_sec - tv_start.tv_sec) * 1000000L + (tv_end.tv_usec - tv_start.tv_usec);
+
+    if (watermark) {
+        if (debug) fprintf(stderr, "Adding watermark\n");
+        if (add_watermark(bufferyuv, width, height) < 0) {
+            fprintf(stderr, "Error adding watermark\n");
+            return -12;
         }
-        WMRelease(&WM_info);
+    }
+
+    if ((dest_width != 0) && ((dest_width != width) || (dest_height != height))) {
+        if (debug) fprintf(stderr, "Scaling frame to %dx%d\n", dest_width, dest_height);
+        if (nv12_scale(bufferyuv, width, height, bufferdest, dest_width, dest_height) < 0) {
+            fprintf(stderr, "Error scaling frame\n");
+            return -14;
+        }
+        bufferyuv = bufferdest;
+        width = dest_width;
+        height = dest_height;
+    }
+
+    if (bench > 0) {
+        gettimeofday(&tv_start, NULL);
+        for (ret = 0; ret < bench; ret++)
+            YUVtoJPG("/dev/null", bufferyuv, width, height, width, height, quality);
+        gettimeofday(&tv_end, NULL);
+        fprintf(stderr, "Jpeg encode (%s, neon %s): %ld us per image\n",
+                jpeg_raw_input ? "raw data" : "scanlines", yuv_get_neon() ? "on" : "off",
+                ((tv_end.tv_sec - tv_start.tv_sec) * 1000000L + (tv_end.tv_usec - tv_start.tv_usec)) / bench);
+    }
+
+    if (debug) fprintf(stderr, "Encoding jpeg image\n");
+    if(YUVtoJPG(output, bufferyuv, width, height, width, height, quality) < 0) {
+        fprintf(stderr, "Error encoding jpeg file\n");
+        return -13;
     }
 
     return 0;
 }
 
+/*
+ * Batch mode: create the jpg of a single file, the jpg is written
+ * next to the input file and it's not overwritten.
+ */
+int batch_file(char *file, unsigned char *bufferyuv, int yuvsize, int quality, int watermark,
+        int *count, long *total_time)
+{
+    char output[PATH_MAX];
+    char *ext;
+    long decode_time;
+
+    ext = strrchr(file, '.');
+    if ((ext == NULL) || (strchr(ext, '/') != NULL))
+        return 0;
+    if ((strcasecmp(ext, ".mp4") != 0) && (strcasecmp(ext, ".h26x") != 0) &&
+            (strcasecmp(ext, ".h264") != 0) && (strcasecmp(ext, ".h265") != 0))
+        return 0;
+    if (ext - file + strlen(".jpg") >= sizeof(output))
+        return -1;
+
+    memcpy(output, file, ext - file);
+    strcpy(output + (ext - file), ".jpg");
+    if (access(output, F_OK) == 0) {
+        if (debug) fprintf(stderr, "Ignore file %s, already present\n", output);
+        return 0;
+    }
+
+    if (grab_frame(file, output, bufferyuv, yuvsize, quality, watermark, &decode_time) < 0) {
+        unlink(output);
+        return -1;
+    }
+
+    fprintf(stderr, "%s: decoded in %ld us\n", file, decode_time);
+    (*count)++;
+    *total_time += decode_time;
+
+    return 0;
+}
+
+/*
+ * Batch mode: process all the files of the folder and of its subfolders.
+ */
+void batch_dir(char *path, unsigned char *bufferyuv, int yuvsize, int quality, int watermark,
+        int *count, long *total_time)
+{
+    struct dirent **namelist;
+    char file[PATH_MAX];
+    struct stat st;
+    int i, n;
+
+    n = scandir(path, &namelist, NULL, alphasort);
+    if (n < 0)
+        return;
+
+    for (i = 0; i < n; i++) {
+        if ((namelist[i]->d_name[0] != '.') &&
+                (snprintf(file, sizeof(file), "%s/%s", path, namelist[i]->d_name) < sizeof(file)) &&
+                (stat(file, &st) == 0)) {
+            if (S_ISDIR(st.st_mode))
+                batch_dir(file, bufferyuv, yuvsize, quality, watermark, count, total_time);
+            else if (S_ISREG(st.st_mode))
+                batch_file(file, bufferyuv, yuvsize, quality, watermark, count, total_time);
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
+}
+
 void usage(char *prog_name)
 {
     fprintf(stderr, "Usage: %s [options]\n", prog_name);
-    fprintf(stderr, "\t-f, --file FILE         Read frame from file FILE\n");
+    fprintf(stderr, "\t-f, --file FILE         Read frame from file FILE (h26x or mp4)\n");
+    fprintf(stderr, "\t-b, --batch LIST        Batch mode: create a jpg for each file listed in LIST\n");
+    fprintf(stderr, "\t                        (\"-\" for stdin) or contained in folder LIST\n");
     fprintf(stderr, "\t-r, --res RES           Set resolution: \"low\" or \"high\" (default \"high\")\n");
+    fprintf(stderr, "\t-s, --size WxH          Scale the image to WxH (even values)\n");
     fprintf(stderr, "\t-q, --quality Q         Set jpeg quality: 0 - 100 (default 90)\n");
     fprintf(stderr, "\t-w, --watermark         Add watermark to image\n");
+    fprintf(stderr, "\t-m, --mode MODE         Jpeg input: \"raw\", \"neon\" or \"c\" (default \"raw\")\n");
+    fprintf(stderr, "\t-n, --bench N           Encode the jpeg N times and print the average time\n");
     fprintf(stderr, "\t-d, --debug             Enable debug\n");
     fprintf(stderr, "\t-h, --help              Show this help\n");
 }
@@ -215,29 +423,24 @@ int main(int argc, char **argv)
     int errno;
     char *endptr;
 
-    FILE *fHF;
-
-    unsigned char *bufferh26x, *bufferyuv;
+    unsigned char *bufferyuv;
     char file[256];
+    char batch[256];
+    char line[PATH_MAX];
     int quality = -1;
     int watermark = 0;
     int width, height;
+    int ret;
 
-    int c;
+    FILE *fList;
+    struct stat st;
+    int count;
+    long total_time;
 
-    struct frame_header fh, fhs, fhp, fhv, fhi;
-    unsigned char *fhs_addr, *fhp_addr, *fhv_addr, *fhi_addr;
-
-    int sps_start_found = -1, sps_end_found = -1;
-    int pps_start_found = -1, pps_end_found = -1;
-    int vps_start_found = -1, vps_end_found = -1;
-    int idr_start_found = -1;
-    int i, j, f, start_code, is_hevc = 0;
-    unsigned char *h26x_file_buffer;
-    long h26x_file_size;
-    size_t nread;
+    int c;
 
     memset(file, '\0', sizeof(file));
+    memset(batch, '\0', sizeof(batch));
     res = RESOLUTION_HIGH;
     quality = -1;
     width = W_FHD;
@@ -247,16 +450,20 @@ int main(int argc, char **argv)
     while (1) {
         static struct option long_options[] = {
             {"file",      required_argument, 0, 'f'},
+            {"batch",     required_argument, 0, 'b'},
             {"res",       required_argument, 0, 'r'},
+            {"size",      required_argument, 0, 's'},
             {"quality",   required_argument, 0, 'q'},
             {"watermark", no_argument,       0, 'w'},
+            {"mode",      required_argument, 0, 'm'},
+            {"bench",     required_argument, 0, 'n'},
             {"debug",     no_argument,       0, 'd'},
             {"help",      no_argument,       0, 'h'},
             {0,           0,                 0,  0 }
         };
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "f:r:q:wdh",
+        c = getopt_long(argc, argv, "f:b:r:s:q:wm:n:dh",
             long_options, &option_index);
         if (c == -1)
             break;
@@ -266,6 +473,13 @@ int main(int argc, char **argv)
                 if (strlen(optarg) < sizeof(file)) {
                     strcpy(file, optarg);
                 }
+                break;
+
+            case 'b':
+                if (strlen(optarg) < sizeof(batch)) {
+                    strcpy(batch, optarg);
+                }
+                break;
 
             case 'r':
                 if (strcasecmp("low", optarg) == 0)
@@ -274,6 +488,15 @@ int main(int argc, char **argv)
                     res = RESOLUTION_HIGH;
                 break;
 
+            case 's':
+                if ((sscanf(optarg, "%dx%d", &dest_width, &dest_height) != 2) ||
+                        (dest_width < 2) || (dest_width > W_FHD) || (dest_width & 1) ||
+                        (dest_height < 2) || (dest_height > H_FHD) || (dest_height & 1)) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
             case 'q':
                 errno = 0;    /* To distinguish success/failure after call */
                 quality = strtol(optarg, &endptr, 10);
@@ -297,6 +520,26 @@ int main(int argc, char **argv)
                 watermark = 1;
                 break;
 
+            case 'm':
+                if (strcasecmp("raw", optarg) == 0) {
+                    jpeg_raw_input = 1;
+                } else if (strcasecmp("neon", optarg) == 0) {
+                    jpeg_raw_input = 0;
+                    if (!yuv_set_neon(1))
+                        fprintf(stderr, "NEON not available, using C\n");
+                } else if (strcasecmp("c", optarg) == 0) {
+                    jpeg_raw_input = 0;
+                    yuv_set_neon(0);
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'n':
+                bench = atoi(optarg);
+                break;
+
             case 'd':
                 debug = 1;
                 break;
@@ -319,168 +562,59 @@ int main(int argc, char **argv)
         height = H_FHD;
     }
 
-    // Read frames from h26x file
-    fhs.len = 0;
-    fhp.len = 0;
-    fhv.len = 0;
-    fhi.len = 0;
-    fhs_addr = NULL;
-    fhp_addr = NULL;
-    fhv_addr = NULL;
-    fhi_addr = NULL;
-
-    fHF = fopen(file, "r");
-    if ( fHF == NULL ) {
-        fprintf(stderr, "Could not get size of %s\n", file);
-        exit(-6);
-    }
-    fseek(fHF, 0, SEEK_END);
-    h26x_file_size = ftell(fHF);
-    fseek(fHF, 0, SEEK_SET);
-    h26x_file_buffer = (unsigned char *) malloc(h26x_file_size);
-    nread = fread(h26x_file_buffer, 1, h26x_file_size, fHF);
-    fclose(fHF);
-    if (debug) fprintf(stderr, "The size of the file is %d\n", h26x_file_size);
-
-    if (nread != h26x_file_size) {
-        fprintf(stderr, "Read error %s\n", file);
-        exit(-7);
-    }
-
-    for (f=0; f<h26x_file_size; f++) {
-        for (i=f; i<h26x_file_size; i++) {
-            if(h26x_file_buffer[i] == 0 && h26x_file_buffer[i+1] == 0 && h26x_file_buffer[i+2] == 0 && h26x_file_buffer[i+3] == 1) {
-                start_code = 4;
-            } else {
-                continue;
-            }
-
-            if ((h26x_file_buffer[i+start_code]&0x7E) == 0x40) {
-                is_hevc = 1;
-                vps_start_found = i;
-                break;
-            } else if ((h26x_file_buffer[i+start_code]&0x1F) == 0x7) {
-                is_hevc = 0;
-                sps_start_found = i;
-                break;
-            } else if ((h26x_file_buffer[i+start_code]&0x7E) == 0x42) {
-                is_hevc = 1;
-                sps_start_found = i;
-                break;
-            } else if ((is_hevc == 0) && ((h26x_file_buffer[i+start_code]&0x1F) == 0x8)) {
-                pps_start_found = i;
-                break;
-            } else if ((is_hevc == 1) && ((h26x_file_buffer[i+start_code]&0x7E) == 0x44)) {
-                pps_start_found = i;
-                break;
-            } else if (((h26x_file_buffer[i+start_code]&0x1F) == 0x5) || ((h26x_file_buffer[i+start_code]&0x7E) == 0x26)) {
-                idr_start_found = i;
-                break;
-            }
-        }
-        for (j = i + 4; j<h26x_file_size; j++) {
-            if (h26x_file_buffer[j] == 0 && h26x_file_buffer[j+1] == 0 && h26x_file_buffer[j+2] == 0 && h26x_file_buffer[j+3] == 1) {
-                start_code = 4;
-            } else {
-                continue;
-            }
-
-            if ((h26x_file_buffer[j+start_code]&0x7E) == 0x42) {
-                vps_end_found = j;
-                break;
-            } else if ((is_hevc == 0) && ((h26x_file_buffer[j+start_code]&0x1F) == 0x8)) {
-                sps_end_found = j;
-                break;
-            } else if ((is_hevc == 1) && ((h26x_file_buffer[j+start_code]&0x7E) == 0x44)) {
-                sps_end_found = j;
-                break;
-            } else if (((h26x_file_buffer[j+start_code]&0x1F) == 0x5) || ((h26x_file_buffer[j+start_code]&0x7E) == 0x26)) {
-                pps_end_found = j;
-                break;
-            }
-        }
-        f = j - 1;
-    }
-
-    if ((sps_start_found >= 0) && (pps_start_found >= 0) && (idr_start_found >= 0) &&
-            (sps_end_found >= 0) && (pps_end_found >= 0)) {
-
-        if ((vps_start_found >= 0) && (vps_end_found >= 0)) {
-            fhv.len = vps_end_found - vps_start_found;
-            fhv_addr = &h26x_file_buffer[vps_start_found];
-        }
-        fhs.len = sps_end_found - sps_start_found;
-        fhp.len = pps_end_found - pps_start_found;
-        fhi.len = h26x_file_size - idr_start_found;
-        fhs_addr = &h26x_file_buffer[sps_start_found];
-        fhp_addr = &h26x_file_buffer[pps_start_found];
-        fhi_addr = &h26x_file_buffer[idr_start_found];
-
-        if (debug) {
-            fprintf(stderr, "Found SPS at %d, len %d\n", sps_start_found, fhs.len);
-            fprintf(stderr, "Found PPS at %d, len %d\n", pps_start_found, fhp.len);
-            if (fhv_addr != NULL) {
-                fprintf(stderr, "Found VPS at %d, len %d\n", vps_start_found, fhv.len);
-            }
-            fprintf(stderr, "Found IDR at %d, len %d\n", idr_start_found, fhi.len);
-        }
-    } else {
-        if (debug) fprintf(stderr, "No frame found\n");
-        exit(-8);
-    }
-
-    // Add FF_INPUT_BUFFER_PADDING_SIZE to make the size compatible with ffmpeg conversion
-    bufferh26x = (unsigned char *) malloc(fhv.len + fhs.len + fhp.len + fhi.len + FF_INPUT_BUFFER_PADDING_SIZE);
-    if (bufferh26x == NULL) {
-        fprintf(stderr, "Unable to allocate memory\n");
-        exit(-9);
-    }
-
+    // The resolution is the max size of the frame, the real one is read from the stream
     bufferyuv = (unsigned char *) malloc(width * height * 3 / 2);
     if (bufferyuv == NULL) {
         fprintf(stderr, "Unable to allocate memory\n");
         exit(-10);
     }
 
-    if (fhv_addr != NULL) {
-        memcpy(bufferh26x, fhv_addr, fhv.len);
-    }
-    memcpy(bufferh26x + fhv.len, fhs_addr, fhs.len);
-    memcpy(bufferh26x + fhv.len + fhs.len, fhp_addr, fhp.len);
-    memcpy(bufferh26x + fhv.len + fhs.len + fhp.len, fhi_addr, fhi.len);
-
-    free(h26x_file_buffer);
-
-    if (fhv_addr == NULL) {
-        if (debug) fprintf(stderr, "Decoding h264 frame\n");
-        if(frame_decode(bufferyuv, bufferh26x, fhs.len + fhp.len + fhi.len, 4) < 0) {
-            fprintf(stderr, "Error decoding h264 frame\n");
-            exit(-11);
-        }
-    } else {
-        if (debug) fprintf(stderr, "Decoding h265 frame\n");
-        if(frame_decode(bufferyuv, bufferh26x, fhv.len + fhs.len + fhp.len + fhi.len, 5) < 0) {
-            fprintf(stderr, "Error decoding h265 frame\n");
-            exit(-11);
+    if (dest_width != 0) {
+        bufferdest = (unsigned char *) malloc(dest_width * dest_height * 3 / 2);
+        if (bufferdest == NULL) {
+            fprintf(stderr, "Unable to allocate memory\n");
+            exit(-10);
         }
     }
-    free(bufferh26x);
 
-    if (watermark) {
-        if (debug) fprintf(stderr, "Adding watermark\n");
-        if (add_watermark(bufferyuv, width, height) < 0) {
-            fprintf(stderr, "Error adding watermark\n");
-            exit(-12);
+    if (batch[0] != '\0') {
+        // The decoder contexts stay open for all the files
+        count = 0;
+        total_time = 0;
+        if ((stat(batch, &st) == 0) && S_ISDIR(st.st_mode)) {
+            batch_dir(batch, bufferyuv, width * height * 3 / 2, quality, watermark, &count, &total_time);
+        } else {
+            if (strcmp(batch, "-") == 0)
+                fList = stdin;
+            else
+                fList = fopen(batch, "r");
+            if (fList == NULL) {
+                fprintf(stderr, "Could not open %s\n", batch);
+                exit(-6);
+            }
+            while (fgets(line, sizeof(line), fList) != NULL) {
+                line[strcspn(line, "\r\n")] = '\0';
+                if (line[0] != '\0')
+                    batch_file(line, bufferyuv, width * height * 3 / 2, quality, watermark, &count, &total_time);
+            }
+            if (fList != stdin)
+                fclose(fList);
         }
+        if (count > 0)
+            fprintf(stderr, "%d frames decoded, average %ld us per frame\n", count, total_time / count);
+        ret = 0;
+    } else {
+        ret = grab_frame(file, "stdout", bufferyuv, width * height * 3 / 2, quality, watermark, NULL);
     }
 
-    if (debug) fprintf(stderr, "Encoding jpeg image\n");
-    if(YUVtoJPG("stdout", bufferyuv, width, height, width, height, quality) < 0) {
-        fprintf(stderr, "Error encoding jpeg file\n");
-        exit(-13);
-    }
-
+    if (wm_width != 0)
+        WMRelease(&wm_info);
+    decoder_close();
+    free(bufferdest);
     free(bufferyuv);
 
+    if (ret < 0)
+        exit(ret);
+
     return 0;
 }
@@ -0,0 +1,536 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Ask the vendor encoder for a jpg snapshot.
+ * The encoder receives the file name with an UDP message and writes the
+ * jpg asynchronously: the folder is watched with inotify and the file is
+ * read as soon as it is closed, instead of waiting a fixed time.
+ *
+ * The last jpg is kept in a file on tmpfs mapped by every process.
+ * A request is served from this copy if it is younger than max_age ms;
+ * the capture runs with an exclusive lock on the file, so the requests
+ * arriving during a capture wait for it instead of sending a new one.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "libsnapshot.h"
+
+#define MSG_SIZE 288
+
+#define MSG_PART_1 "\x44\x59\x30\x31\x18\x01\x00\x00\xF1\x03\x00\x00\x88\x77\xB0\x7E\x88\x12\xF6\x76\xB8\x7D\xB0\x7E"
+#define MSG_PART_3 "\x01\x01\xB0\x7E"
+
+// The file name is between part 1 and part 3
+#define MSG_NAME_MAX (MSG_SIZE - (int) sizeof(MSG_PART_1) - (int) sizeof(MSG_PART_3) + 1)
+
+#define LOCAL_IP "127.0.0.1"
+#define AVENCODE_IP "127.0.0.1"
+#define AVENCODE_PORT 11000
+
+// Max wait between two checks of the file, in ms
+#define CHECK_INTERVAL_INOTIFY 200
+#define CHECK_INTERVAL_POLL    20
+
+#define CACHE_MAGIC 0x50414E53
+
+typedef struct
+{
+    unsigned int magic;
+    unsigned int seq;
+    long long timestamp;            // CLOCK_MONOTONIC ms of the capture
+    int size;
+    unsigned char jpg[SNAPSHOT_MAX_SIZE];
+} snapshot_cache_t;
+
+static int debug = 0;
+
+static int cache_fd = -1;
+static snapshot_cache_t *cache = NULL;
+
+void snapshot_set_debug(int enable)
+{
+    debug = enable;
+}
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Return the size of the file if it contains a whole jpg, 0 otherwise.
+ * Once the encoder has closed the file a SOI at the beginning is enough,
+ * the encoder can pad the jpg after the EOI. Before, the file is taken
+ * only if it ends with the EOI, so that the wait can end without the event.
+ */
+static int jpg_complete(const char *filename, int closed)
+{
+    struct stat st;
+    unsigned char m[2];
+    int fd;
+    int ret = 0;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    if ((fstat(fd, &st) == 0) && (st.st_size >= 4) &&
+            (pread(fd, m, 2, 0) == 2) && (m[0] == 0xFF) && (m[1] == 0xD8)) {
+        if (closed || ((pread(fd, m, 2, st.st_size - 2) == 2) && (m[0] == 0xFF) && (m[1] == 0xD9)))
+            ret = st.st_size;
+    }
+    close(fd);
+
+    return ret;
+}
+
+/*
+ * Send the request to the encoder.
+ * Return the socket to receive the confirmation or a negative error.
+ */
+static int send_request(const char *filename)
+{
+    int sockfd;
+    struct sockaddr_in local_addr, avencode_addr;
+    char message[MSG_SIZE];
+
+    // Create UDP socket
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd == -1) {
+        fprintf(stderr, "Could not create socket\n");
+        return SNAPSHOT_ERR_SOCKET;
+    }
+
+    memset(&local_addr, '\0', sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = inet_addr(LOCAL_IP);
+    local_addr.sin_port = htons(0);
+
+    memset(&avencode_addr, '\0', sizeof(avencode_addr));
+    avencode_addr.sin_family = AF_INET;
+    avencode_addr.sin_addr.s_addr = inet_addr(AVENCODE_IP);
+    avencode_addr.sin_port = htons(AVENCODE_PORT);
+
+    // Bind the socket with the local address
+    if (bind(sockfd, (const struct sockaddr *) &local_addr, sizeof(local_addr)) < 0) {
+        fprintf(stderr, "Bind failed\n");
+        close(sockfd);
+        return SNAPSHOT_ERR_SOCKET;
+    }
+
+    // Build message
+    memset(message, '\0', MSG_SIZE);
+    memcpy(message, MSG_PART_1, sizeof(MSG_PART_1) - 1);
+    memcpy(message + sizeof(MSG_PART_1) - 1, filename, strlen(filename));
+    memcpy(message + MSG_SIZE - 4, MSG_PART_3, sizeof(MSG_PART_3) - 1);
+
+    // Send data
+    if (debug) fprintf(stderr, "Sending message to %s port %d\n", AVENCODE_IP, AVENCODE_PORT);
+    if (sendto(sockfd, message, MSG_SIZE, 0,
+                (const struct sockaddr *) &avencode_addr, sizeof(avencode_addr)) < 0) {
+        fprintf(stderr, "Send failed\n");
+        close(sockfd);
+        return SNAPSHOT_ERR_SEND;
+    }
+    if (debug) fprintf(stderr, "Data successfully sent\n");
+
+    return sockfd;
+}
+
+/*
+ * Let the encoder write a jpg snapshot to filename and wait until the
+ * file is complete, for at most timeout ms (0 = SNAPSHOT_TIMEOUT).
+ * Return 0 or a negative SNAPSHOT_ERR_* value.
+ */
+int snapshot_get_file(const char *filename, int timeout)
+{
+    char dir[MSG_NAME_MAX + 1];
+    const char *name;
+    char *p;
+    char ev_buf[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    struct pollfd fds[2];
+    char ack[1024];
+    long long deadline, left;
+    int ifd, sockfd;
+    int nfds, check, closed, len;
+    int ret;
+
+    if (access(SNAPSHOT_DISABLED_FILE, F_OK) == 0) {
+        if (debug) fprintf(stderr, "Snapshot is disabled\n");
+        return SNAPSHOT_ERR_DISABLED;
+    }
+
+    if ((filename == NULL) || (filename[0] == '\0') || (strlen(filename) > MSG_NAME_MAX)) {
+        fprintf(stderr, "Invalid file name\n");
+        return SNAPSHOT_ERR_NAME;
+    }
+    if (timeout <= 0)
+        timeout = SNAPSHOT_TIMEOUT;
+
+    // Split folder and file name
+    strcpy(dir, filename);
+    p = strrchr(dir, '/');
+    if (p == NULL) {
+        strcpy(dir, ".");
+        name = filename;
+    } else {
+        name = filename + (p - dir) + 1;
+        if (p == dir)
+            p++;
+        *p = '\0';
+    }
+
+    // Don't take an old file for the new one
+    unlink(filename);
+
+    // Watch the folder before sending the request to not miss the event
+    ifd = inotify_init();
+    if (ifd >= 0) {
+        fcntl(ifd, F_SETFL, O_NONBLOCK);
+        if (inotify_add_watch(ifd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            close(ifd);
+            ifd = -1;
+        }
+    }
+    if ((ifd < 0) && debug) fprintf(stderr, "inotify not available, polling %s\n", filename);
+
+    sockfd = send_request(filename);
+    if (sockfd < 0) {
+        if (ifd >= 0)
+            close(ifd);
+        return sockfd;
+    }
+
+    // The confirmation and the file can arrive in any order
+    ret = SNAPSHOT_ERR_TIMEOUT;
+    closed = 0;
+    deadline = now_ms() + timeout;
+    while ((left = deadline - now_ms()) > 0) {
+        nfds = 0;
+        fds[nfds].fd = sockfd;
+        fds[nfds].events = POLLIN;
+        nfds++;
+        if (ifd >= 0) {
+            fds[nfds].fd = ifd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        // Check the file anyway from time to time, in case the event is lost
+        if (left > ((ifd >= 0) ? CHECK_INTERVAL_INOTIFY : CHECK_INTERVAL_POLL))
+            left = (ifd >= 0) ? CHECK_INTERVAL_INOTIFY : CHECK_INTERVAL_POLL;
+
+        nfds = poll(fds, nfds, (int) left);
+        if (nfds < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Poll failed\n");
+            break;
+        }
+
+        check = (nfds == 0);
+        if (fds[0].revents & POLLIN) {
+            len = recv(sockfd, ack, sizeof(ack), 0);
+            if (debug) fprintf(stderr, "Confirmation received (%d bytes packet)\n", len);
+            check = 1;
+        }
+        if ((ifd >= 0) && (fds[1].revents & POLLIN)) {
+            while ((len = read(ifd, ev_buf, sizeof(ev_buf))) > 0) {
+                for (p = ev_buf; p < ev_buf + len; p += sizeof(struct inotify_event) + ev->len) {
+                    ev = (struct inotify_event *) p;
+                    if ((ev->len > 0) && (strcmp(ev->name, name) == 0)) {
+                        check = 1;
+                        closed = 1;
+                    }
+                }
+            }
+        }
+
+        if (check && (jpg_complete(filename, closed) > 0)) {
+            ret = 0;
+            break;
+        }
+    }
+
+    if (debug) {
+        if (ret == 0)
+            fprintf(stderr, "File %s ready in %lld ms\n", filename, timeout - (deadline - now_ms()));
+        else
+            fprintf(stderr, "Timeout waiting for %s\n", filename);
+    }
+
+    close(sockfd);
+    if (ifd >= 0)
+        close(ifd);
+
+    return ret;
+}
+
+/*
+ * Take a jpg snapshot and copy it to buffer.
+ * The temporary file is created in SNAPSHOT_TMP_DIR and removed.
+ * Return the size of the jpg or a negative SNAPSHOT_ERR_* value.
+ */
+int snapshot_get(unsigned char *buffer, int size, int timeout)
+{
+    static int count = 0;
+    char filename[128];
+    struct stat st;
+    int fd;
+    int n, len;
+    int ret;
+
+    sprintf(filename, "%s/snapshot.%d.%d.jpg", SNAPSHOT_TMP_DIR, (int) getpid(), count++);
+
+    ret = snapshot_get_file(filename, timeout);
+    if (ret < 0) {
+        unlink(filename);
+        return ret;
+    }
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        unlink(filename);
+        return SNAPSHOT_ERR_READ;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        ret = SNAPSHOT_ERR_READ;
+    } else if (st.st_size > size) {
+        fprintf(stderr, "Snapshot too big: %d bytes\n", (int) st.st_size);
+        ret = SNAPSHOT_ERR_SIZE;
+    } else {
+        len = 0;
+        while (len < st.st_size) {
+            n = read(fd, buffer + len, st.st_size - len);
+            if (n <= 0)
+                break;
+            len += n;
+        }
+        ret = (len == st.st_size) ? len : SNAPSHOT_ERR_READ;
+    }
+
+    close(fd);
+    unlink(filename);
+
+    return ret;
+}
+
+static int cache_open(void)
+{
+    struct stat st;
+
+    if (cache != NULL)
+        return 0;
+
+    cache_fd = open(SNAPSHOT_CACHE_FILE, O_RDWR | O_CREAT, 0644);
+    if (cache_fd < 0)
+        return -1;
+    fcntl(cache_fd, F_SETFD, FD_CLOEXEC);
+
+    // A new file is filled with zeros, so it's seen as empty
+    if ((fstat(cache_fd, &st) != 0) ||
+            ((st.st_size < (off_t) sizeof(snapshot_cache_t)) && (ftruncate(cache_fd, sizeof(snapshot_cache_t)) != 0))) {
+        close(cache_fd);
+        cache_fd = -1;
+        return -1;
+    }
+
+    cache = (snapshot_cache_t *) mmap(NULL, sizeof(snapshot_cache_t), PROT_READ | PROT_WRITE, MAP_SHARED, cache_fd, 0);
+    if (cache == MAP_FAILED) {
+        cache = NULL;
+        close(cache_fd);
+        cache_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Return the size of the cached jpg if it is younger than max_age ms,
+ * 0 otherwise.
+ */
+static int cache_fresh(int max_age)
+{
+    long long age;
+
+    if ((cache->magic != CACHE_MAGIC) || (cache->size <= 0) || (cache->size > SNAPSHOT_MAX_SIZE))
+        return 0;
+
+    age = now_ms() - cache->timestamp;
+    if ((age < 0) || (age > max_age))
+        return 0;
+
+    if (debug) fprintf(stderr, "Snapshot %u served from cache, age %lld ms\n", cache->seq, age);
+
+    return cache->size;
+}
+
+/*
+ * Copy the cached jpg if it is younger than max_age ms.
+ * Return the size, 0 if there is no fresh jpg or SNAPSHOT_ERR_SIZE.
+ */
+static int cache_read(unsigned char *buffer, int size, int max_age)
+{
+    int ret;
+
+    ret = cache_fresh(max_age);
+    if (ret > size)
+        return SNAPSHOT_ERR_SIZE;
+    if (ret > 0)
+        memcpy(buffer, cache->jpg, ret);
+
+    return ret;
+}
+
+/*
+ * Take a new jpg in the cache, unless another process has taken it while
+ * we were waiting the lock. Called with the exclusive lock.
+ * Return the size of the jpg or a negative SNAPSHOT_ERR_* value.
+ */
+static int cache_update(int max_age, int timeout)
+{
+    int ret;
+
+    ret = cache_fresh(max_age);
+    if (ret != 0)
+        return ret;
+
+    ret = snapshot_get(cache->jpg, SNAPSHOT_MAX_SIZE, timeout);
+    if (ret > 0) {
+        cache->size = ret;
+        cache->timestamp = now_ms();
+        cache->seq++;
+        cache->magic = CACHE_MAGIC;
+    } else {
+        // The copy may be partially overwritten
+        cache->magic = 0;
+    }
+
+    return ret;
+}
+
+/*
+ * Like snapshot_get() but use the shared copy if it is younger than
+ * max_age ms (0 = always take a new one).
+ * Concurrent requests of a stale jpg are coalesced in one capture.
+ */
+int snapshot_get_cached(unsigned char *buffer, int size, int max_age, int timeout)
+{
+    int ret;
+
+    if (access(SNAPSHOT_DISABLED_FILE, F_OK) == 0) {
+        if (debug) fprintf(stderr, "Snapshot is disabled\n");
+        return SNAPSHOT_ERR_DISABLED;
+    }
+
+    if ((max_age <= 0) || (cache_open() != 0))
+        return snapshot_get(buffer, size, timeout);
+
+    flock(cache_fd, LOCK_SH);
+    ret = cache_read(buffer, size, max_age);
+    flock(cache_fd, LOCK_UN);
+    if (ret != 0)
+        return ret;
+
+    flock(cache_fd, LOCK_EX);
+    ret = cache_update(max_age, timeout);
+    if (ret > size) {
+        ret = SNAPSHOT_ERR_SIZE;
+    } else if (ret > 0) {
+        memcpy(buffer, cache->jpg, ret);
+    }
+    flock(cache_fd, LOCK_UN);
+
+    return ret;
+}
+
+/*
+ * Like snapshot_get_cached() but without copies: *jpg points to the jpg
+ * in the shared cache (max_age 0 = always take a new one).
+ * The jpg is locked until snapshot_unmap_cached(), the other processes
+ * can read it but can't take a new one: release it as soon as possible.
+ * The lock belongs to the process, so only one jpg can be mapped at a time.
+ * Return the size of the jpg or a negative SNAPSHOT_ERR_* value, the lock
+ * is held only if the size is returned.
+ */
+int snapshot_map_cached(const unsigned char **jpg, int max_age, int timeout)
+{
+    int ret;
+
+    if (access(SNAPSHOT_DISABLED_FILE, F_OK) == 0) {
+        if (debug) fprintf(stderr, "Snapshot is disabled\n");
+        return SNAPSHOT_ERR_DISABLED;
+    }
+
+    if (cache_open() != 0) {
+        fprintf(stderr, "Cannot open %s\n", SNAPSHOT_CACHE_FILE);
+        return SNAPSHOT_ERR_READ;
+    }
+    if (max_age <= 0)
+        max_age = -1;
+
+    flock(cache_fd, LOCK_SH);
+    ret = cache_fresh(max_age);
+    if (ret == 0) {
+        flock(cache_fd, LOCK_UN);
+
+        flock(cache_fd, LOCK_EX);
+        ret = cache_update(max_age, timeout);
+        if (ret < 0) {
+            flock(cache_fd, LOCK_UN);
+            return ret;
+        }
+
+        // The conversion is not atomic: a failed capture of another
+        // process can get in the middle
+        flock(cache_fd, LOCK_SH);
+        ret = cache_fresh(INT_MAX);
+        if (ret == 0) {
+            flock(cache_fd, LOCK_UN);
+            return SNAPSHOT_ERR_READ;
+        }
+    }
+
+    *jpg = cache->jpg;
+
+    return ret;
+}
+
+void snapshot_unmap_cached(void)
+{
+    if (cache_fd >= 0)
+        flock(cache_fd, LOCK_UN);
+}
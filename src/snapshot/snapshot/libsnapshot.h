@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Ask the vendor encoder for a jpg snapshot.
+ */
+
+#ifndef LIBSNAPSHOT_H
+#define LIBSNAPSHOT_H
+
+// The temporary jpg is written on tmpfs
+#define SNAPSHOT_TMP_DIR       "/tmp"
+#define SNAPSHOT_DISABLED_FILE "/tmp/snapshot.disabled"
+
+// Default timeout in ms and max size of a 1080p jpg
+#define SNAPSHOT_TIMEOUT       3000
+#define SNAPSHOT_MAX_SIZE      (512 * 1024)
+
+// Last jpg shared between the processes and default freshness window in ms
+#define SNAPSHOT_CACHE_FILE    "/tmp/snapshot.cache"
+#define SNAPSHOT_MAX_AGE       500
+
+// Return values
+#define SNAPSHOT_ERR_SOCKET    -1
+#define SNAPSHOT_ERR_SEND      -2
+#define SNAPSHOT_ERR_TIMEOUT   -3
+#define SNAPSHOT_ERR_READ      -4
+#define SNAPSHOT_ERR_SIZE      -5
+#define SNAPSHOT_ERR_DISABLED  -6
+#define SNAPSHOT_ERR_NAME      -7
+
+void snapshot_set_debug(int enable);
+int snapshot_get_file(const char *filename, int timeout);
+int snapshot_get(unsigned char *buffer, int size, int timeout);
+int snapshot_get_cached(unsigned char *buffer, int size, int max_age, int timeout);
+int snapshot_map_cached(const unsigned char **jpg, int max_age, int timeout);
+void snapshot_unmap_cached(void);
+
+#endif // LIBSNAPSHOT_H
@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Minimal mp4 demuxer: extracts the first sync sample of the video track.
+ * Only the moov box and the sample itself are read from the file, the
+ * sample is converted to annex B and prefixed with the parameter sets
+ * found in avcC/hvcC, ready to be sent to the decoder.
+ * The hdlr box is not used to detect the video track because the one
+ * written by the camera is not standard (see minimp4.patch).
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "mp4demux.h"
+#include "nalu.h"
+
+#define BOX(a, b, c, d) (((uint32_t) (a) << 24) | ((b) << 16) | ((c) << 8) | (d))
+
+// Size of the VisualSampleEntry fields before the child boxes
+#define VISUAL_SAMPLE_ENTRY_SIZE 78
+
+typedef struct {
+    const unsigned char *stsd;
+    const unsigned char *stsz;
+    const unsigned char *stsc;
+    const unsigned char *stco;
+    const unsigned char *stss;
+    int stsd_len;
+    int stsz_len;
+    int stsc_len;
+    int stco_len;
+    int stss_len;
+    int co64;
+} stbl_t;
+
+static uint32_t rb16(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t rb32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t rb64(const unsigned char *p)
+{
+    return ((uint64_t) rb32(p) << 32) | rb32(p + 4);
+}
+
+/*
+ * Get the box starting at buf[*pos] and move *pos to the next one.
+ * Return 0 on success, -1 at the end of the buffer or if the box is truncated.
+ */
+static int next_box(const unsigned char *buf, int len, int *pos, uint32_t *type,
+        const unsigned char **payload, int *payload_len)
+{
+    uint64_t size;
+    int hdr = 8;
+
+    if (len - *pos < 8)
+        return -1;
+
+    size = rb32(buf + *pos);
+    *type = rb32(buf + *pos + 4);
+    if (size == 1) {
+        if (len - *pos < 16)
+            return -1;
+        size = rb64(buf + *pos + 8);
+        hdr = 16;
+    } else if (size == 0) {
+        size = len - *pos;
+    }
+    if ((size < hdr) || (size > (uint64_t) (len - *pos)))
+        return -1;
+
+    *payload = buf + *pos + hdr;
+    *payload_len = size - hdr;
+    *pos += size;
+
+    return 0;
+}
+
+static const unsigned char *find_box(const unsigned char *buf, int len, uint32_t type, int *payload_len)
+{
+    const unsigned char *payload;
+    uint32_t t;
+    int pos = 0;
+
+    while (next_box(buf, len, &pos, &t, &payload, payload_len) == 0) {
+        if (t == type)
+            return payload;
+    }
+
+    return NULL;
+}
+
+/*
+ * Load the moov box in memory.
+ */
+static unsigned char *read_moov(int fd, int *moov_len)
+{
+    unsigned char hdr[16];
+    unsigned char *moov;
+    uint64_t size;
+    off_t pos = 0;
+    off_t file_size;
+    int hdr_len;
+
+    file_size = lseek(fd, 0, SEEK_END);
+    if (file_size < 0)
+        return NULL;
+
+    while (pread(fd, hdr, 8, pos) == 8) {
+        size = rb32(hdr);
+        hdr_len = 8;
+        if (size == 1) {
+            if (pread(fd, hdr + 8, 8, pos + 8) != 8)
+                return NULL;
+            size = rb64(hdr + 8);
+            hdr_len = 16;
+        } else if (size == 0) {
+            // Last box, it extends to the end of the file
+            size = file_size - pos;
+        }
+        if (size < hdr_len)
+            return NULL;
+
+        if (rb32(hdr + 4) == BOX('m', 'o', 'o', 'v')) {
+            if (size - hdr_len > MP4_MAX_MOOV_SIZE)
+                return NULL;
+            *moov_len = size - hdr_len;
+            moov = (unsigned char *) malloc(*moov_len);
+            if (moov == NULL)
+                return NULL;
+            if (pread(fd, moov, *moov_len, pos + hdr_len) != *moov_len) {
+                free(moov);
+                return NULL;
+            }
+            return moov;
+        }
+        pos += size;
+    }
+
+    return NULL;
+}
+
+/*
+ * Fill stbl with the sample tables of the first video track.
+ * Return the sample entry type or 0 if no video track is found.
+ */
+static uint32_t find_video_track(const unsigned char *moov, int moov_len, stbl_t *stbl)
+{
+    const unsigned char *trak, *p, *entry;
+    int trak_len, len, entry_len;
+    int pos = 0, epos;
+    uint32_t type, etype;
+
+    while (next_box(moov, moov_len, &pos, &type, &trak, &trak_len) == 0) {
+        if (type != BOX('t', 'r', 'a', 'k'))
+            continue;
+
+        p = find_box(trak, trak_len, BOX('m', 'd', 'i', 'a'), &len);
+        if (p != NULL) p = find_box(p, len, BOX('m', 'i', 'n', 'f'), &len);
+        if (p != NULL) p = find_box(p, len, BOX('s', 't', 'b', 'l'), &len);
+        if (p == NULL)
+            continue;
+
+        memset(stbl, 0, sizeof(stbl_t));
+        stbl->stsd = find_box(p, len, BOX('s', 't', 's', 'd'), &stbl->stsd_len);
+        stbl->stsz = find_box(p, len, BOX('s', 't', 's', 'z'), &stbl->stsz_len);
+        stbl->stsc = find_box(p, len, BOX('s', 't', 's', 'c'), &stbl->stsc_len);
+        stbl->stss = find_box(p, len, BOX('s', 't', 's', 's'), &stbl->stss_len);
+        stbl->stco = find_box(p, len, BOX('s', 't', 'c', 'o'), &stbl->stco_len);
+        if (stbl->stco == NULL) {
+            stbl->stco = find_box(p, len, BOX('c', 'o', '6', '4'), &stbl->stco_len);
+            stbl->co64 = 1;
+        }
+        if ((stbl->stsd == NULL) || (stbl->stsz == NULL) || (stbl->stsc == NULL) || (stbl->stco == NULL))
+            continue;
+        if ((stbl->stsd_len < 8) || (stbl->stsz_len < 12) || (stbl->stsc_len < 8) || (stbl->stco_len < 8))
+            continue;
+
+        // First sample entry
+        epos = 0;
+        if (next_box(stbl->stsd + 8, stbl->stsd_len - 8, &epos, &etype, &entry, &entry_len) < 0)
+            continue;
+        if ((etype == BOX('a', 'v', 'c', '1')) || (etype == BOX('a', 'v', 'c', '3')) ||
+                (etype == BOX('h', 'v', 'c', '1')) || (etype == BOX('h', 'e', 'v', '1'))) {
+            stbl->stsd = entry;
+            stbl->stsd_len = entry_len;
+            return etype;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Write the parameter sets of avcC/hvcC in annex B format.
+ * Return the number of bytes written or -1.
+ */
+static int write_parameter_sets(unsigned char *out, const unsigned char *dsi, int dsi_len, int codec, int *nal_len_size)
+{
+    int n = 0;
+    int i, j, pos, arrays, count, len;
+
+    if (codec == NALU_CODEC_H264) {
+        // AVCDecoderConfigurationRecord
+        if (dsi_len < 7)
+            return -1;
+        *nal_len_size = (dsi[4] & 3) + 1;
+        pos = 5;
+        for (i = 0; i < 2; i++) {
+            // SPS first, then PPS
+            if (pos >= dsi_len)
+                return -1;
+            count = (i == 0) ? dsi[pos] & 0x1F : dsi[pos];
+            pos++;
+            for (j = 0; j < count; j++) {
+                if (pos + 2 > dsi_len)
+                    return -1;
+                len = rb16(dsi + pos);
+                pos += 2;
+                if (pos + len > dsi_len)
+                    return -1;
+                memcpy(out + n, "\x00\x00\x00\x01", 4);
+                memcpy(out + n + 4, dsi + pos, len);
+                n += 4 + len;
+                pos += len;
+            }
+        }
+    } else {
+        // HEVCDecoderConfigurationRecord
+        if (dsi_len < 23)
+            return -1;
+        *nal_len_size = (dsi[21] & 3) + 1;
+        arrays = dsi[22];
+        pos = 23;
+        for (i = 0; i < arrays; i++) {
+            if (pos + 3 > dsi_len)
+                return -1;
+            count = rb16(dsi + pos + 1);
+            pos += 3;
+            for (j = 0; j < count; j++) {
+                if (pos + 2 > dsi_len)
+                    return -1;
+                len = rb16(dsi + pos);
+                pos += 2;
+                if (pos + len > dsi_len)
+                    return -1;
+                memcpy(out + n, "\x00\x00\x00\x01", 4);
+                memcpy(out + n + 4, dsi + pos, len);
+                n += 4 + len;
+                pos += len;
+            }
+        }
+    }
+
+    return n;
+}
+
+/*
+ * Return 1 if the sample is a chain of nal units with a length prefix of
+ * nal_len_size bytes that ends exactly at the end of the sample.
+ * A start code can't be used to tell the formats apart: a 4 byte length
+ * of 256-511 starts with 00 00 01 and a length of 1 is 00 00 00 01.
+ */
+static int is_length_prefixed(const unsigned char *sample, uint32_t sample_len, int nal_len_size)
+{
+    uint32_t i = 0, nal_len;
+    int j;
+
+    while (i + nal_len_size <= sample_len) {
+        nal_len = 0;
+        for (j = 0; j < nal_len_size; j++)
+            nal_len = (nal_len << 8) | sample[i + j];
+        i += nal_len_size;
+        if ((nal_len == 0) || (nal_len > sample_len - i))
+            return 0;
+        i += nal_len;
+    }
+
+    return i == sample_len;
+}
+
+/*
+ * Locate the first sync sample using stss, stsc, stco and stsz.
+ * Return 0 on success, -1 if the tables are inconsistent.
+ */
+static int locate_sync_sample(stbl_t *stbl, uint64_t *offset, uint32_t *size)
+{
+    uint32_t sample = 1;
+    uint32_t sample_size, sample_count, entries;
+    uint32_t first, fc, next_fc, spc, chunk, first_in_chunk, s;
+    uint64_t chunks;
+    uint32_t k;
+
+    if ((stbl->stss != NULL) && (stbl->stss_len >= 12) && (rb32(stbl->stss + 4) > 0))
+        sample = rb32(stbl->stss + 8);
+
+    sample_size = rb32(stbl->stsz + 4);
+    sample_count = rb32(stbl->stsz + 8);
+    if ((sample == 0) || (sample > sample_count))
+        return -1;
+    if ((sample_size == 0) && ((uint64_t) stbl->stsz_len < 12 + 4 * (uint64_t) sample_count))
+        return -1;
+
+    // Find the chunk that contains the sample
+    entries = rb32(stbl->stsc + 4);
+    if ((entries == 0) || ((uint64_t) stbl->stsc_len < 8 + 12 * (uint64_t) entries))
+        return -1;
+    first = 1;
+    chunk = 0;
+    first_in_chunk = 0;
+    for (k = 0; k < entries; k++) {
+        fc = rb32(stbl->stsc + 8 + 12 * k);
+        spc = rb32(stbl->stsc + 8 + 12 * k + 4);
+        next_fc = (k + 1 < entries) ? rb32(stbl->stsc + 8 + 12 * (k + 1)) : 0;
+        if ((spc == 0) || (fc == 0))
+            return -1;
+        if ((next_fc == 0) || ((next_fc > fc) && (sample < first + (uint64_t) (next_fc - fc) * spc))) {
+            chunk = fc + (sample - first) / spc;
+            first_in_chunk = first + ((sample - first) / spc) * spc;
+            break;
+        }
+        if (next_fc <= fc)
+            return -1;
+        chunks = next_fc - fc;
+        first += chunks * spc;
+    }
+    if (chunk == 0)
+        return -1;
+
+    // Chunk offset
+    entries = rb32(stbl->stco + 4);
+    if (chunk > entries)
+        return -1;
+    if (stbl->co64) {
+        if ((uint64_t) stbl->stco_len < 8 + 8 * (uint64_t) entries)
+            return -1;
+        *offset = rb64(stbl->stco + 8 + 8 * (chunk - 1));
+    } else {
+        if ((uint64_t) stbl->stco_len < 8 + 4 * (uint64_t) entries)
+            return -1;
+        *offset = rb32(stbl->stco + 8 + 4 * (chunk - 1));
+    }
+
+    // Skip the samples that precede ours in the same chunk
+    for (s = first_in_chunk; s < sample; s++)
+        *offset += (sample_size != 0) ? sample_size : rb32(stbl->stsz + 12 + 4 * (s - 1));
+
+    *size = (sample_size != 0) ? sample_size : rb32(stbl->stsz + 12 + 4 * (sample - 1));
+
+    return 0;
+}
+
+/*
+ * Read the first sync sample of the video track of file.
+ * On success frame->buf must be released with mp4_frame_free().
+ * Return 0 on success, a negative value on error.
+ */
+int mp4_read_idr(const char *file, mp4_frame_t *frame)
+{
+    int fd;
+    unsigned char *moov, *sample, *out;
+    int moov_len, dsi_len, ps_len, nal_len_size;
+    const unsigned char *dsi;
+    uint32_t entry_type, sample_len, nal_len;
+    uint64_t sample_offset;
+    stbl_t stbl;
+    int i, j, n, ret;
+
+    memset(frame, 0, sizeof(mp4_frame_t));
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    moov = read_moov(fd, &moov_len);
+    if (moov == NULL) {
+        close(fd);
+        return -2;
+    }
+
+    entry_type = find_video_track(moov, moov_len, &stbl);
+    if (entry_type == 0) {
+        free(moov);
+        close(fd);
+        return -3;
+    }
+
+    if ((entry_type == BOX('a', 'v', 'c', '1')) || (entry_type == BOX('a', 'v', 'c', '3'))) {
+        frame->codec = NALU_CODEC_H264;
+        dsi = find_box(stbl.stsd + VISUAL_SAMPLE_ENTRY_SIZE, stbl.stsd_len - VISUAL_SAMPLE_ENTRY_SIZE,
+                BOX('a', 'v', 'c', 'C'), &dsi_len);
+    } else {
+        frame->codec = NALU_CODEC_HEVC;
+        dsi = find_box(stbl.stsd + VISUAL_SAMPLE_ENTRY_SIZE, stbl.stsd_len - VISUAL_SAMPLE_ENTRY_SIZE,
+                BOX('h', 'v', 'c', 'C'), &dsi_len);
+    }
+    if ((stbl.stsd_len < VISUAL_SAMPLE_ENTRY_SIZE) || (dsi == NULL) ||
+            (locate_sync_sample(&stbl, &sample_offset, &sample_len) < 0) ||
+            (sample_len == 0) || (sample_len > MP4_MAX_SAMPLE_SIZE)) {
+        free(moov);
+        close(fd);
+        return -2;
+    }
+    frame->width = rb16(stbl.stsd + 24);
+    frame->height = rb16(stbl.stsd + 26);
+
+    sample = (unsigned char *) malloc(sample_len);
+    // Worst case: every nal unit has a 1 byte length and a 1 byte payload
+    out = (unsigned char *) malloc(dsi_len * 3 + sample_len * 5 / 2 + 4 + MP4_PADDING_SIZE);
+    if ((sample == NULL) || (out == NULL)) {
+        free(sample);
+        free(out);
+        free(moov);
+        close(fd);
+        return -4;
+    }
+
+    ret = pread(fd, sample, sample_len, sample_offset);
+    close(fd);
+    if (ret != (int) sample_len) {
+        free(sample);
+        free(out);
+        free(moov);
+        return -5;
+    }
+
+    ps_len = write_parameter_sets(out, dsi, dsi_len, frame->codec, &nal_len_size);
+    free(moov);
+    if (ps_len < 0) {
+        free(sample);
+        free(out);
+        return -2;
+    }
+
+    n = ps_len;
+    if (is_length_prefixed(sample, sample_len, nal_len_size)) {
+        // Replace the length prefixes with start codes
+        i = 0;
+        while (i + nal_len_size <= sample_len) {
+            nal_len = 0;
+            for (j = 0; j < nal_len_size; j++)
+                nal_len = (nal_len << 8) | sample[i + j];
+            i += nal_len_size;
+            if (nal_len > sample_len - i)
+                break;
+            memcpy(out + n, "\x00\x00\x00\x01", 4);
+            memcpy(out + n + 4, sample + i, nal_len);
+            n += 4 + nal_len;
+            i += nal_len;
+        }
+    } else if ((sample_len >= 4) && (sample[0] == 0) && (sample[1] == 0) &&
+            ((sample[2] == 1) || ((sample[2] == 0) && (sample[3] == 1)))) {
+        // Already annex B
+        memcpy(out + n, sample, sample_len);
+        n += sample_len;
+    }
+    free(sample);
+
+    if (n == ps_len) {
+        free(out);
+        return -2;
+    }
+
+    memset(out + n, 0, MP4_PADDING_SIZE);
+    frame->buf = out;
+    frame->len = n;
+
+    return 0;
+}
+
+void mp4_frame_free(mp4_frame_t *frame)
+{
+    free(frame->buf);
+    frame->buf = NULL;
+    frame->len = 0;
+}
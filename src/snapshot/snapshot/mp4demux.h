@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Minimal mp4 demuxer: extracts the first sync sample of the video track.
+ */
+
+#ifndef MP4DEMUX_H
+#define MP4DEMUX_H
+
+// Zeroed bytes added at the end of the buffer, enough for libavcodec
+#define MP4_PADDING_SIZE       64
+
+// Max size of the moov box and of the sample loaded in memory
+#define MP4_MAX_MOOV_SIZE      (4 * 1024 * 1024)
+#define MP4_MAX_SAMPLE_SIZE    (4 * 1024 * 1024)
+
+typedef struct {
+    int codec;              // NALU_CODEC_H264 or NALU_CODEC_HEVC
+    int width;
+    int height;
+    unsigned char *buf;     // annex B: parameter sets followed by the sync sample
+    int len;                // length of the data, padding excluded
+} mp4_frame_t;
+
+int mp4_read_idr(const char *file, mp4_frame_t *frame);
+void mp4_frame_free(mp4_frame_t *frame);
+
+#endif // MP4DEMUX_H
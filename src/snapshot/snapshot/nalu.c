@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Single pass NAL unit scanner for h264/h265 annex B streams.
+ * The buffer is walked only once: 4 bytes at a time while no zero byte
+ * is present, byte by byte only around the candidate start codes.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "nalu.h"
+
+#define HAS_ZERO_BYTE(x) (((x) - 0x01010101U) & ~(x) & 0x80808080U)
+
+/*
+ * Return the offset of the first 3-byte start code (00 00 01) found
+ * in buf[pos..size), or -1.
+ */
+static int find_start_code_3(const unsigned char *buf, int pos, int size)
+{
+    const unsigned char *p = buf + pos;
+    const unsigned char *end = buf + size - 3;
+    uint32_t x;
+
+    if (size - pos < 3)
+        return -1;
+
+    // Reach a word aligned address
+    while ((p <= end) && (((uintptr_t) p) & 3)) {
+        if ((p[0] == 0) && (p[1] == 0) && (p[2] == 1))
+            return p - buf;
+        p++;
+    }
+
+    // Word at a time: skip 4 bytes if none of them is zero
+    while (p + 6 <= buf + size) {
+        memcpy(&x, p, 4);
+        if (HAS_ZERO_BYTE(x)) {
+            if (p[1] == 0) {
+                if ((p[0] == 0) && (p[2] == 1))
+                    return p - buf;
+                if ((p[2] == 0) && (p[3] == 1))
+                    return p + 1 - buf;
+            }
+            if (p[3] == 0) {
+                if ((p[2] == 0) && (p[4] == 1))
+                    return p + 2 - buf;
+                if ((p[4] == 0) && (p[5] == 1))
+                    return p + 3 - buf;
+            }
+        }
+        p += 4;
+    }
+
+    // Tail
+    while (p <= end) {
+        if ((p[0] == 0) && (p[1] == 0) && (p[2] == 1))
+            return p - buf;
+        p++;
+    }
+
+    return -1;
+}
+
+/*
+ * Return the offset of the first start code in buf[pos..size), or -1.
+ * If start_code is not NULL it's filled with the start code length (3 or 4).
+ */
+int nalu_find_start_code(const unsigned char *buf, int pos, int size, int *start_code)
+{
+    int off;
+
+    off = find_start_code_3(buf, pos, size);
+    if (off < 0)
+        return -1;
+
+    if ((off > pos) && (buf[off - 1] == 0)) {
+        if (start_code != NULL) *start_code = 4;
+        return off - 1;
+    }
+
+    if (start_code != NULL) *start_code = 3;
+    return off;
+}
+
+/*
+ * Fill nalu with the first nal unit found in buf[pos..size).
+ * Return the offset where the next search should start, or -1 if no
+ * nal unit is present.
+ */
+int nalu_next(const unsigned char *buf, int pos, int size, int codec, nalu_t *nalu)
+{
+    int start, sc, next;
+    unsigned char h;
+
+    start = nalu_find_start_code(buf, pos, size, &sc);
+    if ((start < 0) || (start + sc >= size))
+        return -1;
+
+    h = buf[start + sc];
+    next = nalu_find_start_code(buf, start + sc + 1, size, NULL);
+    if (next < 0)
+        next = size;
+
+    nalu->offset = start;
+    nalu->len = next - start;
+    nalu->start_code = sc;
+    if (codec == NALU_CODEC_HEVC)
+        nalu->type = (h >> 1) & 0x3F;
+    else
+        nalu->type = h & 0x1F;
+
+    return next;
+}
+
+/*
+ * Detect the codec looking at the first parameter set of the stream.
+ * Default is h264.
+ */
+int nalu_detect_codec(const unsigned char *buf, int size)
+{
+    nalu_t nalu;
+    int pos = 0;
+    unsigned char h;
+
+    while ((pos = nalu_next(buf, pos, size, NALU_CODEC_AUTO, &nalu)) >= 0) {
+        h = buf[nalu.offset + nalu.start_code];
+        if ((h & 0x80) != 0)
+            continue;
+        if (nalu.type == NALU_H264_SPS)
+            return NALU_CODEC_H264;
+        if (((((h >> 1) & 0x3F) == NALU_HEVC_VPS) || (((h >> 1) & 0x3F) == NALU_HEVC_SPS)) &&
+                (nalu.len > nalu.start_code + 1) && (buf[nalu.offset + nalu.start_code + 1] == 0x01))
+            return NALU_CODEC_HEVC;
+    }
+
+    return NALU_CODEC_H264;
+}
+
+/*
+ * Build a table of the nal units present in buf (max entries).
+ * Return the number of entries filled.
+ */
+int nalu_index(const unsigned char *buf, int size, int codec, nalu_t *table, int max)
+{
+    int pos = 0;
+    int n = 0;
+
+    if (codec == NALU_CODEC_AUTO)
+        codec = nalu_detect_codec(buf, size);
+
+    while ((n < max) && ((pos = nalu_next(buf, pos, size, codec, &table[n])) >= 0))
+        n++;
+
+    return n;
+}
+
+int nalu_is_idr(int codec, int type)
+{
+    if (codec == NALU_CODEC_HEVC)
+        return (type == NALU_HEVC_IDR_W_RADL) || (type == NALU_HEVC_IDR_N_LP);
+
+    return type == NALU_H264_IDR;
+}
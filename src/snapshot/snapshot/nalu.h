@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Single pass NAL unit scanner for h264/h265 annex B streams.
+ */
+
+#ifndef NALU_H
+#define NALU_H
+
+#include <stdint.h>
+
+#define NALU_CODEC_AUTO        0
+#define NALU_CODEC_H264        4
+#define NALU_CODEC_HEVC        5
+
+// h264 nal unit types
+#define NALU_H264_IDR          5
+#define NALU_H264_SPS          7
+#define NALU_H264_PPS          8
+
+// h265 nal unit types
+#define NALU_HEVC_IDR_W_RADL   19
+#define NALU_HEVC_IDR_N_LP     20
+#define NALU_HEVC_VPS          32
+#define NALU_HEVC_SPS          33
+#define NALU_HEVC_PPS          34
+
+typedef struct {
+    int offset;         // offset of the start code
+    int len;            // length of the nal unit including the start code
+    int start_code;     // length of the start code: 3 or 4
+    int type;           // nal unit type (h264 or h265 numbering)
+} nalu_t;
+
+int nalu_find_start_code(const unsigned char *buf, int pos, int size, int *start_code);
+int nalu_detect_codec(const unsigned char *buf, int size);
+int nalu_next(const unsigned char *buf, int pos, int size, int codec, nalu_t *nalu);
+int nalu_index(const unsigned char *buf, int size, int codec, nalu_t *table, int max);
+int nalu_is_idr(int codec, int type);
+
+#endif // NALU_H
@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
 #include <jpeglib.h>
 
+#define DEFAULT_QUALITY 75
+
 void swapJsampRow(unsigned char *src, unsigned char *dest) {
     unsigned char *temp;
     temp = dest;
@@ -205,13 +208,105 @@ int resizeJpegFile(char *inFileName, char *outFileName, float factor) {
     return 0;
 }
 
+/*
+ * scaleJpegFile
+ * Scale by 1/denom while decoding: libjpeg skips the unneeded DCT
+ * coefficients, so it's much faster than a full decode and resize.
+ * The data stays in YCbCr, no color conversion is done.
+ * "-" is stdin or stdout.
+ */
+int scaleJpegFile(char *inFileName, char *outFileName, int denom, int quality) {
+    struct jpeg_decompress_struct in;
+    struct jpeg_compress_struct out;
+    struct jpeg_error_mgr jInErr;
+    struct jpeg_error_mgr jOutErr;
+    JSAMPARRAY rows;
+    FILE *inFile, *outFile;
+    int n;
+
+    if (strcmp(inFileName, "-") == 0) {
+        inFile = stdin;
+    } else {
+        inFile = fopen(inFileName, "rb");
+    }
+    if (!inFile) {
+        fprintf(stderr, "Error opening jpeg file %s\n", inFileName);
+        return -1;
+    }
+
+    if (strcmp(outFileName, "-") == 0) {
+        outFile = stdout;
+    } else {
+        outFile = fopen(outFileName, "wb");
+    }
+    if (!outFile) {
+        fprintf(stderr, "Error opening file %s\n", outFileName);
+        if (inFile != stdin)
+            fclose(inFile);
+        return -1;
+    }
+
+    in.err = jpeg_std_error(&jInErr);
+    jpeg_create_decompress(&in);
+    jpeg_stdio_src(&in, inFile);
+    jpeg_read_header(&in, TRUE);
+
+    in.scale_num = 1;
+    in.scale_denom = denom;
+    in.out_color_space = JCS_YCbCr;
+    in.dct_method = JDCT_IFAST;
+    in.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&in);
+
+    out.err = jpeg_std_error(&jOutErr);
+    jpeg_create_compress(&out);
+    jpeg_stdio_dest(&out, outFile);
+
+    out.image_width = in.output_width;
+    out.image_height = in.output_height;
+    out.input_components = in.output_components;
+    out.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&out);
+    jpeg_set_quality(&out, quality, TRUE);
+    out.dct_method = JDCT_IFAST;
+    jpeg_start_compress(&out, TRUE);
+
+    // Pass the rows as the decoder outputs them
+    rows = (*in.mem->alloc_sarray)((j_common_ptr) &in, JPOOL_IMAGE,
+            in.output_width * in.output_components, in.rec_outbuf_height);
+    while (in.output_scanline < in.output_height) {
+        n = jpeg_read_scanlines(&in, rows, in.rec_outbuf_height);
+        jpeg_write_scanlines(&out, rows, n);
+    }
+
+    jpeg_finish_compress(&out);
+    jpeg_destroy_compress(&out);
+    jpeg_finish_decompress(&in);
+    jpeg_destroy_decompress(&in);
+
+    if (inFile != stdin)
+        fclose(inFile);
+    if (outFile != stdout) {
+        fclose(outFile);
+    } else {
+        fflush(outFile);
+    }
+
+    return 0;
+}
+
 void print_usage(char *progname)
 {
-    fprintf(stderr, "\nUsage: %s -i input_filename -o output_filename [-h]\n\n", progname);
+    fprintf(stderr, "\nUsage: %s -i input_filename -o output_filename [-s denom] [-q quality] [-h]\n\n", progname);
     fprintf(stderr, "\t-i input_filename, --input_file input_filename\n");
-    fprintf(stderr, "\t\tfile to resize\n");
+    fprintf(stderr, "\t\tfile to resize, \"-\" for stdin\n");
     fprintf(stderr, "\t-o output_filename, --output_file output_filename\n");
-    fprintf(stderr, "\t\tresized file\n");
+    fprintf(stderr, "\t\tresized file, \"-\" for stdout\n");
+    fprintf(stderr, "\t-s denom, --scale denom\n");
+    fprintf(stderr, "\t\tfast scale to 1/denom while decoding (1 - 8)\n");
+    fprintf(stderr, "\t\twithout this option the image is resized to 1/3\n");
+    fprintf(stderr, "\t-q quality, --quality quality\n");
+    fprintf(stderr, "\t\tjpeg quality with -s: 0 - 100 (default %d)\n", DEFAULT_QUALITY);
     fprintf(stderr, "\t-d,     --debug\n");
     fprintf(stderr, "\t\tenable debug\n");
     fprintf(stderr, "\t-h,     --help\n");
@@ -221,13 +316,16 @@ void print_usage(char *progname)
 int main(int argc, char **argv) {
     char input_filename[1024];
     char output_filename[1024];
+    int denom;
+    int quality;
     int debug;
     int c;
-    int errno;
     char *endptr;
 
     input_filename[0] = '\0';
     output_filename[0] = '\0';
+    denom = 0;
+    quality = DEFAULT_QUALITY;
     debug = 0;
 
     while (1) {
@@ -235,6 +333,8 @@ int main(int argc, char **argv) {
         {
             {"input_filename",  required_argument, 0, 'i'},
             {"output_filename",  required_argument, 0, 'o'},
+            {"scale",  required_argument, 0, 's'},
+            {"quality",  required_argument, 0, 'q'},
             {"debug",  no_argument, 0, 'd'},
             {"help",  no_argument, 0, 'h'},
             {0, 0, 0, 0}
@@ -242,7 +342,7 @@ int main(int argc, char **argv) {
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "i:o:dh",
+        c = getopt_long (argc, argv, "i:o:s:q:dh",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -271,6 +371,24 @@ int main(int argc, char **argv) {
             }
             break;
 
+        case 's':
+            errno = 0;
+            denom = strtol(optarg, &endptr, 10);
+            if ((errno != 0) || (endptr == optarg) || (denom < 1) || (denom > 8)) {
+                print_usage(argv[0]);
+                return -1;
+            }
+            break;
+
+        case 'q':
+            errno = 0;
+            quality = strtol(optarg, &endptr, 10);
+            if ((errno != 0) || (endptr == optarg) || (quality < 0) || (quality > 100)) {
+                print_usage(argv[0]);
+                return -1;
+            }
+            break;
+
         case 'd':
             fprintf (stderr, "debug on\n");
             debug = 1;
@@ -303,11 +421,17 @@ int main(int argc, char **argv) {
     if (debug) fprintf(stderr, "Reading from %s\n", input_filename);
     if (debug) fprintf(stderr, "Writing to %s\n", output_filename);
 
-    int result = resizeJpegFile(input_filename, output_filename, 1.0f / 3);
+    int result;
+    if (denom > 0) {
+        result = scaleJpegFile(input_filename, output_filename, denom, quality);
+    } else {
+        result = resizeJpegFile(input_filename, output_filename, 1.0f / 3);
+    }
     if (result == 0) {
         if (debug) fprintf(stderr, "Program completed successfully\n");
     } else {
         fprintf(stderr, "Error resizing image\n");
+        return result;
     }
 
     return 0;
@@ -21,50 +21,131 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <getopt.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include "snapshot.h"
+#include <sys/time.h>
+#include "libsnapshot.h"
 
 void print_usage(char *progname)
 {
-    fprintf(stderr, "\nUsage: %s [-f filename [-d] [-h]\n\n", progname);
+    fprintf(stderr, "\nUsage: %s [-f filename] [-a max_age] [-t timeout] [-b N] [-d] [-h]\n\n", progname);
     fprintf(stderr, "\t-f filename, --file filename\n");
     fprintf(stderr, "\t\tsave jpg to filename\n");
+    fprintf(stderr, "\t-a max_age, --max-age max_age\n");
+    fprintf(stderr, "\t\tuse the last jpg if younger than max_age ms, 0 to disable\n");
+    fprintf(stderr, "\t\t(default %d, 0 with -f)\n", SNAPSHOT_MAX_AGE);
+    fprintf(stderr, "\t-t timeout, --timeout timeout\n");
+    fprintf(stderr, "\t\tmax wait in ms (default %d)\n", SNAPSHOT_TIMEOUT);
+    fprintf(stderr, "\t-b N,   --bench N\n");
+    fprintf(stderr, "\t\ttake N snapshots and print the latency, no output\n");
     fprintf(stderr, "\t-d,     --debug\n");
     fprintf(stderr, "\t\tenable debug\n");
     fprintf(stderr, "\t-h,     --help\n");
     fprintf(stderr, "\t\tprint this help\n");
 }
 
+long elapsed_ms(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/*
+ * Take a new jpg without the cache, for the jpgs bigger than SNAPSHOT_MAX_SIZE:
+ * the encoder writes filename, or a temporary file sent to stdout.
+ */
+int snapshot_uncached(const char *filename, int stdout_output, int timeout)
+{
+    char tmp[128];
+    unsigned char buf[4096];
+    FILE *fp;
+    size_t n;
+    int ret;
+
+    if (stdout_output == 0)
+        return snapshot_get_file(filename, timeout);
+
+    sprintf(tmp, "%s/snapshot.%d.jpg", SNAPSHOT_TMP_DIR, (int) getpid());
+    ret = snapshot_get_file(tmp, timeout);
+    if (ret == 0) {
+        fp = fopen(tmp, "r");
+        if (fp == NULL) {
+            ret = SNAPSHOT_ERR_READ;
+        } else {
+            while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+                fwrite(buf, 1, n, stdout);
+            fclose(fp);
+        }
+    }
+    unlink(tmp);
+
+    return ret;
+}
+
+/*
+ * Take n snapshots and print min, average and max latency.
+ */
+int bench_snapshot(unsigned char *buffer, int n, int max_age, int timeout)
+{
+    struct timeval start;
+    long t, t_min = -1, t_max = 0, t_sum = 0;
+    int i, ret;
+    int ok = 0;
+
+    for (i = 0; i < n; i++) {
+        gettimeofday(&start, NULL);
+        ret = snapshot_get_cached(buffer, SNAPSHOT_MAX_SIZE, max_age, timeout);
+        t = elapsed_ms(&start);
+        if (ret < 0) {
+            fprintf(stderr, "Snapshot %d failed: %d\n", i, ret);
+            continue;
+        }
+        if ((t_min < 0) || (t < t_min)) t_min = t;
+        if (t > t_max) t_max = t;
+        t_sum += t;
+        ok++;
+    }
+    if (ok == 0)
+        return -1;
+
+    fprintf(stderr, "%d/%d snapshots, latency min %ld ms, avg %ld ms, max %ld ms\n",
+            ok, n, t_min, t_sum / ok, t_max);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     char filename[1024];
     int debug;
     int c;
-    int errno;
-    char *endptr;
     int stdout_output;
+    int max_age;
+    int timeout;
+    int bench;
+    char *endptr;
 
-    int sockfd;
-    struct sockaddr_in local_addr, avencode_addr;
-    char *message;
-
+    unsigned char *buffer;
     FILE *fp;
-    char buffer[4096];
-    int n_recv;
-    size_t n_read;
+    int ret;
 
     // Setting default
-    tmpnam(filename);
+    filename[0] = '\0';
     stdout_output = 1;
+    max_age = -1;
+    timeout = SNAPSHOT_TIMEOUT;
+    bench = 0;
     debug = 0;
 
     while (1) {
         static struct option long_options[] =
         {
             {"filename",  required_argument, 0, 'f'},
+            {"max-age",  required_argument, 0, 'a'},
+            {"timeout",  required_argument, 0, 't'},
+            {"bench",  required_argument, 0, 'b'},
             {"debug",  no_argument, 0, 'd'},
             {"help",  no_argument, 0, 'h'},
             {0, 0, 0, 0}
@@ -72,7 +153,7 @@ int main(int argc, char **argv)
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "f:dh",
+        c = getopt_long (argc, argv, "f:a:t:b:dh",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -84,12 +165,45 @@ int main(int argc, char **argv)
         case 'f':
             memset(filename, '\0', 1024);
             if (strlen(optarg) >= 1024)
-                strncpy(filename, optarg, 1024);
+                strncpy(filename, optarg, 1023);
             else
                 strncpy(filename, optarg, strlen(optarg));
             stdout_output = 0;
             break;
 
+        case 'a':
+            errno = 0;    /* To distinguish success/failure after call */
+            max_age = strtol(optarg, &endptr, 10);
+
+            /* Check for various possible errors */
+            if ((errno != 0) || (endptr == optarg) || (max_age < 0)) {
+                print_usage(argv[0]);
+                return -1;
+            }
+            break;
+
+        case 't':
+            errno = 0;    /* To distinguish success/failure after call */
+            timeout = strtol(optarg, &endptr, 10);
+
+            /* Check for various possible errors */
+            if ((errno != 0) || (endptr == optarg) || (timeout <= 0)) {
+                print_usage(argv[0]);
+                return -1;
+            }
+            break;
+
+        case 'b':
+            errno = 0;    /* To distinguish success/failure after call */
+            bench = strtol(optarg, &endptr, 10);
+
+            /* Check for various possible errors */
+            if ((errno != 0) || (endptr == optarg) || (bench <= 0)) {
+                print_usage(argv[0]);
+                return -1;
+            }
+            break;
+
         case 'd':
             fprintf (stderr, "debug on\n");
             debug = 1;
@@ -111,72 +225,56 @@ int main(int argc, char **argv)
     }
 
     if (debug) fprintf(stderr, "Starting program\n");
-
-    // Check if snapshot is disabled
-    if (access("/tmp/snapshot.disabled", F_OK ) == 0 ) {
-        fprintf(stderr, "Snapshot is disabled\n");
-        return 0;
-    }
-
-
-    if (debug) fprintf(stderr, "File %s selected\n", filename);
-
-    // Create UDP socket
-    sockfd = socket(AF_INET , SOCK_DGRAM , 0);
-    if (sockfd == -1) {
-        fprintf(stderr, "Could not create socket\n");
-        return -1;
-    }
-
-    local_addr.sin_family = AF_INET;
-    local_addr.sin_addr.s_addr = inet_addr(LOCAL_IP);
-    local_addr.sin_port = htons(0);
-
-    avencode_addr.sin_family = AF_INET;
-    avencode_addr.sin_addr.s_addr = inet_addr(AVENCODE_IP);
-    avencode_addr.sin_port = htons(AVENCODE_PORT);
-
-    // Bind the socket with the local address
-    if (bind(sockfd, (const struct sockaddr *) &local_addr, sizeof(local_addr)) < 0) {
-        fprintf(stderr, "Bind failed\n");
-        return -2;
-    }
-
-    if (debug) fprintf(stderr, "Socket created\n");
-
-    // Build message
-    message = (char *) malloc(MSG_SIZE * sizeof(char));
-    memset(message, '\0', MSG_SIZE);
-    memcpy(message, MSG_PART_1, sizeof(MSG_PART_1) - 1);
-    memcpy(message + sizeof(MSG_PART_1) - 1, filename, strlen(filename));
-    memcpy(message + MSG_SIZE - 4, MSG_PART_3, sizeof(MSG_PART_3) - 1);
-
-    // Send data
-    if (debug) fprintf(stderr, "Sending message to %s port %d\n", AVENCODE_IP, AVENCODE_PORT);
-    if (sendto(sockfd, message, MSG_SIZE, 0,
-                (const struct sockaddr *) &avencode_addr, sizeof(avencode_addr)) < 0) {
-        fprintf(stderr, "Send failed");
-        return -1;
-    }
-    if (debug) fprintf(stderr, "Data successfully sent\n");
-
-    n_recv = recv(sockfd, (char *)buffer, 1024, 0);
-    if (debug) fprintf(stderr, "Confirmation received (%d bytes packet)\n", n_recv);
-
-    sleep(1);
-
-    // Read file and send to stdout
-    if (stdout_output == 1) {
-        if (debug) fprintf(stderr, "Sending file to stdout\n");
-        fp = fopen(filename, "r");
-        if (fp == NULL)
+    snapshot_set_debug(debug);
+
+    // A file is written by the encoder itself, with no size limit
+    if (max_age < 0)
+        max_age = stdout_output ? SNAPSHOT_MAX_AGE : 0;
+
+    if ((stdout_output == 0) && (bench == 0) && (max_age == 0)) {
+        // The encoder writes the file directly
+        if (debug) fprintf(stderr, "File %s selected\n", filename);
+        ret = snapshot_get_file(filename, timeout);
+    } else {
+        buffer = (unsigned char *) malloc(SNAPSHOT_MAX_SIZE);
+        if (buffer == NULL) {
+            fprintf(stderr, "Unable to allocate memory\n");
             return -1;
+        }
+        if (bench > 0) {
+            ret = bench_snapshot(buffer, bench, max_age, timeout);
+        } else {
+            ret = snapshot_get_cached(buffer, SNAPSHOT_MAX_SIZE, max_age, timeout);
+            if ((ret > 0) && (stdout_output == 0)) {
+                if (debug) fprintf(stderr, "Writing file %s\n", filename);
+                fp = fopen(filename, "w");
+                if ((fp == NULL) || (fwrite(buffer, 1, ret, fp) != ret)) {
+                    fprintf(stderr, "Unable to write file %s\n", filename);
+                    ret = -1;
+                }
+                if (fp != NULL)
+                    fclose(fp);
+            } else if (ret > 0) {
+                if (debug) fprintf(stderr, "Sending file to stdout\n");
+                fwrite(buffer, 1, ret, stdout);
+            }
+            if (ret > 0)
+                ret = 0;
+        }
+        free(buffer);
 
-        while ((n_read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
-            fwrite(buffer, 1, n_read, stdout);
+        if ((ret == SNAPSHOT_ERR_SIZE) && (bench == 0)) {
+            if (debug) fprintf(stderr, "Snapshot too big for the cache, taking a new one\n");
+            ret = snapshot_uncached(filename, stdout_output, timeout);
+        }
+    }
 
-        fclose(fp);
-        remove(filename);
+    if (ret == SNAPSHOT_ERR_DISABLED) {
+        fprintf(stderr, "Snapshot is disabled\n");
+        return 0;
+    } else if (ret < 0) {
+        fprintf(stderr, "Snapshot failed: %d\n", ret);
+        return ret;
     }
     if (debug) fprintf(stderr, "Program completed successfully\n");
 
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Bit exact test of the watermark blending.
+ * watermark_blending() and watermark_blending_ajust_brightness() run on
+ * random frames with the C kernels and, if available, the NEON kernels;
+ * the whole frame must match a plain per pixel reference.
+ *
+ * "make test" runs it on the host (C kernels only). To test the NEON
+ * kernels build it for the camera:
+ *   make test_water_mark HOST_CC=$(CROSS)gcc HOST_NEON=1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "water_mark.h"
+#include "yuv.h"
+
+#define BG_WIDTH               640
+#define BG_HEIGHT              64
+#define MAX_FG_WIDTH           100
+#define MAX_FG_HEIGHT          9
+
+static unsigned char fg_y[MAX_PIC][MAX_FG_WIDTH * MAX_FG_HEIGHT];
+static unsigned char fg_c[MAX_PIC][MAX_FG_WIDTH * MAX_FG_HEIGHT];
+static unsigned char fg_a[MAX_PIC][MAX_FG_WIDTH * MAX_FG_HEIGHT];
+
+static unsigned char bg_y[BG_WIDTH * BG_HEIGHT], bg_c[BG_WIDTH * BG_HEIGHT / 2];
+static unsigned char ref_y[BG_WIDTH * BG_HEIGHT], ref_c[BG_WIDTH * BG_HEIGHT / 2];
+
+static void fill_random(unsigned char *p, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        p[i] = rand() & 0xFF;
+}
+
+// Random data with the extremes of alpha and luma more frequent
+static void fill_alpha(unsigned char *p, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        switch (rand() & 7) {
+            case 0: p[i] = 0; break;
+            case 1: p[i] = 255; break;
+            default: p[i] = rand() & 0xFF; break;
+        }
+    }
+}
+
+static unsigned char ref_blend(unsigned char bg, int fg, unsigned char a)
+{
+    return ((256 - a) * bg + fg * a) >> 8;
+}
+
+// The same as region_bright_or_dark(), one row at a time
+static int ref_bright(int left, int top, int w, int h)
+{
+    int i, j, sum, bright = 0;
+
+    for (i = 0; i < h; i++) {
+        sum = 0;
+        for (j = 0; j < w; j++)
+            sum += ref_y[(top + i) * BG_WIDTH + left + j];
+        if (sum / w > 128)
+            bright++;
+    }
+
+    return bright > h / 2;
+}
+
+static void ref_watermark(WaterMarkInfo *wm, ShowWaterMarkParam *param, int adjust)
+{
+    int n, i, j, left, top, invert;
+    int w = wm->width, h = wm->height;
+    SinglePicture *pic;
+    unsigned char *y, *c;
+
+    for (n = 0; n < param->number; n++) {
+        pic = &wm->single_pic[param->id_list[n]];
+        left = param->pos.x + w * n;
+        top = param->pos.y;
+        invert = adjust ? ref_bright(left, top, w, h) : 0;
+
+        for (i = 0; i < h; i++) {
+            for (j = 0; j < w; j++) {
+                y = &ref_y[(top + i) * BG_WIDTH + left + j];
+                *y = ref_blend(*y, invert ? 256 - pic->y[i * w + j] : pic->y[i * w + j],
+                        pic->alph[i * w + j]);
+                if ((i & 1) == 0) {
+                    c = &ref_c[((top >> 1) + i / 2) * BG_WIDTH + left + j];
+                    *c = ref_blend(*c, pic->c[(i / 2) * w + j], pic->alph[i * w + j]);
+                }
+            }
+        }
+    }
+}
+
+static int run(int neon, int adjust, int width, int height, int number)
+{
+    BackGroudLayerInfo bg;
+    WaterMarkInfo wm;
+    ShowWaterMarkParam param;
+    int i, k, ret;
+
+    memset(&wm, 0, sizeof(wm));
+    wm.width = width;
+    wm.height = height;
+    wm.picture_number = MAX_PIC;
+    for (i = 0; i < MAX_PIC; i++) {
+        fill_random(fg_y[i], width * height);
+        fill_random(fg_c[i], width * height);
+        fill_alpha(fg_a[i], width * height);
+        wm.single_pic[i].id = i;
+        wm.single_pic[i].y = fg_y[i];
+        wm.single_pic[i].c = fg_c[i];
+        wm.single_pic[i].alph = fg_a[i];
+    }
+
+    memset(&param, 0, sizeof(param));
+    param.number = number;
+    for (i = 0; i < number; i++)
+        param.id_list[i] = rand() % MAX_PIC;
+    param.pos.x = rand() % (BG_WIDTH - width * number + 1);
+    param.pos.y = (rand() % (BG_HEIGHT - height - 1)) & ~1;
+
+    // Dark, bright or random background to hit both sides of the brightness check
+    k = rand() % 3;
+    for (i = 0; i < BG_WIDTH * BG_HEIGHT; i++)
+        bg_y[i] = (k == 0) ? rand() & 0x7F : (k == 1) ? 128 + (rand() & 0x7F) : rand() & 0xFF;
+    fill_random(bg_c, sizeof(bg_c));
+    memcpy(ref_y, bg_y, sizeof(bg_y));
+    memcpy(ref_c, bg_c, sizeof(bg_c));
+
+    bg.width = BG_WIDTH;
+    bg.height = BG_HEIGHT;
+    bg.y = bg_y;
+    bg.c = bg_c;
+
+    yuv_set_neon(neon);
+    if (adjust)
+        ret = watermark_blending_ajust_brightness(&bg, &wm, &param);
+    else
+        ret = watermark_blending(&bg, &wm, &param);
+    ref_watermark(&wm, &param, adjust);
+
+    if ((ret != 0) || (memcmp(bg_y, ref_y, sizeof(bg_y)) != 0) || (memcmp(bg_c, ref_c, sizeof(bg_c)) != 0)) {
+        fprintf(stderr, "FAIL: %s %s, width %d height %d number %d at %d,%d\n",
+                neon ? "neon" : "c", adjust ? "adjust_brightness" : "blending",
+                width, height, number, param.pos.x, param.pos.y);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int modes[2] = { 0, 1 };
+    int m, adjust, width, height, number, iter;
+    int tests = 0, failed = 0;
+
+    srand(1);
+
+    for (m = 0; m < 2; m++) {
+        if (modes[m] && !yuv_neon_available()) {
+            printf("neon: not available, skipped\n");
+            continue;
+        }
+        for (adjust = 0; adjust < 2; adjust++) {
+            // Every width up to MAX_FG_WIDTH: most of them are not multiples of 8 or 16
+            for (width = 1; width <= MAX_FG_WIDTH; width++) {
+                for (height = 1; height <= MAX_FG_HEIGHT; height++) {
+                    for (iter = 0; iter < 2; iter++) {
+                        number = 1 + rand() % 4;
+                        if (width * number > BG_WIDTH)
+                            number = 1;
+                        failed += run(modes[m], adjust, width, height, number);
+                        tests++;
+                    }
+                }
+            }
+        }
+        printf("%s: done\n", modes[m] ? "neon" : "c");
+    }
+
+    printf("%d tests, %d failed\n", tests, failed);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Thumbnail daemon: waits for new mp4 files in the alarm record folder
+ * and creates a low resolution jpg with the first i-frame of each file.
+ * The i-frame is extracted in memory, the decoder is kept open and the
+ * jpg is encoded only once.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/inotify.h>
+
+#include "convert2jpg.h"
+#include "add_water.h"
+#include "decoder.h"
+#include "mp4demux.h"
+#include "yuv_scale.h"
+
+#define FOLDER_TO_WATCH "/mnt/mmc/alarm_record"
+#define FILE_EXT        ".mp4"
+#define THUMB_EXT       ".jpg"
+#define TMP_EXT         ".tmp"
+
+#define PATH_RES_LOW  "/mnt/mmc/sonoff-hack/etc/wm_res/low/wm_540p_"
+#define PATH_RES_HIGH "/mnt/mmc/sonoff-hack/etc/wm_res/high/wm_540p_"
+
+#define W_LOW 640
+#define H_LOW 360
+#define W_FHD 1920
+#define H_FHD 1080
+
+// The thumbnails of the old thumb.sh chain were encoded by resize_jpg
+// with the libjpeg default quality (the -q 50 jpg was only intermediate)
+#define THUMB_QUALITY 75
+
+#define MAX_WATCHES 32
+#define EVENT_BUF_LEN (16 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+typedef struct {
+    int wd;
+    int depth;
+    char path[PATH_MAX];
+} watch_t;
+
+int debug;
+
+static char root[PATH_MAX];
+static int quality;
+static int watermark;
+static int thumb_width, thumb_height;
+
+static unsigned char *bufferyuv;
+static unsigned char *bufferthumb;
+
+static WaterMarkInfo wm_info;
+static int wm_width;
+
+static int ifd;
+static watch_t watches[MAX_WATCHES];
+
+static volatile sig_atomic_t quit;
+
+static void sig_handler(int sig)
+{
+    quit = 1;
+}
+
+static int ends_with(const char *s, const char *ext)
+{
+    int ls = strlen(s);
+    int le = strlen(ext);
+
+    return (ls > le) && (strcmp(s + ls - le, ext) == 0);
+}
+
+/*
+ * Flush the file to the sd card: only the thumbnail, not the whole
+ * filesystem as sync() does while the recorder is writing.
+ */
+static int fsync_file(const char *file)
+{
+    int fd, ret;
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    ret = fsync(fd);
+    close(fd);
+
+    return ret;
+}
+
+/*
+ * Load the watermark resources for the resolution of the frame,
+ * they are kept in memory until the resolution changes.
+ */
+static int add_watermark(unsigned char *buffer, int w_res, int h_res)
+{
+    char path_res[1024];
+
+    if (wm_width != w_res) {
+        if (wm_width != 0) {
+            WMRelease(&wm_info);
+            wm_width = 0;
+        }
+        if (w_res != W_LOW) {
+            strcpy(path_res, PATH_RES_HIGH);
+        } else {
+            strcpy(path_res, PATH_RES_LOW);
+        }
+        if (WMInit(&wm_info, path_res) < 0) {
+            fprintf(stderr, "water mark init error\n");
+            return -1;
+        }
+        wm_width = w_res;
+    }
+
+    if (w_res != W_LOW) {
+        AddWM(&wm_info, w_res, h_res, buffer,
+            buffer + w_res*h_res, w_res-460, h_res-40, NULL);
+    } else {
+        AddWM(&wm_info, w_res, h_res, buffer,
+            buffer + w_res*h_res, w_res-230, h_res-20, NULL);
+    }
+
+    return 0;
+}
+
+/*
+ * Create the thumbnail of the mp4 file, if not already present.
+ */
+static int create_thumb(const char *file)
+{
+    char thumb[PATH_MAX];
+    char tmp[PATH_MAX];
+    mp4_frame_t frame;
+    int width, height, ret;
+    struct timeval tv_start, tv_end;
+
+    if (!ends_with(file, FILE_EXT))
+        return 0;
+    if (debug) fprintf(stderr, "New file %s\n", file);
+    if (strlen(file) - strlen(FILE_EXT) + strlen(THUMB_EXT) + strlen(TMP_EXT) >= PATH_MAX)
+        return -1;
+
+    strcpy(thumb, file);
+    strcpy(thumb + strlen(thumb) - strlen(FILE_EXT), THUMB_EXT);
+    if (access(thumb, F_OK) == 0) {
+        if (debug) fprintf(stderr, "Ignore file %s, already present\n", thumb);
+        return 0;
+    }
+    sprintf(tmp, "%s%s", thumb, TMP_EXT);
+
+    if (debug) gettimeofday(&tv_start, NULL);
+
+    ret = mp4_read_idr(file, &frame);
+    if (ret < 0) {
+        fprintf(stderr, "Demux mp4 failed (%d) - %s\n", ret, file);
+        return -1;
+    }
+
+    ret = decoder_decode(bufferyuv, W_FHD * H_FHD * 3 / 2, frame.buf, frame.len, frame.codec, &width, &height);
+    mp4_frame_free(&frame);
+    if (ret < 0) {
+        fprintf(stderr, "Decode frame failed (%d) - %s\n", ret, file);
+        return -1;
+    }
+
+    if (watermark) {
+        if (debug) fprintf(stderr, "Adding watermark\n");
+        add_watermark(bufferyuv, width, height);
+    }
+
+    if (nv12_scale(bufferyuv, width, height, bufferthumb, thumb_width, thumb_height) < 0) {
+        fprintf(stderr, "Resize failed - %s\n", file);
+        return -1;
+    }
+
+    if (YUVtoJPG(tmp, bufferthumb, thumb_width, thumb_height, thumb_width, thumb_height, quality) < 0) {
+        fprintf(stderr, "Create jpg failed - %s\n", file);
+        unlink(tmp);
+        return -1;
+    }
+    // The data must be on disk before the rename makes the thumbnail visible
+    if (fsync_file(tmp) < 0) {
+        fprintf(stderr, "Sync failed - %s\n", tmp);
+        unlink(tmp);
+        return -1;
+    }
+    if (rename(tmp, thumb) < 0) {
+        fprintf(stderr, "Rename failed - %s\n", tmp);
+        unlink(tmp);
+        return -1;
+    }
+
+    if (debug) {
+        gettimeofday(&tv_end, NULL);
+        fprintf(stderr, "Thumbnail %s created in %ld ms\n", thumb,
+                ((tv_end.tv_sec - tv_start.tv_sec) * 1000000L + (tv_end.tv_usec - tv_start.tv_usec)) / 1000);
+    }
+
+    return 0;
+}
+
+/*
+ * Create the missing thumbnails of the folder and of its subfolders.
+ */
+static void scan_dir(const char *path, int depth)
+{
+    struct dirent **namelist;
+    char file[PATH_MAX];
+    struct stat st;
+    int i, n;
+
+    n = scandir(path, &namelist, NULL, alphasort);
+    if (n < 0)
+        return;
+
+    for (i = 0; i < n; i++) {
+        if ((namelist[i]->d_name[0] != '.') &&
+                (snprintf(file, sizeof(file), "%s/%s", path, namelist[i]->d_name) < sizeof(file)) &&
+                (stat(file, &st) == 0)) {
+            if (S_ISDIR(st.st_mode)) {
+                if (depth > 0)
+                    scan_dir(file, depth - 1);
+            } else if (S_ISREG(st.st_mode)) {
+                create_thumb(file);
+            }
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
+}
+
+/*
+ * Return the most recent subfolder of path (names are yyyymmdd, yyyymmddhh, ...).
+ */
+static int newest_dir(const char *path, char *newest, int size)
+{
+    struct dirent **namelist;
+    char file[PATH_MAX];
+    struct stat st;
+    int i, n, found = -1;
+
+    n = scandir(path, &namelist, NULL, alphasort);
+    if (n < 0)
+        return -1;
+
+    for (i = n - 1; i >= 0; i--) {
+        if ((found < 0) && (namelist[i]->d_name[0] != '.') &&
+                (snprintf(file, sizeof(file), "%s/%s", path, namelist[i]->d_name) < sizeof(file)) &&
+                (stat(file, &st) == 0) && S_ISDIR(st.st_mode) && (strlen(file) < size)) {
+            strcpy(newest, file);
+            found = 0;
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
+
+    return found;
+}
+
+static int add_watch(const char *path, int depth)
+{
+    int i, wd;
+
+    for (i = 0; i < MAX_WATCHES; i++) {
+        if (watches[i].wd < 0)
+            break;
+    }
+    if (i == MAX_WATCHES) {
+        fprintf(stderr, "Too many folders to watch - %s\n", path);
+        return -1;
+    }
+
+    wd = inotify_add_watch(ifd, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0) {
+        fprintf(stderr, "Unable to watch %s\n", path);
+        return -1;
+    }
+    watches[i].wd = wd;
+    watches[i].depth = depth;
+    strcpy(watches[i].path, path);
+    if (debug) fprintf(stderr, "Watching %s\n", path);
+
+    return 0;
+}
+
+/*
+ * Watch a new record folder and its subfolders, then create the thumbnails
+ * of the files written before the watch was added.
+ */
+static void add_record_dir(const char *path, int depth)
+{
+    struct dirent **namelist;
+    char file[PATH_MAX];
+    struct stat st;
+    int i, n;
+
+    if (add_watch(path, depth) < 0)
+        return;
+
+    n = scandir(path, &namelist, NULL, alphasort);
+    if (n < 0)
+        return;
+
+    for (i = 0; i < n; i++) {
+        if ((namelist[i]->d_name[0] != '.') &&
+                (snprintf(file, sizeof(file), "%s/%s", path, namelist[i]->d_name) < sizeof(file)) &&
+                (stat(file, &st) == 0)) {
+            if (S_ISDIR(st.st_mode))
+                add_record_dir(file, depth + 1);
+            else if (S_ISREG(st.st_mode))
+                create_thumb(file);
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
+}
+
+/*
+ * Recordings are written only in the newest folder: when a new one is
+ * created below the root, the watches of the older ones are removed.
+ */
+static void remove_record_dirs(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_WATCHES; i++) {
+        if ((watches[i].wd >= 0) && (watches[i].depth > 0)) {
+            inotify_rm_watch(ifd, watches[i].wd);
+            watches[i].wd = -1;
+        }
+    }
+}
+
+static watch_t *find_watch(int wd)
+{
+    int i;
+
+    for (i = 0; i < MAX_WATCHES; i++) {
+        if (watches[i].wd == wd)
+            return &watches[i];
+    }
+
+    return NULL;
+}
+
+static void handle_event(struct inotify_event *event)
+{
+    char path[PATH_MAX];
+    watch_t *w;
+
+    w = find_watch(event->wd);
+    if (w == NULL)
+        return;
+
+    if (event->mask & IN_IGNORED) {
+        // Folder removed
+        w->wd = -1;
+        return;
+    }
+    if (event->len == 0)
+        return;
+    if (snprintf(path, sizeof(path), "%s/%s", w->path, event->name) >= sizeof(path))
+        return;
+
+    if (event->mask & IN_ISDIR) {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            if (w->depth == 0)
+                remove_record_dirs();
+            add_record_dir(path, w->depth + 1);
+        }
+    } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        create_thumb(path);
+    }
+}
+
+void usage(char *prog_name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", prog_name);
+    fprintf(stderr, "\t-f, --folder FOLDER     Folder to watch (default %s)\n", FOLDER_TO_WATCH);
+    fprintf(stderr, "\t-s, --size WxH          Thumbnail size (default %dx%d)\n", W_LOW, H_LOW);
+    fprintf(stderr, "\t-q, --quality Q         Set jpeg quality: 0 - 100 (default %d)\n", THUMB_QUALITY);
+    fprintf(stderr, "\t-w, --watermark         Add watermark to image\n");
+    fprintf(stderr, "\t-o, --one-shot          Scan the newest folder and exit\n");
+    fprintf(stderr, "\t-d, --debug             Enable debug\n");
+    fprintf(stderr, "\t-h, --help              Show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+    char *endptr;
+    char newest[PATH_MAX];
+    char event_buf[EVENT_BUF_LEN] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *event;
+    struct sigaction sa;
+    int one_shot = 0;
+    int c, i, len;
+
+    strcpy(root, FOLDER_TO_WATCH);
+    quality = THUMB_QUALITY;
+    watermark = 0;
+    thumb_width = W_LOW;
+    thumb_height = H_LOW;
+    debug = 0;
+
+    while (1) {
+        static struct option long_options[] = {
+            {"folder",    required_argument, 0, 'f'},
+            {"size",      required_argument, 0, 's'},
+            {"quality",   required_argument, 0, 'q'},
+            {"watermark", no_argument,       0, 'w'},
+            {"one-shot",  no_argument,       0, 'o'},
+            {"debug",     no_argument,       0, 'd'},
+            {"help",      no_argument,       0, 'h'},
+            {0,           0,                 0,  0 }
+        };
+
+        int option_index = 0;
+        c = getopt_long(argc, argv, "f:s:q:wodh",
+            long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'f':
+                if (strlen(optarg) < sizeof(root)) {
+                    strcpy(root, optarg);
+                }
+                break;
+
+            case 's':
+                if ((sscanf(optarg, "%dx%d", &thumb_width, &thumb_height) != 2) ||
+                        (thumb_width < 2) || (thumb_width > W_FHD) || (thumb_width & 1) ||
+                        (thumb_height < 2) || (thumb_height > H_FHD) || (thumb_height & 1)) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'q':
+                errno = 0;    /* To distinguish success/failure after call */
+                quality = strtol(optarg, &endptr, 10);
+
+                /* Check for various possible errors */
+                if ((errno == ERANGE) && (quality == LONG_MAX || quality == LONG_MIN)) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                if (endptr == optarg) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                if ((quality < 0) || (quality > 100)) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'w':
+                watermark = 1;
+                break;
+
+            case 'o':
+                one_shot = 1;
+                break;
+
+            case 'd':
+                debug = 1;
+                break;
+
+            case 'h':
+            default:
+                usage(argv[0]);
+                exit(-1);
+                break;
+        }
+    }
+
+    if (debug) fprintf(stderr, "Starting program\n");
+
+    bufferyuv = (unsigned char *) malloc(W_FHD * H_FHD * 3 / 2);
+    bufferthumb = (unsigned char *) malloc(thumb_width * thumb_height * 3 / 2);
+    if ((bufferyuv == NULL) || (bufferthumb == NULL)) {
+        fprintf(stderr, "Unable to allocate memory\n");
+        exit(-2);
+    }
+
+    if (one_shot) {
+        if (newest_dir(root, newest, sizeof(newest)) == 0)
+            scan_dir(newest, 2);
+        decoder_close();
+        free(bufferthumb);
+        free(bufferyuv);
+        return 0;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (i = 0; i < MAX_WATCHES; i++)
+        watches[i].wd = -1;
+
+    ifd = inotify_init();
+    if (ifd < 0) {
+        fprintf(stderr, "Unable to init inotify\n");
+        exit(-3);
+    }
+
+    mkdir(root, 0755);
+    if (add_watch(root, 0) < 0)
+        exit(-4);
+    if (newest_dir(root, newest, sizeof(newest)) == 0)
+        add_record_dir(newest, 1);
+
+    while (!quit) {
+        len = read(ifd, event_buf, sizeof(event_buf));
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error reading inotify events\n");
+            break;
+        }
+
+        for (i = 0; i < len; i += sizeof(struct inotify_event) + event->len) {
+            event = (struct inotify_event *) &event_buf[i];
+            handle_event(event);
+        }
+
+        // The root folder has been removed
+        if (watches[0].wd < 0) {
+            fprintf(stderr, "Folder %s removed\n", root);
+            break;
+        }
+    }
+
+    if (debug) fprintf(stderr, "Exiting\n");
+
+    close(ifd);
+    if (wm_width != 0)
+        WMRelease(&wm_info);
+    decoder_close();
+    free(bufferthumb);
+    free(bufferyuv);
+
+    return 0;
+}
@@ -30,6 +30,8 @@ typedef struct WaterMarkInfo
     unsigned int height; //single pic height
     unsigned int picture_number;
     SinglePicture single_pic[MAX_PIC];
+    void *atlas; //mapped atlas, NULL if the pictures are allocated
+    unsigned int atlas_size;
 }WaterMarkInfo;
 
 typedef struct WaterMarkPositon
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * NEON versions of the water_mark.c row kernels, see water_mark_neon.h.
+ */
+
+#include <stdint.h>
+#include <arm_neon.h>
+
+#include "water_mark_neon.h"
+
+// (256 - a) * bg is computed as (255 - a) * bg + bg to stay in 8 bit
+// lanes, the result is the same of the C code.
+int watermark_blending_row_neon(unsigned char *bg, const unsigned char *fg,
+            const unsigned char *alph, int width, int invert)
+{
+    uint8x8_t v255 = vdup_n_u8(255);
+    uint8x8_t a, b, c;
+    uint16x8_t acc;
+    int j;
+
+    for (j = 0; j + 8 <= width; j += 8) {
+        a = vld1_u8(alph + j);
+        b = vld1_u8(bg + j);
+        c = vld1_u8(fg + j);
+
+        acc = vmull_u8(vsub_u8(v255, a), b);
+        acc = vaddw_u8(acc, b);
+        if (invert) {
+            // (256 - fg) * a = (255 - fg) * a + a, max sum is 65535
+            acc = vmlal_u8(acc, vsub_u8(v255, c), a);
+            acc = vaddw_u8(acc, a);
+        } else {
+            acc = vmlal_u8(acc, c, a);
+        }
+        vst1_u8(bg + j, vshrn_n_u16(acc, 8));
+    }
+
+    return j;
+}
+
+// Add the sum of the first pixels to *sum
+int watermark_row_sum_neon(const unsigned char *p, int width, int *sum)
+{
+    uint32x4_t acc = vdupq_n_u32(0);
+    uint32_t lane[4];
+    int j;
+
+    for (j = 0; j + 16 <= width; j += 16) {
+        acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(p + j)));
+    }
+    vst1q_u32(lane, acc);
+    *sum += lane[0] + lane[1] + lane[2] + lane[3];
+
+    return j;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * NEON row kernels of the watermark blending, built with the NEON flags
+ * like yuv_neon.c. They return the number of pixels done, the caller
+ * finishes the row in C.
+ */
+
+#ifndef WATER_MARK_NEON_H
+#define WATER_MARK_NEON_H
+
+int watermark_blending_row_neon(unsigned char *bg, const unsigned char *fg,
+            const unsigned char *alph, int width, int invert);
+int watermark_row_sum_neon(const unsigned char *p, int width, int *sum);
+
+#endif // WATER_MARK_NEON_H
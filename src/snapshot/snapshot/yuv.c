@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * YUV row kernels, C and NEON versions.
+ * The NEON kernels (yuv_neon.c) are built only with make NEON=1, which
+ * defines HAVE_NEON, and they're used only if the cpu reports NEON in the
+ * hwcap. This file is built without the NEON flags, it must run on any cpu.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "yuv.h"
+
+#ifdef HAVE_NEON
+#include "yuv_neon.h"
+#endif
+
+#define AT_HWCAP      16
+#define HWCAP_NEON    (1 << 12)
+
+static int neon = -1;
+
+#ifdef HAVE_NEON
+static int cpu_has_neon(void)
+{
+    FILE *fp;
+    unsigned long aux[2];
+    int ret = 0;
+
+    fp = fopen("/proc/self/auxv", "r");
+    if (fp == NULL)
+        return 0;
+
+    while (fread(aux, sizeof(aux), 1, fp) == 1) {
+        if (aux[0] == AT_HWCAP) {
+            ret = (aux[1] & HWCAP_NEON) != 0;
+            break;
+        }
+    }
+    fclose(fp);
+
+    return ret;
+}
+#endif
+
+/*
+ * Return 1 if the NEON kernels are built and the cpu supports them.
+ */
+int yuv_neon_available(void)
+{
+#ifdef HAVE_NEON
+    static int available = -1;
+
+    if (available < 0)
+        available = cpu_has_neon();
+    return available;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Select the NEON or the C kernels, NEON is used by default when available.
+ * Return the selected mode.
+ */
+int yuv_set_neon(int enable)
+{
+    neon = enable && yuv_neon_available();
+    return neon;
+}
+
+int yuv_get_neon(void)
+{
+    if (neon < 0)
+        neon = yuv_neon_available();
+    return neon;
+}
+
+/*
+ * Build a libjpeg YCbCr scanline (Y Cb Cr for every pixel) from a
+ * luma row and the NV12 chroma row shared with it.
+ * width must be even.
+ */
+void yuv_nv12_to_ycbcr_row(uint8_t *dst, const uint8_t *y, const uint8_t *uv, int width)
+{
+    int i = 0;
+
+#ifdef HAVE_NEON
+    if (yuv_get_neon())
+        i = yuv_nv12_to_ycbcr_row_neon(dst, y, uv, width);
+#endif
+
+    for (; i < width; i += 2) {
+        dst[i * 3 + 0] = y[i];          // Y (unique to this pixel)
+        dst[i * 3 + 1] = uv[i];         // U (shared between pixels)
+        dst[i * 3 + 2] = uv[i + 1];     // V (shared between pixels)
+        dst[i * 3 + 3] = y[i + 1];      // Y (unique to this pixel)
+        dst[i * 3 + 4] = uv[i];         // U (shared between pixels)
+        dst[i * 3 + 5] = uv[i + 1];     // V (shared between pixels)
+    }
+}
+
+/*
+ * Split a NV12 chroma row in the U and V rows.
+ * width is the luma width, must be even.
+ */
+void yuv_split_uv_row(uint8_t *u, uint8_t *v, const uint8_t *uv, int width)
+{
+    int i = 0;
+
+#ifdef HAVE_NEON
+    if (yuv_get_neon())
+        i = yuv_split_uv_row_neon(u, v, uv, width);
+#endif
+
+    for (; i < width; i += 2) {
+        u[i / 2] = uv[i];
+        v[i / 2] = uv[i + 1];
+    }
+}
+
+/*
+ * Merge the U and V rows in a NV12 chroma row.
+ * width is the luma width, must be even.
+ */
+void yuv_merge_uv_row(uint8_t *uv, const uint8_t *u, const uint8_t *v, int width)
+{
+    int i = 0;
+
+#ifdef HAVE_NEON
+    if (yuv_get_neon())
+        i = yuv_merge_uv_row_neon(uv, u, v, width);
+#endif
+
+    for (; i < width; i += 2) {
+        uv[i] = u[i / 2];
+        uv[i + 1] = v[i / 2];
+    }
+}
+
+/*
+ * Convert the planes of a decoded I420 picture, with their line sizes,
+ * to a packed NV12 buffer (width * height * 3 / 2 bytes).
+ */
+void yuv_i420_to_nv12(uint8_t *dst, int width, int height,
+        const uint8_t *y, int y_stride, const uint8_t *u, int u_stride, const uint8_t *v, int v_stride)
+{
+    uint8_t *uv = dst + width * height;
+    int i;
+
+    if (y_stride == width) {
+        memcpy(dst, y, width * height);
+    } else {
+        for (i = 0; i < height; i++)
+            memcpy(dst + i * width, y + i * y_stride, width);
+    }
+
+    for (i = 0; i < height / 2; i++)
+        yuv_merge_uv_row(uv + i * width, u + i * u_stride, v + i * v_stride, width);
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * YUV row kernels, C and NEON versions.
+ */
+
+#ifndef YUV_H
+#define YUV_H
+
+#include <stdint.h>
+
+int yuv_neon_available(void);
+int yuv_set_neon(int enable);
+int yuv_get_neon(void);
+
+void yuv_nv12_to_ycbcr_row(uint8_t *dst, const uint8_t *y, const uint8_t *uv, int width);
+void yuv_split_uv_row(uint8_t *u, uint8_t *v, const uint8_t *uv, int width);
+void yuv_merge_uv_row(uint8_t *uv, const uint8_t *u, const uint8_t *v, int width);
+void yuv_i420_to_nv12(uint8_t *dst, int width, int height,
+        const uint8_t *y, int y_stride, const uint8_t *u, int u_stride, const uint8_t *v, int v_stride);
+
+#endif // YUV_H
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * NEON versions of the yuv.c row kernels, see yuv_neon.h.
+ */
+
+#include <stdint.h>
+#include <arm_neon.h>
+
+#include "yuv_neon.h"
+
+int yuv_nv12_to_ycbcr_row_neon(uint8_t *dst, const uint8_t *y, const uint8_t *uv, int width)
+{
+    uint8x16x3_t ycc;
+    uint8x8x2_t c;
+    uint8x8x2_t u2, v2;
+    int i;
+
+    for (i = 0; i + 16 <= width; i += 16) {
+        ycc.val[0] = vld1q_u8(y + i);
+        c = vld2_u8(uv + i);
+        u2 = vzip_u8(c.val[0], c.val[0]);
+        v2 = vzip_u8(c.val[1], c.val[1]);
+        ycc.val[1] = vcombine_u8(u2.val[0], u2.val[1]);
+        ycc.val[2] = vcombine_u8(v2.val[0], v2.val[1]);
+        vst3q_u8(dst + i * 3, ycc);
+    }
+
+    return i;
+}
+
+int yuv_split_uv_row_neon(uint8_t *u, uint8_t *v, const uint8_t *uv, int width)
+{
+    uint8x16x2_t c;
+    int i;
+
+    for (i = 0; i + 32 <= width; i += 32) {
+        c = vld2q_u8(uv + i);
+        vst1q_u8(u + i / 2, c.val[0]);
+        vst1q_u8(v + i / 2, c.val[1]);
+    }
+
+    return i;
+}
+
+int yuv_merge_uv_row_neon(uint8_t *uv, const uint8_t *u, const uint8_t *v, int width)
+{
+    uint8x16x2_t c;
+    int i;
+
+    for (i = 0; i + 32 <= width; i += 32) {
+        c.val[0] = vld1q_u8(u + i / 2);
+        c.val[1] = vld1q_u8(v + i / 2);
+        vst2q_u8(uv + i, c);
+    }
+
+    return i;
+}
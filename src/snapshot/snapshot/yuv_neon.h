@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * NEON row kernels, in their own file: only this file is built with the
+ * NEON flags. Every kernel handles the largest multiple of its block size
+ * and returns the number of pixels done, the caller finishes the row in C.
+ */
+
+#ifndef YUV_NEON_H
+#define YUV_NEON_H
+
+#include <stdint.h>
+
+int yuv_nv12_to_ycbcr_row_neon(uint8_t *dst, const uint8_t *y, const uint8_t *uv, int width);
+int yuv_split_uv_row_neon(uint8_t *u, uint8_t *v, const uint8_t *uv, int width);
+int yuv_merge_uv_row_neon(uint8_t *uv, const uint8_t *u, const uint8_t *v, int width);
+
+#endif // YUV_NEON_H
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fixed point NV12 scaler.
+ * Box filter (area average) when both sides are reduced by 2 or more,
+ * bilinear otherwise. Luma and interleaved chroma are handled by the
+ * same code, the chroma plane is a half size plane with 2 components.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "yuv_scale.h"
+
+static void scale_box(const unsigned char *src, int sw, int sh, int comps,
+        unsigned char *dst, int dw, int dh, int *xs)
+{
+    int dx, dy, x, y, k, y0, y1, count;
+    uint32_t sum[2];
+    const unsigned char *s;
+
+    for (dx = 0; dx <= dw; dx++)
+        xs[dx] = (int) (((int64_t) dx * sw) / dw);
+
+    for (dy = 0; dy < dh; dy++) {
+        y0 = (int) (((int64_t) dy * sh) / dh);
+        y1 = (int) (((int64_t) (dy + 1) * sh) / dh);
+        for (dx = 0; dx < dw; dx++) {
+            sum[0] = sum[1] = 0;
+            for (y = y0; y < y1; y++) {
+                s = src + (y * sw + xs[dx]) * comps;
+                for (x = xs[dx]; x < xs[dx + 1]; x++) {
+                    for (k = 0; k < comps; k++)
+                        sum[k] += *s++;
+                }
+            }
+            // Rounded division: a truncated 16.16 reciprocal biases to dark
+            count = (y1 - y0) * (xs[dx + 1] - xs[dx]);
+            for (k = 0; k < comps; k++)
+                *dst++ = (sum[k] + (count >> 1)) / count;
+        }
+    }
+}
+
+static void scale_bilinear(const unsigned char *src, int sw, int sh, int comps,
+        unsigned char *dst, int dw, int dh, int *xs)
+{
+    int dx, dy, k, y0, y1, fy, x0, x1, fx;
+    int32_t pos, step;
+    uint32_t top, bottom;
+    const unsigned char *r0, *r1;
+
+    // Source x in 16.16, pixel centers aligned
+    step = (int32_t) (((int64_t) sw << 16) / dw);
+    for (dx = 0; dx < dw; dx++) {
+        pos = (dx * step) + (step >> 1) - 32768;
+        if (pos < 0) pos = 0;
+        if (pos > ((sw - 1) << 16)) pos = (sw - 1) << 16;
+        xs[dx] = pos;
+    }
+
+    step = (int32_t) (((int64_t) sh << 16) / dh);
+    for (dy = 0; dy < dh; dy++) {
+        pos = (dy * step) + (step >> 1) - 32768;
+        if (pos < 0) pos = 0;
+        if (pos > ((sh - 1) << 16)) pos = (sh - 1) << 16;
+        y0 = pos >> 16;
+        y1 = (y0 + 1 < sh) ? y0 + 1 : y0;
+        fy = (pos >> 8) & 0xFF;
+        r0 = src + y0 * sw * comps;
+        r1 = src + y1 * sw * comps;
+
+        for (dx = 0; dx < dw; dx++) {
+            x0 = xs[dx] >> 16;
+            x1 = (x0 + 1 < sw) ? x0 + 1 : x0;
+            fx = (xs[dx] >> 8) & 0xFF;
+            for (k = 0; k < comps; k++) {
+                top = r0[x0 * comps + k] * (256 - fx) + r0[x1 * comps + k] * fx;
+                bottom = r1[x0 * comps + k] * (256 - fx) + r1[x1 * comps + k] * fx;
+                *dst++ = (top * (256 - fy) + bottom * fy + 32768) >> 16;
+            }
+        }
+    }
+}
+
+static void scale_plane(const unsigned char *src, int sw, int sh, int comps,
+        unsigned char *dst, int dw, int dh, int *xs)
+{
+    if ((sw >= 2 * dw) && (sh >= 2 * dh))
+        scale_box(src, sw, sh, comps, dst, dw, dh, xs);
+    else
+        scale_bilinear(src, sw, sh, comps, dst, dw, dh, xs);
+}
+
+/*
+ * Scale the NV12 image src to dst (dst_width * dst_height * 3 / 2 bytes).
+ * All sizes must be even.
+ * Return 0 on success, -1 on error.
+ */
+int nv12_scale(const unsigned char *src, int src_width, int src_height,
+        unsigned char *dst, int dst_width, int dst_height)
+{
+    int *xs;
+
+    if ((src_width < 2) || (src_height < 2) || (dst_width < 2) || (dst_height < 2) ||
+            (src_width & 1) || (src_height & 1) || (dst_width & 1) || (dst_height & 1))
+        return -1;
+
+    xs = (int *) malloc((dst_width + 1) * sizeof(int));
+    if (xs == NULL)
+        return -1;
+
+    // Y plane
+    scale_plane(src, src_width, src_height, 1,
+            dst, dst_width, dst_height, xs);
+    // UV plane
+    scale_plane(src + src_width * src_height, src_width / 2, src_height / 2, 2,
+            dst + dst_width * dst_height, dst_width / 2, dst_height / 2, xs);
+
+    free(xs);
+
+    return 0;
+}
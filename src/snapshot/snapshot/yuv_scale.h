@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2022 roleo.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fixed point NV12 scaler.
+ */
+
+#ifndef YUV_SCALE_H
+#define YUV_SCALE_H
+
+int nv12_scale(const unsigned char *src, int src_width, int src_height,
+        unsigned char *dst, int dst_width, int dst_height);
+
+#endif // YUV_SCALE_H
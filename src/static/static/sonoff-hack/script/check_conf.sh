@@ -52,6 +52,13 @@ TOPIC_BIRTH_WILL=status
 TOPIC_MOTION=motion_detection
 TOPIC_MOTION_IMAGE=motion_detection_image
 MOTION_IMAGE_DELAY=0.5
+TOPIC_MOTION_IMAGE_LOW=
+MOTION_IMAGE_LOW_SCALE=4
+MOTION_IMAGE_LOW_QUALITY=60
+TOPIC_MOTION_BURST=motion_detection_burst
+MOTION_BURST_FRAMES=0
+MOTION_BURST_INTERVAL=0.5
+MOTION_BURST_MODE=sequence
 BIRTH_MSG=online
 WILL_MSG=offline
 MOTION_START_MSG=motion_start
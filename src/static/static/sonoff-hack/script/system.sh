@@ -160,6 +160,8 @@ if [[ $PTZ_PRESENT -eq 1 ]]; then
     rmmod ptz_drv.ko
     sleep 1
     insmod /mnt/mtd/ipc//app/drive/ptz_drv.ko factory="Links" AutoRun=1 Horizontal=3500 Vertical=900
+    # ptzd keeps the driver open for the ptz command, the web ui and the boot preset
+    $SONOFF_HACK_PREFIX/bin/ptzd -f $SONOFF_HACK_PREFIX/etc/ptz_presets.conf > /dev/null 2>&1 &
     if [[ $(get_config PTZ_PRESET_BOOT) != "default" ]] ; then
         (sleep 20 && /mnt/mmc/sonoff-hack/bin/ptz -a go_preset -f $SONOFF_HACK_PREFIX/etc/ptz_presets.conf -n $(get_config PTZ_PRESET_BOOT)) &
     fi
@@ -239,7 +241,6 @@ fi
 
 if [[ $(get_config MQTT) == "yes" ]] ; then
     $SONOFF_HACK_PREFIX/bin/mqtt-sonoff &
-    $SONOFF_HACK_PREFIX/bin/mqtt-config &
 fi
 
 if [[ $RTSP_PORT != "554" ]] ; then
@@ -317,10 +318,12 @@ if [[ $(get_config ONVIF) == "yes" ]] ; then
             echo "move_right=/mnt/mmc/sonoff-hack/bin/ptz -a left" >> $ONVIF_SRVD_CONF
             echo "move_up=/mnt/mmc/sonoff-hack/bin/ptz -a down" >> $ONVIF_SRVD_CONF
             echo "move_down=/mnt/mmc/sonoff-hack/bin/ptz -a up" >> $ONVIF_SRVD_CONF
+            echo "ptz_reverse=1" >> $ONVIF_SRVD_CONF
         fi
         echo "move_stop=/mnt/mmc/sonoff-hack/bin/ptz -a stop" >> $ONVIF_SRVD_CONF
         echo "move_preset=/mnt/mmc/sonoff-hack/bin/ptz -f /mnt/mmc/sonoff-hack/etc/ptz_presets.conf -a go_preset -n %t" >> $ONVIF_SRVD_CONF
         echo "set_preset=/mnt/mmc/sonoff-hack/bin/ptz -f /mnt/mmc/sonoff-hack/etc/ptz_presets.conf -a set_preset -e %n -n %t" >> $ONVIF_SRVD_CONF
+        echo "ptz_socket=/tmp/ptzd.sock" >> $ONVIF_SRVD_CONF
     fi
 
     onvif_srvd --conf_file $ONVIF_SRVD_CONF
@@ -333,6 +336,10 @@ fi
 # Run rtsp watchdog
 $SONOFF_HACK_PREFIX/script/wd_rtsp.sh &
 
+if [[ $(get_config SNAPSHOT_VIDEO) == "yes" ]] ; then
+    $SONOFF_HACK_PREFIX/script/thumb.sh start
+fi
+
 # Add crontab
 CRONTAB=$(get_config CRONTAB)
 FREE_SPACE=$(get_config FREE_SPACE)
@@ -340,9 +347,6 @@ mkdir -p /var/spool/cron/crontabs/
 if [ ! -z "$CRONTAB" ]; then
     echo -e "$CRONTAB" > /var/spool/cron/crontabs/root
 fi
-if [[ $(get_config SNAPSHOT_VIDEO) == "yes" ]] ; then
-    echo "* * * * * /mnt/mmc/sonoff-hack/script/thumb.sh cron" >> /var/spool/cron/crontabs/root
-fi
 if [ "$FREE_SPACE" != "0" ]; then
     echo "0 * * * * sleep 20; /mnt/mmc/sonoff-hack/script/clean_records.sh $FREE_SPACE" >> /var/spool/cron/crontabs/root
 fi
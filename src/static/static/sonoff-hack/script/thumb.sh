@@ -5,24 +5,18 @@
 # 	ash "/mnt/mmc/sonoff-hack/script/thumb.sh" start
 # 	ash "/mnt/mmc/sonoff-hack/script/thumb.sh" stop
 #
-CONF_FILE="etc/system.conf"
-
-YI_HACK_PREFIX="/mnt/mmc/sonoff-hack"
-
-get_config()
-{
-    key=$1
-    grep -w $1 $YI_HACK_PREFIX/$CONF_FILE | cut -d "=" -f2
-}
+# The thumbnails are created by thumbd:
+#   start: run the daemon, new files are detected with inotify
+#   cron:  create the missing thumbnails of the newest folder and exit
+# They are 640x360 with jpeg quality 75, as the resize_jpg output of the
+# previous script (thumbd -q changes it).
+#
 # Setup env.
 export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:/mnt/mmc/sonoff-hack/lib
 export PATH=$PATH:/mnt/mmc/sonoff-hack/bin:/mnt/mmc/sonoff-hack/sbin:/mnt/mmc/sonoff-hack/usr/bin:/mnt/mmc/sonoff-hack/usr/sbin
 #
 # Script Configuration.
 FOLDER_TO_WATCH="/mnt/mmc/alarm_record"
-FOLDER_MINDEPTH="1"
-FILE_WATCH_PATTERN="*.mp4"
-SLEEP_CYCLE_SECONDS="45"
 #
 # Runtime Variables.
 SCRIPT_FULLFN="thumb.sh"
@@ -31,18 +25,6 @@ LOGFILE="/tmp/${SCRIPT_NAME}.log"
 LOG_MAX_LINES="200"
 
 
-#
-# -----------------------------------------------------
-# -------------- START OF FUNCTION BLOCK --------------
-# -----------------------------------------------------
-
-
-lbasename ()
-{
-	echo ${1:0:$((${#1} - 4))}
-}
-
-
 logAdd ()
 {
 	TMP_DATETIME="$(date '+%Y-%m-%d [%H-%M-%S]')"
@@ -54,145 +36,25 @@ logAdd ()
 }
 
 
-lstat ()
-{
-	if [ -d "${1}" ]; then
-		ls -a -l -td "${1}" | awk '{k=0;for(i=0;i<=8;i++)k+=((substr($1,i+2,1)~/[rwx]/) \
-				 *2^(8-i));if(k)printf("%0o ",k);print}' | \
-				 cut -d " " -f 1
-	else
-		ls -a -l "${1}" | awk '{k=0;for(i=0;i<=8;i++)k+=((substr($1,i+2,1)~/[rwx]/) \
-				 *2^(8-i));if(k)printf("%0o ",k);print}' | \
-				 cut -d " " -f 1
-	fi
-}
-
-
-checkFiles ()
-{
-	#
-	logAdd "[INFO] checkFiles"
-
-	L_PATH=$(find "${FOLDER_TO_WATCH}" -type d -maxdepth 1 | sort -r | head -1)
-	#
-	# Search for new files.
-	if [ -f "/usr/bin/sort" ]; then
-		# Default: Optimized for busybox
-		L_FILE_LIST="$(find "${L_PATH}" -mindepth ${FOLDER_MINDEPTH} -type f \( -name "${FILE_WATCH_PATTERN}" \) | sort -k 1 -n)"
-	else
-		# Alternative: Unsorted output
-		L_FILE_LIST="$(find "${L_PATH}" -mindepth ${FOLDER_MINDEPTH} -type f \( -name "${FILE_WATCH_PATTERN}" \))"
-	fi
-	if [ -z "${L_FILE_LIST}" ]; then
-		return 0
-	fi
-	#
-	echo "${L_FILE_LIST}" | while read file; do
-		BASE_NAME=$(lbasename "$file")
-		if [ ! -f $BASE_NAME.jpg ]; then
-			minimp4_sonoff -t 0 $file $BASE_NAME.h26x
-			if [ $? -ne 0 ]; then
-				logAdd "[ERROR] checkFiles: demux mp4 FAILED - [${file}]."
-				rm -f $BASE_NAME.h26x
-				return 0
-			fi
-			imggrabber -f $BASE_NAME.h26x -r high -q 50 -w > $BASE_NAME.jpg
-			if [ $? -ne 0 ]; then
-				logAdd "[ERROR] checkFiles: create jpg FAILED - [${file}]."
-				rm -f $BASE_NAME.h26x
-				rm -f $BASE_NAME.jpg
-				return 0
-			fi
-			rm -f $BASE_NAME.h26x
-			resize_jpg -i $BASE_NAME.jpg -o $BASE_NAME.low.jpg
-			if [ $? -ne 0 ]; then
-				logAdd "[ERROR] checkFiles: resize jpg FAILED - [${file}]."
-				rm -f $BASE_NAME.h26x
-				rm -f $BASE_NAME.jpg
-				rm -f $BASE_NAME.low.jpg
-				return 0
-			fi
-			mv $BASE_NAME.low.jpg $BASE_NAME.jpg
-			logAdd "[INFO] checkFiles: createThumb SUCCEEDED - [${file}]."
-			sync
-		else
-			logAdd "[INFO] checkFiles: ignore file [$BASE_NAME.jpg] - already present."
-		fi
-		#
-	done
-	#
-	return 0
-}
-
-
-serviceMain ()
-{
-	#
-	# Usage:		serviceMain	[--one-shot]
-	# Called By:	MAIN
-	#
-	logAdd "[INFO] === SERVICE START ==="
-	# sleep 10
-	while (true); do
-		# Check if folder exists.
-		if [ ! -d "${FOLDER_TO_WATCH}" ]; then 
-			mkdir -p "${FOLDER_TO_WATCH}"
-		fi
-		# 
-		# Ensure correct file permissions.
-		if ( ! lstat "${FOLDER_TO_WATCH}/" | grep -q "^755$" ); then
-			logAdd "[WARN] Adjusting folder permissions to 0755 ..."
-			chmod -R 0755 "${FOLDER_TO_WATCH}"
-		fi
-		#
-		checkFiles
-		#
-		if [ "${1}" = "--one-shot" ]; then
-			break
-		fi
-		#
-		sleep ${SLEEP_CYCLE_SECONDS}
-	done
-	return 0
-}
-# ---------------------------------------------------
-# -------------- END OF FUNCTION BLOCK --------------
-# ---------------------------------------------------
-#
-# set +m
 trap "" SIGHUP
 #
 if [ "${1}" = "cron" ]; then
-	RUNNING=$(ps | grep $SCRIPT_FULLFN | grep -v grep | grep /bin/sh | awk 'END { print NR }')
-	if [ $RUNNING -gt 1 ]; then
+	if pidof thumbd > /dev/null; then
 		logAdd "[INFO] === SERVICE ALREADY RUNNING ==="
 		exit 0
 	fi
-	serviceMain --one-shot
-	logAdd "[INFO] === SERVICE STOPPED ==="
+	thumbd -f "${FOLDER_TO_WATCH}" -w -o 2>> "${LOGFILE}"
 	exit 0
 elif [ "${1}" = "start" ]; then
-	RUNNING=$(ps | grep $SCRIPT_FULLFN | grep -v grep | grep /bin/sh | awk 'END { print NR }')
-	if [ $RUNNING -gt 1 ]; then
+	if pidof thumbd > /dev/null; then
 		logAdd "[INFO] === SERVICE ALREADY RUNNING ==="
 		exit 0
 	fi
-	serviceMain &
-	#
-	# Wait for kill -INT.
-	wait
+	logAdd "[INFO] === SERVICE START ==="
+	thumbd -f "${FOLDER_TO_WATCH}" -w 2>> "${LOGFILE}" &
 	exit 0
 elif [ "${1}" = "stop" ]; then
-	ps w | grep -v grep | grep "ash ${0}" | sed 's/ \+/|/g' | sed 's/^|//' | cut -d '|' -f 1 | grep -v "^$$" | while read pidhandle; do
-		echo "[INFO] Terminating old service instance [${pidhandle}] ..."
-		kill -9 "${pidhandle}"
-	done
-	#
-	# Check if parts of the service are still running.
-	if [ "$(ps w | grep -v grep | grep "ash ${0}" | sed 's/ \+/|/g' | sed 's/^|//' | cut -d '|' -f 1 | grep -v "^$$" | grep -c "^")" -gt 1 ]; then
-		logAdd "[ERROR] === SERVICE FAILED TO STOP ==="
-		exit 99
-	fi
+	killall thumbd 2> /dev/null
 	logAdd "[INFO] === SERVICE STOPPED ==="
 	exit 0
 fi
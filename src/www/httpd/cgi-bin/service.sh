@@ -120,6 +120,7 @@ start_onvif()
         echo "move_right=/mnt/mmc/sonoff-hack/bin/ptz -a left" >> $ONVIF_SRVD_CONF
         echo "move_up=/mnt/mmc/sonoff-hack/bin/ptz -a down" >> $ONVIF_SRVD_CONF
         echo "move_down=/mnt/mmc/sonoff-hack/bin/ptz -a up" >> $ONVIF_SRVD_CONF
+        echo "ptz_reverse=1" >> $ONVIF_SRVD_CONF
     else
         echo "move_left=/mnt/mmc/sonoff-hack/bin/ptz -a left" >> $ONVIF_SRVD_CONF
         echo "move_right=/mnt/mmc/sonoff-hack/bin/ptz -a right" >> $ONVIF_SRVD_CONF
@@ -129,6 +130,7 @@ start_onvif()
     echo "move_stop=/mnt/mmc/sonoff-hack/bin/ptz -a stop" >> $ONVIF_SRVD_CONF
     echo "move_preset=/mnt/mmc/sonoff-hack/bin/ptz -f /mnt/mmc/sonoff-hack/etc/ptz_presets.conf -a go_preset -n %t" >> $ONVIF_SRVD_CONF
     echo "set_preset=/mnt/mmc/sonoff-hack/bin/ptz -f /mnt/mmc/sonoff-hack/etc/ptz_presets.conf -a set_preset -e %n -n %t" >> $ONVIF_SRVD_CONF
+    echo "ptz_socket=/tmp/ptzd.sock" >> $ONVIF_SRVD_CONF
 
     onvif_srvd --conf_file $ONVIF_SRVD_CONF
 }
@@ -238,14 +240,12 @@ if [ "$ACTION" == "start" ] ; then
         start_ftpd $PARAM1
     elif [ "$NAME" == "mqtt" ]; then
         mqtt-sonoff > /dev/null &
-        mqtt-config > /dev/null &
     elif [ "$NAME" == "all" ]; then
         start_rtsp
         start_onvif
         start_wsdd
         start_ftpd
         mqtt-sonoff > /dev/null &
-        mqtt-config > /dev/null &
     fi
 elif [ "$ACTION" == "stop" ] ; then
     if [ "$NAME" == "rtsp" ]; then
@@ -257,14 +257,12 @@ elif [ "$ACTION" == "stop" ] ; then
     elif [ "$NAME" == "ftpd" ]; then
         stop_ftpd $PARAM1
     elif [ "$NAME" == "mqtt" ]; then
-        killall mqtt-config
         killall mqtt-sonoff
     elif [ "$NAME" == "all" ]; then
         stop_rtsp
         stop_onvif
         stop_wsdd
         stop_ftpd
-        killall mqtt-config
         killall mqtt-sonoff
     fi
 elif [ "$ACTION" == "status" ] ; then